@@ -0,0 +1,149 @@
+/*
+ * Compares the dense and bitboard Board representations on the hot paths of a
+ * game: placement validation, firing and repeated-shot lookups.
+ *
+ *   gcc -O2 -I src -o bench_board bench/bench_board.c src/board.c
+ *   ./bench_board [min_seconds_per_case]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "board.h"
+
+typedef struct {
+    const char *name;
+    void (*setup)(Board *board, ShotLog *shots);
+    void (*run)(Board *board, ShotLog *shots, long *ops);
+} BenchCase;
+
+static volatile long sink;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void place_fleet(Board *board) {
+    for (int piece = 0; piece < MAX_SHIPS; piece++) {
+        insert_piece_on_board(board, 0, 0, 0, piece * 2, piece + 1);
+    }
+}
+
+/* Validates one piece at a time, as an Initialize packet does. */
+static void bench_placement(Board *board, ShotLog *shots, long *ops) {
+    (void)shots;
+    long valid = 0;
+
+    init_board(board, board->kind, board->width, board->height);
+    place_fleet(board);
+
+    for (int row = 0; row < board->height && row < 64; row++) {
+        for (int col = 0; col < board->width && col < 64; col++) {
+            valid += check_valid_piece_placement(board, (row + col) % shape_count, col % 4, row, col) == 0;
+            (*ops)++;
+        }
+    }
+    sink += valid;
+}
+
+/* Tries every shape and rotation at every cell, as a placement search would. */
+static void bench_placement_sweep(Board *board, ShotLog *shots, long *ops) {
+    (void)shots;
+    long valid = 0;
+
+    init_board(board, board->kind, board->width, board->height);
+    place_fleet(board);
+
+    for (int shape = 0; shape < shape_count; shape++) {
+        for (int rotation = 0; rotation < 4; rotation++) {
+            valid += count_valid_placements(board, shape, rotation);
+            *ops += (long)board->width * board->height;
+        }
+    }
+    sink += valid;
+}
+
+/* Fires at every cell of a freshly placed board. */
+static void bench_shots(Board *board, ShotLog *shots, long *ops) {
+    init_board(board, board->kind, board->width, board->height);
+    shot_log_clear(shots);
+    place_fleet(board);
+
+    for (int row = 0; row < board->height; row++) {
+        for (int col = 0; col < board->width; col++) {
+            if (validate_shot_coordinates(row, col, board) == 0) {
+                sink += process_shot(board, shots, row, col);
+            }
+            (*ops)++;
+        }
+    }
+}
+
+static void shoot_every_cell(Board *board, ShotLog *shots) {
+    long ignored = 0;
+    bench_shots(board, shots, &ignored);
+}
+
+/* Re-validates every cell of a fully shot board; every lookup is a 401. */
+static void bench_repeat_lookup(Board *board, ShotLog *shots, long *ops) {
+    (void)shots;
+    long repeated = 0;
+    for (int row = 0; row < board->height; row++) {
+        for (int col = 0; col < board->width; col++) {
+            repeated += validate_shot_coordinates(row, col, board) == 401;
+            (*ops)++;
+        }
+    }
+    sink += repeated;
+}
+
+static double measure(const BenchCase *bench, BoardKind kind, int size, double min_seconds) {
+    Board *board = create_board(kind, size, size);
+    ShotLog shots;
+    shot_log_init(&shots);
+    if (!board) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (bench->setup) {
+        bench->setup(board, &shots);
+    }
+
+    long ops = 0;
+    double start = now_seconds();
+    double elapsed;
+    do {
+        bench->run(board, &shots, &ops);
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_seconds);
+
+    free_board(board);
+    shot_log_free(&shots);
+    return elapsed * 1e9 / ops;
+}
+
+int main(int argc, char **argv) {
+    double min_seconds = argc > 1 ? atof(argv[1]) : 0.2;
+    const int sizes[] = {10, 100, 1000};
+    const BenchCase cases[] = {
+        {"placement", NULL, bench_placement},
+        {"placement_sweep", NULL, bench_placement_sweep},
+        {"shots", NULL, bench_shots},
+        {"repeat_lookup", shoot_every_cell, bench_repeat_lookup},
+    };
+
+    printf("%-16s %10s %14s %14s %9s\n", "case", "board", "dense ns/op", "bitboard ns/op", "speedup");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            double dense = measure(&cases[c], BOARD_DENSE, sizes[s], min_seconds);
+            double bitboard = measure(&cases[c], BOARD_BITBOARD, sizes[s], min_seconds);
+            char label[32];
+            snprintf(label, sizeof(label), "%dx%d", sizes[s], sizes[s]);
+            printf("%-16s %10s %14.2f %14.2f %8.2fx\n", cases[c].name, label, dense, bitboard, dense / bitboard);
+        }
+    }
+
+    return 0;
+}
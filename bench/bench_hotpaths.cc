@@ -0,0 +1,357 @@
+/*
+ * Google Benchmark suite for the per-packet hot paths: placement checks,
+ * Initialize validation, firing, queries, the packet decoders and the
+ * built-in AI's choice of shot. Board sizes sweep from 10x10 to 4096x4096
+ * and shot densities from an empty board to a full one.
+ *
+ *   gcc -O2 -c src/board.c src/engine.c src/protocol.c src/ai.c
+ *   g++ -O2 -std=c++17 -I src -o bench_hotpaths bench/bench_hotpaths.cc board.o engine.o protocol.o ai.o -lbenchmark -lpthread
+ *   ./bench_hotpaths --benchmark_out=results.json --benchmark_out_format=json
+ *   python3 bench/compare.py baseline.json results.json
+ */
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "ai.h"
+#include "board.h"
+#include "engine.h"
+#include "protocol.h"
+}
+
+namespace {
+
+const int64_t kSizes[] = {10, 64, 256, 1024, 4096};
+const int64_t kDensities[] = {0, 25, 50, 75, 100};
+
+/* Five pieces that fit any board of at least 10x10. */
+const int kFleet[20] = {1, 1, 0, 0, 1, 1, 0, 2, 1, 1, 0, 4, 1, 1, 2, 2, 1, 1, 2, 0};
+
+BoardKind board_kind(int64_t arg) {
+    return (BoardKind)arg;
+}
+
+const char *board_label(int64_t arg) {
+    static const char *const labels[] = {"dense", "bitboard", "sparse"};
+    return labels[arg];
+}
+
+Board *new_board(BoardKind kind, int size) {
+    Board *board = create_board(kind, size, size);
+    if (!board) {
+        std::abort();
+    }
+    return board;
+}
+
+void place_fleet(Board *board) {
+    for (int piece = 0; piece < MAX_SHIPS; piece++) {
+        const int *fields = &kFleet[piece * 4];
+        insert_piece_on_board(board, fields[0] - 1, fields[1] - 1, fields[2], fields[3], piece + 1);
+    }
+}
+
+/* Every cell of a size x size board in a fixed pseudo-random order. */
+std::vector<int> shuffled_cells(int size) {
+    std::vector<int> cells((size_t)size * size);
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i] = (int)i;
+    }
+    std::shuffle(cells.begin(), cells.end(), std::mt19937(42));
+    return cells;
+}
+
+/*
+ * A board with the fleet placed and the first density% of `cells` already
+ * fired at, recorded in `log`.
+ */
+void fire_to_density(Board *board, ShotLog *log, const std::vector<int> &cells, size_t count) {
+    int size = board->width;
+    init_board(board, board->kind, size, size);
+    shot_log_clear(log);
+    place_fleet(board);
+    for (size_t i = 0; i < count; i++) {
+        process_shot(board, log, cells[i] / size, cells[i] % size);
+    }
+}
+
+/* Args: board size, board kind. */
+void SizesAndKinds(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size", "kind"});
+    for (int64_t size : kSizes) {
+        for (int64_t kind : {BOARD_DENSE, BOARD_BITBOARD, BOARD_SPARSE}) {
+            bench->Args({size, kind});
+        }
+    }
+}
+
+/* As above without sparse boards, whose placement search is the plain per-cell walk. */
+void SizesAndGridKinds(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size", "kind"});
+    for (int64_t size : kSizes) {
+        for (int64_t kind : {BOARD_DENSE, BOARD_BITBOARD}) {
+            bench->Args({size, kind});
+        }
+    }
+}
+
+/* Args: board size, board kind, shot density in percent. */
+void SizesKindsAndDensities(benchmark::internal::Benchmark *bench) {
+    bench->ArgNames({"size", "kind", "density"});
+    for (int64_t size : kSizes) {
+        for (int64_t kind : {BOARD_DENSE, BOARD_BITBOARD, BOARD_SPARSE}) {
+            for (int64_t density : kDensities) {
+                bench->Args({size, kind, density});
+            }
+        }
+    }
+}
+
+/* One piece checked at anchors spread over the whole board. */
+void BM_CheckValidPiecePlacement(benchmark::State &state) {
+    int size = (int)state.range(0);
+    Board *board = new_board(board_kind(state.range(1)), size);
+    place_fleet(board);
+    std::vector<int> anchors = shuffled_cells(size);
+    size_t next = 0;
+
+    for (auto _ : state) {
+        int cell = anchors[next];
+        int shape = cell % SHAPE_COUNT;
+        benchmark::DoNotOptimize(check_valid_piece_placement(board, shape, cell & 3, cell / size, cell % size));
+        next = next + 1 == anchors.size() ? 0 : next + 1;
+    }
+
+    state.SetLabel(board_label(state.range(1)));
+    free_board(board);
+}
+BENCHMARK(BM_CheckValidPiecePlacement)->Apply(SizesAndKinds);
+
+/* Every anchor of every rotation of every shape, as a placement search does. */
+void BM_CountValidPlacements(benchmark::State &state) {
+    int size = (int)state.range(0);
+    Board *board = new_board(board_kind(state.range(1)), size);
+    place_fleet(board);
+
+    for (auto _ : state) {
+        long valid = 0;
+        for (int shape = 0; shape < SHAPE_COUNT; shape++) {
+            for (int rotation = 0; rotation < 4; rotation++) {
+                valid += count_valid_placements(board, shape, rotation);
+            }
+        }
+        benchmark::DoNotOptimize(valid);
+    }
+
+    state.SetItemsProcessed(state.iterations() * SHAPE_COUNT * 4 * (int64_t)size * size);
+    state.SetLabel(board_label(state.range(1)));
+    free_board(board);
+}
+BENCHMARK(BM_CountValidPlacements)->Apply(SizesAndGridKinds);
+
+/*
+ * A whole Initialize packet through the engine: parameter checks, placement
+ * on the scratch board and the copy onto the player's board.
+ */
+void BM_ValidateAndPlacePieces(benchmark::State &state) {
+    int size = (int)state.range(0);
+    ArenaPool pool = {};
+    Game game;
+    GameStep step;
+    Packet begin = {};
+    Packet init = {};
+
+    begin.type = PACKET_BEGIN;
+    begin.spaced = true;
+    begin.tokens = begin.integers = 2;
+    begin.values[0] = begin.values[1] = size;
+    init.type = PACKET_INITIALIZE;
+    init.spaced = true;
+    init.tokens = init.integers = PACKET_MAX_VALUES;
+    std::memcpy(init.values, kFleet, sizeof(kFleet));
+
+    game_init(&game, board_kind(state.range(1)), &pool);
+    game_apply(&game, 0, &begin, &step);
+    begin.bare = true;
+    begin.spaced = false;
+    begin.tokens = begin.integers = 0;
+    game_apply(&game, 1, &begin, &step);
+
+    for (auto _ : state) {
+        /* Stay in the first Initialize phase so every iteration validates. */
+        game.phase = PHASE_INIT_P1;
+        game.active = 0;
+        game_apply(&game, 0, &init, &step);
+        benchmark::DoNotOptimize(step.replies[0].type);
+    }
+
+    state.SetLabel(board_label(state.range(1)));
+    game_release(&game);
+    arena_pool_clear(&pool);
+}
+BENCHMARK(BM_ValidateAndPlacePieces)->Apply(SizesAndKinds);
+
+/*
+ * Fresh shots on a board already fired at to the given density, including
+ * the sunk-ship bookkeeping. Shots are drawn from the next quarter of the
+ * cells, and the board is rebuilt off the clock when that runs out, so the
+ * density stays within its band. At 100% every shot is a repeat and only
+ * the 401 check runs.
+ */
+void BM_ProcessShot(benchmark::State &state) {
+    int size = (int)state.range(0);
+    int64_t density = state.range(2);
+    Board *board = new_board(board_kind(state.range(1)), size);
+    ShotLog log;
+    shot_log_init(&log);
+    std::vector<int> cells = shuffled_cells(size);
+    size_t first = cells.size() * density / 100;
+    size_t last = density == 100 ? cells.size() : cells.size() * (density + 25) / 100;
+    if (last == first) {
+        last = first + 1;
+    }
+
+    fire_to_density(board, &log, cells, first);
+    size_t next = density == 100 ? 0 : first;
+
+    for (auto _ : state) {
+        int cell = cells[next];
+        int row = cell / size;
+        int col = cell % size;
+        if (validate_shot_coordinates(row, col, board) == 0) {
+            benchmark::DoNotOptimize(process_shot(board, &log, row, col));
+        }
+        if (++next == last) {
+            if (density == 100) {
+                next = 0;
+            } else {
+                state.PauseTiming();
+                fire_to_density(board, &log, cells, first);
+                next = first;
+                state.ResumeTiming();
+            }
+        }
+    }
+
+    state.SetLabel(board_label(state.range(1)));
+    shot_log_free(&log);
+    free_board(board);
+}
+BENCHMARK(BM_ProcessShot)->Apply(SizesKindsAndDensities);
+
+/*
+ * A full "Q" after each new shot: the incremental sort of the shot log and
+ * the text encoding of every entry.
+ */
+void BM_QueryResponse(benchmark::State &state) {
+    int size = (int)state.range(0);
+    int64_t density = state.range(1);
+    Board *board = new_board(BOARD_DENSE, size);
+    ShotLog log;
+    shot_log_init(&log);
+    OutputBuffer out = {};
+    std::vector<int> cells = shuffled_cells(size);
+    size_t count = cells.size() * density / 100;
+
+    fire_to_density(board, &log, cells, count);
+    shot_log_sorted(&log);
+    size_t next = count;
+
+    for (auto _ : state) {
+        if (next < cells.size()) {
+            process_shot(board, &log, cells[next] / size, cells[next] % size);
+            next++;
+        }
+        Reply reply = {};
+        reply.type = REPLY_QUERY;
+        reply.value = get_remaining_ships(board);
+        reply.shots = shot_log_sorted(&log);
+        reply.shot_count = log.count;
+        out.length = 0;
+        encode_reply(&reply, WIRE_TEXT, &out);
+        benchmark::DoNotOptimize(out.data);
+    }
+
+    state.SetBytesProcessed(state.iterations() * (int64_t)out.length);
+    output_free(&out);
+    shot_log_free(&log);
+    free_board(board);
+}
+/* A full 4096x4096 log is hundreds of megabytes per reply; stop at 1024. */
+BENCHMARK(BM_QueryResponse)->ArgNames({"size", "density"})->ArgsProduct({{10, 64, 256, 1024}, {0, 25, 50, 75, 100}});
+
+/*
+ * The AI's next shot on a board already fired at to the given density, with
+ * the replies it got: a fresh board is a full count of every placement, and
+ * once there are hits on ships still afloat only the rows around them are
+ * counted. The AI's knowledge does not change between iterations.
+ */
+void BM_AiChoose(benchmark::State &state) {
+    int size = (int)state.range(0);
+    int64_t density = state.range(1);
+    Board *board = new_board(BOARD_DENSE, size);
+    ShotLog log;
+    shot_log_init(&log);
+    AiPlayer ai;
+    if (!ai_init(&ai, size, size, 42)) {
+        std::abort();
+    }
+    std::vector<int> cells = shuffled_cells(size);
+    size_t count = cells.size() * density / 100;
+
+    place_fleet(board);
+    for (size_t i = 0; i < count && get_remaining_ships(board) > 1; i++) {
+        int row = cells[i] / size;
+        int col = cells[i] % size;
+        char result = process_shot(board, &log, row, col);
+        ai_learn(&ai, row, col, result, get_remaining_ships(board));
+    }
+
+    for (auto _ : state) {
+        int row, col;
+        ai_choose(&ai, &row, &col);
+        benchmark::DoNotOptimize(row);
+        benchmark::DoNotOptimize(col);
+    }
+
+    ai_free(&ai);
+    shot_log_free(&log);
+    free_board(board);
+}
+BENCHMARK(BM_AiChoose)->ArgNames({"size", "density"})->ArgsProduct({{10, 64, 256, 1024}, {0, 10, 50}});
+
+void BM_ScanPacket(benchmark::State &state, const char *text) {
+    Packet packet;
+    for (auto _ : state) {
+        scan_packet(text, &packet);
+        benchmark::DoNotOptimize(packet.integers);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t)std::strlen(text));
+}
+BENCHMARK_CAPTURE(BM_ScanPacket, begin, "B 10 10");
+BENCHMARK_CAPTURE(BM_ScanPacket, initialize, "I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 2 2 1 1 2 0");
+BENCHMARK_CAPTURE(BM_ScanPacket, shoot, "S 1023 4095");
+BENCHMARK_CAPTURE(BM_ScanPacket, malformed, "S 12x 4 -2147483649 junk");
+
+void BM_DecodeBinaryRecord(benchmark::State &state, uint8_t type) {
+    uint8_t record[BINARY_RECORD_MAX] = {type};
+    for (size_t i = 1; i < sizeof(record); i++) {
+        record[i] = (uint8_t)(i * 7);
+    }
+    Packet packet;
+    for (auto _ : state) {
+        decode_binary_record(record, &packet);
+        benchmark::DoNotOptimize(packet.integers);
+    }
+}
+BENCHMARK_CAPTURE(BM_DecodeBinaryRecord, initialize, BINARY_TYPE('I'));
+BENCHMARK_CAPTURE(BM_DecodeBinaryRecord, shoot, BINARY_TYPE('S'));
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,73 @@
+#!/bin/bash
+# Compares the epoll and io_uring backends: the same loadgen run against a
+# fresh server on each, reporting throughput, the server's CPU time and the
+# system calls its workers made per turn, from the metrics endpoint.
+#
+#   bench/bench_io.sh SERVER LOADGEN [server args] [-- loadgen args]
+#
+# Loadgen defaults to --games 3000 --concurrency 100 --size 10x10.
+set -u
+
+server=$1 loadgen=$2
+shift 2
+server_args=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    server_args="$server_args $1"
+    shift
+done
+[ $# -gt 0 ] && shift
+[ $# -eq 0 ] && set -- --games 3000 --concurrency 100 --size 10x10
+
+metrics_port=2203
+log=$(mktemp)
+pid=
+fell_back=
+trap 'kill $pid 2>/dev/null; rm -f "$log"' EXIT
+
+listening() {
+    awk 'NR > 1 && $4 == "0A" { print $2 }' /proc/net/tcp /proc/net/tcp6 2>/dev/null |
+        grep -q ":$1\$"
+}
+
+metric() {
+    exec 3<>/dev/tcp/127.0.0.1/$metrics_port
+    awk -v name="$1" '$1 == name { print $2 }' <&3
+    exec 3<&-
+}
+
+# utime + stime of the server, in clock ticks.
+cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$pid/stat
+}
+
+printf '%-9s %9s %10s %12s %14s %16s\n' backend games/s turns io_syscalls syscalls/turn "CPU us/turn"
+for backend in epoll io_uring; do
+    $server $server_args --io-backend $backend --metrics-port $metrics_port --log-level warn > "$log" 2>&1 &
+    pid=$!
+    until listening 0899 && listening 089A && listening 089B; do
+        if ! kill -0 $pid 2>/dev/null; then
+            echo "server did not start"
+            cat "$log"
+            exit 1
+        fi
+        sleep 0.05
+    done
+
+    rate=$($loadgen "$@" | awk '/games\/sec/ { print $2 }')
+    turns=$(metric turns_total)
+    calls=$(metric io_syscalls_total)
+    ticks=$(cpu_ticks)
+    kill -TERM $pid
+    wait $pid
+    pid=
+
+    if grep -q 'falling back to epoll' "$log"; then
+        backend="$backend*"
+        fell_back=1
+    fi
+    printf '%-9s %9s %10s %12s %14.2f %16.2f\n' "$backend" "$rate" "$turns" "$calls" \
+        "$(echo "$calls $turns" | awk '{ print $2 ? $1 / $2 : 0 }')" \
+        "$(echo "$ticks $turns $(getconf CLK_TCK)" | awk '{ print $2 ? $1 / $3 * 1e6 / $2 : 0 }')"
+done
+[ -n "$fell_back" ] && echo "* io_uring was unavailable, so this server ran on epoll"
+exit 0
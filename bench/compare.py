@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""Compares two Google Benchmark JSON result files and flags regressions.
+
+    python3 bench/compare.py baseline.json results.json [--threshold 5] [--metric cpu_time]
+
+Benchmarks are matched by name. With --benchmark_repetitions the median
+aggregate is used, otherwise the single run. Exits 1 if any benchmark got
+slower by more than the threshold percentage.
+"""
+import argparse
+import json
+import sys
+
+UNITS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path, metric):
+    with open(path) as f:
+        data = json.load(f)
+
+    times = {}
+    medians = {}
+    for bench in data.get("benchmarks", []):
+        if bench.get("error_occurred"):
+            continue
+        value = bench[metric] * UNITS[bench.get("time_unit", "ns")]
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[bench["run_name"]] = value
+        else:
+            times.setdefault(bench.get("run_name", bench["name"]), value)
+    times.update(medians)
+    return times
+
+
+def format_ns(ns):
+    for unit in ("s", "ms", "us"):
+        if ns >= UNITS[unit]:
+            return "%.2f %s" % (ns / UNITS[unit], unit)
+    return "%.2f ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("contender")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="percent slowdown that counts as a regression (default 5)")
+    parser.add_argument("--metric", choices=("cpu_time", "real_time"), default="cpu_time")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline, args.metric)
+    contender = load(args.contender, args.metric)
+
+    regressions = 0
+    width = max((len(name) for name in baseline), default=9)
+    print("%-*s %12s %12s %9s" % (width, "benchmark", "baseline", "contender", "change"))
+    for name, before in baseline.items():
+        after = contender.get(name)
+        if after is None:
+            print("%-*s %12s %12s %9s" % (width, name, format_ns(before), "missing", ""))
+            continue
+        change = (after - before) / before * 100 if before else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-*s %12s %12s %+8.1f%%%s" % (width, name, format_ns(before), format_ns(after), change, flag))
+
+    for name in contender.keys() - baseline.keys():
+        print("%-*s %12s %12s %9s" % (width, name, "new", format_ns(contender[name]), ""))
+
+    if regressions:
+        print("%d benchmark(s) regressed by more than %.1f%%" % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
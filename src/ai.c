@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ai.h"
+
+/* Rows a placement spans below its top row, at most. */
+#define SHAPE_REACH 3
+
+static inline size_t cell_bit(const AiPlayer *ai, int row, int col) {
+    return (size_t)row * ai->row_words * 64 + col;
+}
+
+/*
+ * Every rotation of every shape, moved to its bounding box's corner, with
+ * the rotations that only repeat another shape's cells dropped so each
+ * placement is counted once.
+ */
+static void collect_shapes(AiPlayer *ai) {
+    ai->shape_count = 0;
+    for (int s = 0; s < SHAPE_COUNT; s++) {
+        for (int r = 0; r < 4; r++) {
+            const RotatedShape *rotated = &rotated_shapes[s][r];
+            AiShape shape = {.height = rotated->max_x - rotated->min_x + 1};
+            for (int b = 0; b < 4; b++) {
+                int row = rotated->blocks[b].x - rotated->min_x;
+                int col = rotated->blocks[b].y - rotated->min_y;
+                /* Kept in row-major order, so equal shapes compare equal. */
+                int at = b;
+                while (at > 0 && (shape.rows[at - 1] > row || (shape.rows[at - 1] == row && shape.cols[at - 1] > col))) {
+                    shape.rows[at] = shape.rows[at - 1];
+                    shape.cols[at] = shape.cols[at - 1];
+                    at--;
+                }
+                shape.rows[at] = row;
+                shape.cols[at] = col;
+            }
+
+            bool seen = false;
+            for (int i = 0; i < ai->shape_count && !seen; i++) {
+                seen = memcmp(ai->shapes[i].rows, shape.rows, sizeof(shape.rows)) == 0 &&
+                       memcmp(ai->shapes[i].cols, shape.cols, sizeof(shape.cols)) == 0;
+            }
+            if (!seen) {
+                ai->shapes[ai->shape_count++] = shape;
+            }
+        }
+    }
+}
+
+void ai_start(AiPlayer *ai, uint64_t seed) {
+    memset(ai, 0, sizeof(*ai));
+    ai->rng = seed | 1;
+}
+
+bool ai_init(AiPlayer *ai, int width, int height, uint64_t seed) {
+    ai_start(ai, seed);
+    ai->width = width;
+    ai->height = height;
+    ai->row_words = (width + 63) / 64;
+    ai->words = (size_t)ai->row_words * height;
+    collect_shapes(ai);
+
+    uint64_t *block = malloc(((4 + AI_COUNT_BITS) * ai->words + 2 * ai->row_words) * sizeof(uint64_t));
+    if (!block) {
+        return false;
+    }
+    ai->shot = block;
+    ai->blocked = ai->shot + ai->words;
+    ai->hits = ai->blocked + ai->words;
+    ai->candidates = ai->hits + ai->words;
+    ai->counts = ai->candidates + ai->words;
+    ai->anchors = ai->counts + AI_COUNT_BITS * ai->words;
+    ai_reset(ai);
+    return true;
+}
+
+void ai_reset(AiPlayer *ai) {
+    memset(ai->shot, 0, ai->words * sizeof(uint64_t));
+    memset(ai->hits, 0, ai->words * sizeof(uint64_t));
+    memset(ai->blocked, 0, ai->words * sizeof(uint64_t));
+    if (ai->width % 64 != 0) {
+        uint64_t padding = ~(uint64_t)0 << (ai->width % 64);
+        for (int row = 0; row < ai->height; row++) {
+            ai->blocked[(size_t)(row + 1) * ai->row_words - 1] = padding;
+        }
+    }
+    ai->ships = MAX_SHIPS;
+    ai->failed = false;
+}
+
+void ai_free(AiPlayer *ai) {
+    free(ai->shot);
+    ai->shot = NULL;
+}
+
+/* A random fleet, placed piece by piece as an Initialize packet would place it. */
+bool ai_place_fleet(AiPlayer *ai, int values[PACKET_MAX_VALUES]) {
+    Board *scratch = create_board(BOARD_DENSE, ai->width, ai->height);
+    if (!scratch) {
+        return false;
+    }
+
+    random_fleet(scratch, &ai->rng, values);
+    free_board(scratch);
+    return true;
+}
+
+/* The 64 bits of a row from column word * 64 + shift on; columns past the row read as `beyond`. */
+static inline uint64_t bits_from(const uint64_t *row, int row_words, int word, int shift, uint64_t beyond) {
+    if (shift == 0) {
+        return row[word];
+    }
+    uint64_t high = word + 1 < row_words ? row[word + 1] : beyond;
+    return (row[word] >> shift) | (high << (64 - shift));
+}
+
+/* Adds one to the count of every cell in `cells`, a word of cells at index `word`. */
+static inline void count_cells(AiPlayer *ai, size_t word, uint64_t cells) {
+    uint64_t *bits = ai->counts + word * AI_COUNT_BITS;
+    for (int k = 0; cells && k < AI_COUNT_BITS; k++) {
+        uint64_t carry = bits[k] & cells;
+        bits[k] ^= cells;
+        cells = carry;
+    }
+}
+
+/* Counts the cells a block `col` columns right of each anchor covers, in `row`. */
+static void count_block(AiPlayer *ai, int row, int col, const uint64_t *anchors) {
+    size_t base = (size_t)row * ai->row_words;
+    for (int w = 0; w < ai->row_words; w++) {
+        uint64_t cells = anchors[w] << col;
+        if (col && w > 0) {
+            cells |= anchors[w - 1] >> (64 - col);
+        }
+        if (cells) {
+            count_cells(ai, base + w, cells);
+        }
+    }
+}
+
+/*
+ * Counts the placements anchored in rows first..last over every cell they
+ * cover. A targeting count only takes those through at least one open hit,
+ * and takes those through two a second time. Returns whether there were any.
+ */
+static bool count_placements(AiPlayer *ai, int first, int last, bool targeting) {
+    int row_words = ai->row_words;
+    uint64_t *twice = ai->anchors + row_words;
+    bool any = false;
+
+    for (int s = 0; s < ai->shape_count; s++) {
+        const AiShape *shape = &ai->shapes[s];
+        int top = first > 0 ? first : 0;
+        int bottom = last < ai->height - shape->height ? last : ai->height - shape->height;
+
+        for (int row = top; row <= bottom; row++) {
+            uint64_t found = 0;
+            for (int w = 0; w < row_words; w++) {
+                uint64_t fits = ~(uint64_t)0;
+                uint64_t covered = 0;
+                uint64_t doubled = 0;
+                for (int b = 0; b < 4; b++) {
+                    size_t offset = (size_t)(row + shape->rows[b]) * row_words;
+                    fits &= ~bits_from(ai->blocked + offset, row_words, w, shape->cols[b], ~(uint64_t)0);
+                    if (targeting) {
+                        uint64_t hit = bits_from(ai->hits + offset, row_words, w, shape->cols[b], 0);
+                        doubled |= covered & hit;
+                        covered |= hit;
+                    }
+                }
+                if (targeting) {
+                    fits &= covered;
+                    twice[w] = fits & doubled;
+                }
+                ai->anchors[w] = fits;
+                found |= fits;
+            }
+            if (!found) {
+                continue;
+            }
+
+            any = true;
+            for (int b = 0; b < 4; b++) {
+                count_block(ai, row + shape->rows[b], shape->cols[b], ai->anchors);
+                if (targeting) {
+                    count_block(ai, row + shape->rows[b], shape->cols[b], twice);
+                }
+            }
+        }
+    }
+    return any;
+}
+
+/*
+ * Narrows `candidates`, the open cells of rows first..last, to those with
+ * the highest count, one bit of the count at a time from the top. Returns
+ * false, leaving every open cell, when no open cell has a count at all.
+ */
+static bool keep_densest(AiPlayer *ai, int first, int last) {
+    size_t begin = (size_t)first * ai->row_words;
+    size_t end = (size_t)(last + 1) * ai->row_words;
+    bool narrowed = false;
+
+    for (size_t i = begin; i < end; i++) {
+        ai->candidates[i] = ~(ai->shot[i] | ai->blocked[i]);
+    }
+    for (int k = AI_COUNT_BITS - 1; k >= 0; k--) {
+        uint64_t any = 0;
+        for (size_t i = begin; i < end; i++) {
+            any |= ai->candidates[i] & ai->counts[i * AI_COUNT_BITS + k];
+        }
+        if (!any) {
+            continue;
+        }
+        for (size_t i = begin; i < end; i++) {
+            ai->candidates[i] &= ai->counts[i * AI_COUNT_BITS + k];
+        }
+        narrowed = true;
+    }
+    return narrowed;
+}
+
+/* One of the candidates in rows first..last, picked at random. */
+static void pick_candidate(AiPlayer *ai, int first, int last, int *row, int *col) {
+    size_t begin = (size_t)first * ai->row_words;
+    size_t end = (size_t)(last + 1) * ai->row_words;
+    long total = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        total += __builtin_popcountll(ai->candidates[i]);
+    }
+    *row = 0;
+    *col = 0;
+    if (total == 0) {
+        return;
+    }
+
+    long pick = (long)(next_random(&ai->rng) % (uint64_t)total);
+    for (size_t i = begin; i < end; i++) {
+        uint64_t bits = ai->candidates[i];
+        int count = __builtin_popcountll(bits);
+        if (pick >= count) {
+            pick -= count;
+            continue;
+        }
+        while (pick-- > 0) {
+            bits &= bits - 1;
+        }
+        *row = (int)(i / ai->row_words);
+        *col = (int)(i % ai->row_words) * 64 + __builtin_ctzll(bits);
+        return;
+    }
+}
+
+static void clear_counts(AiPlayer *ai, int first, int last) {
+    size_t begin = (size_t)first * ai->row_words * AI_COUNT_BITS;
+    size_t end = (size_t)(last + 1) * ai->row_words * AI_COUNT_BITS;
+    memset(ai->counts + begin, 0, (end - begin) * sizeof(uint64_t));
+}
+
+void ai_choose(AiPlayer *ai, int *row, int *col) {
+    int first = -1;
+    int last = -1;
+    for (int r = 0; r < ai->height; r++) {
+        for (int w = 0; w < ai->row_words; w++) {
+            if (ai->hits[(size_t)r * ai->row_words + w]) {
+                first = first == -1 ? r : first;
+                last = r;
+                break;
+            }
+        }
+    }
+
+    /* Only placements through an open hit, which lie within reach of its row. */
+    if (first != -1) {
+        int top = first - SHAPE_REACH > 0 ? first - SHAPE_REACH : 0;
+        int bottom = last + SHAPE_REACH < ai->height - 1 ? last + SHAPE_REACH : ai->height - 1;
+        clear_counts(ai, top, bottom);
+        if (count_placements(ai, first - SHAPE_REACH, last, true) && keep_densest(ai, top, bottom)) {
+            pick_candidate(ai, top, bottom, row, col);
+            ai->last_row = *row;
+            ai->last_col = *col;
+            return;
+        }
+    }
+
+    /* Hunting, or the hits left belong to sunk ships it could not tell apart. */
+    clear_counts(ai, 0, ai->height - 1);
+    count_placements(ai, 0, ai->height - 1, false);
+    keep_densest(ai, 0, ai->height - 1);
+    pick_candidate(ai, 0, ai->height - 1, row, col);
+    ai->last_row = *row;
+    ai->last_col = *col;
+}
+
+/* Whether the placement of `shape` anchored at (row, col) lies wholly on open hits. */
+static bool on_open_hits(const AiPlayer *ai, const AiShape *shape, int row, int col) {
+    if (row < 0 || col < 0 || row + shape->height > ai->height) {
+        return false;
+    }
+    for (int b = 0; b < 4; b++) {
+        if (col + shape->cols[b] >= ai->width ||
+            !bitset_test(ai->hits, cell_bit(ai, row + shape->rows[b], col + shape->cols[b]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Takes the ship sunk at (row, col) off the open hits, if its cells can be told. */
+static void mark_sunk(AiPlayer *ai, int row, int col) {
+    for (int s = 0; s < ai->shape_count; s++) {
+        const AiShape *shape = &ai->shapes[s];
+        for (int b = 0; b < 4; b++) {
+            int top = row - shape->rows[b];
+            int left = col - shape->cols[b];
+            if (!on_open_hits(ai, shape, top, left)) {
+                continue;
+            }
+            for (int i = 0; i < 4; i++) {
+                size_t bit = cell_bit(ai, top + shape->rows[i], left + shape->cols[i]);
+                ai->hits[bit >> 6] &= ~((uint64_t)1 << (bit & 63));
+                bitset_set(ai->blocked, bit);
+            }
+            return;
+        }
+    }
+}
+
+void ai_learn(AiPlayer *ai, int row, int col, char result, int ships) {
+    if (row < 0 || row >= ai->height || col < 0 || col >= ai->width) {
+        return;
+    }
+
+    size_t bit = cell_bit(ai, row, col);
+    bitset_set(ai->shot, bit);
+    if (result != 'H') {
+        bitset_set(ai->blocked, bit);
+        return;
+    }
+    bitset_set(ai->hits, bit);
+    if (ships < ai->ships) {
+        ai->ships = ships;
+        mark_sunk(ai, row, col);
+    }
+}
+
+static void make_packet(Packet *packet, PacketType type, int count, const int *values) {
+    memset(packet, 0, sizeof(*packet));
+    packet->type = type;
+    packet->bare = count == 0;
+    packet->spaced = count > 0;
+    packet->tokens = count;
+    packet->integers = count;
+    if (count) {
+        memcpy(packet->values, values, count * sizeof(int));
+    }
+}
+
+void ai_next_packet(AiPlayer *ai, const Game *game, Packet *packet) {
+    int values[PACKET_MAX_VALUES];
+
+    if (ai->failed) {
+        make_packet(packet, PACKET_FORFEIT, 0, NULL);
+        return;
+    }
+
+    switch (game->phase) {
+    case PHASE_BEGIN_P2:
+        make_packet(packet, PACKET_BEGIN, 0, NULL);
+        return;
+    case PHASE_INIT_P2:
+        if ((ai->shot || ai_init(ai, game->width, game->height, ai->rng)) && ai_place_fleet(ai, values)) {
+            make_packet(packet, PACKET_INITIALIZE, PACKET_MAX_VALUES, values);
+            return;
+        }
+        break;
+    case PHASE_TURN:
+        if (ai->shot) {
+            ai_choose(ai, &values[0], &values[1]);
+            make_packet(packet, PACKET_SHOOT, 2, values);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    make_packet(packet, PACKET_FORFEIT, 0, NULL);
+}
+
+void ai_observe(AiPlayer *ai, const Reply *reply) {
+    if (reply->type == REPLY_SHOT) {
+        ai_learn(ai, ai->last_row, ai->last_col, reply->shot, reply->value);
+    } else if (reply->type == REPLY_ERROR) {
+        ai->failed = true;
+    }
+}
+
+bool ai_resume(AiPlayer *ai, const Game *game, int player) {
+    if (game->phase < PHASE_INIT_P1 || game->phase == PHASE_OVER) {
+        return true;
+    }
+
+    ai_free(ai);
+    if (!ai_init(ai, game->width, game->height, ai->rng)) {
+        return false;
+    }
+    const ShotLog *log = &game->shot_log[player];
+    for (size_t i = 0; i < log->count; i++) {
+        ai_learn(ai, log->entries[i].row, log->entries[i].col, log->entries[i].result, log->entries[i].ships);
+    }
+    return true;
+}
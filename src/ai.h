@@ -0,0 +1,93 @@
+#ifndef AI_H
+#define AI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "engine.h"
+
+/*
+ * The built-in opponent. It places a random fleet under the same rules a
+ * client's Initialize is checked against, and fires at the open cell the
+ * most placements of a ship could still cover: every rotation of every
+ * shape, since a fleet may use any of them, anchored anywhere it misses
+ * every miss and every ship already sunk. While it has hits on ships still
+ * afloat it only counts the placements through those hits, and those
+ * through two of them twice, so it finishes a ship off before it hunts on.
+ *
+ * It knows what a client would and nothing more: where it fired and what
+ * each reply said. When the ships left drop on a hit it takes the sunk ship
+ * to be a placement of four of its open hits through that cell.
+ *
+ * Everything is a bitset laid out like a bitboard's, rows padded to whole
+ * words, so one word of anchors is tested for a shape with four shifted
+ * ANDs. The count of placements over each cell is kept bit-sliced, one
+ * word per bit of the count, and added to 64 cells at a time; the densest
+ * open cells come out of the same words a bit at a time from the top.
+ */
+
+/* Largest board, in cells, the AI plays on; past it a bit per cell stops being cheap. */
+#define AI_MAX_CELLS SPARSE_MIN_CELLS
+/* A cell lies under at most 19 distinct placements of each of its 4 blocks, each counted at most twice. */
+#define AI_COUNT_BITS 8
+
+/* One distinct placement shape, as block offsets from its bounding box's top-left corner. */
+typedef struct {
+    int rows[4];
+    int cols[4];
+    int height;
+} AiShape;
+
+typedef struct {
+    int width;
+    int height;
+    int row_words;
+    size_t words;
+    AiShape shapes[SHAPE_COUNT * 4];
+    int shape_count;
+    /* Ships the opponent still has afloat, as the last reply said. */
+    int ships;
+    int last_row;
+    int last_col;
+    /* A move it made was refused; it forfeits rather than make it again. */
+    bool failed;
+    uint64_t rng;
+    /* Every cell fired at. */
+    uint64_t *shot;
+    /* Where no ship can lie: misses, ships known to be sunk and the padding past each row. */
+    uint64_t *blocked;
+    /* Hits on ships not known to be sunk yet. */
+    uint64_t *hits;
+    uint64_t *candidates;
+    /* AI_COUNT_BITS words per word of cells, lowest bit of the count first. */
+    uint64_t *counts;
+    /* One row of anchors, then those of them that cover two hits. */
+    uint64_t *anchors;
+} AiPlayer;
+
+/* An AI for a game whose board is not set yet; ai_next_packet() sizes it once it is. */
+void ai_start(AiPlayer *ai, uint64_t seed);
+/* Sets up for games on a width x height board; `seed` picks its fleets and breaks ties. */
+bool ai_init(AiPlayer *ai, int width, int height, uint64_t seed);
+/* Forgets the last game, for another on a board of the same size. */
+void ai_reset(AiPlayer *ai);
+void ai_free(AiPlayer *ai);
+
+bool ai_place_fleet(AiPlayer *ai, int values[PACKET_MAX_VALUES]);
+void ai_choose(AiPlayer *ai, int *row, int *col);
+/* What the reply to a shot at (row, col) said: 'H' or 'M', and the ships left. */
+void ai_learn(AiPlayer *ai, int row, int col, char result, int ships);
+
+/*
+ * Plays `game` as a client would: the packet to send when the game waits
+ * on the AI, and the replies it gets back. A halt is acknowledged with "F",
+ * as is anything the AI cannot or may not answer.
+ */
+void ai_next_packet(AiPlayer *ai, const Game *game, Packet *packet);
+void ai_observe(AiPlayer *ai, const Reply *reply);
+/* Catches up on a game played so far as `player`, from its shot log. */
+bool ai_resume(AiPlayer *ai, const Game *game, int player);
+
+#endif
@@ -0,0 +1,812 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+
+/* Random pieces tried before a fleet that will not fit is started over. */
+#define MAX_PLACEMENT_TRIES 1000
+
+const Shape base_shapes[] = {
+    {{{0, 0}, {1, 0}, {2, 0}, {3, 0}}},
+    {{{0, 0}, {0, 1}, {1, 0}, {1, 1}}},
+    {{{0, 0}, {1, 0}, {2, 0}, {2, 1}}},
+    {{{0, 0}, {1, 0}, {2, 0}, {2, -1}}},
+    {{{0, 0}, {0, 1}, {1, 1}, {1, 2}}},
+    {{{0, 1}, {0, 0}, {1, 1}, {1, 2}}},
+    {{{0, 0}, {1, -1}, {1, 0}, {1, 1}}}
+};
+
+const int shape_count = SHAPE_COUNT;
+
+bool arena_open(Arena *arena, ArenaPool *pool, size_t size) {
+    ArenaBlock **link = pool ? &pool->free_blocks : NULL;
+    while (link && *link) {
+        ArenaBlock *candidate = *link;
+        /* Do not let a small game pin a much larger block. */
+        if (candidate->capacity >= size && candidate->capacity / 2 <= size) {
+            *link = candidate->next;
+            pool->count--;
+            arena->block = candidate;
+            arena->used = 0;
+            return true;
+        }
+        link = &candidate->next;
+    }
+
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) {
+        perror("Failed to allocate arena");
+        arena->block = NULL;
+        return false;
+    }
+    block->capacity = size;
+    block->next = NULL;
+    arena->block = block;
+    arena->used = 0;
+    return true;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size_t aligned = (arena->used + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+    if (!arena->block || aligned + size > arena->block->capacity) {
+        return NULL;
+    }
+
+    void *memory = (char *)arena->block->data + aligned;
+    arena->used = aligned + size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+void arena_close(Arena *arena, ArenaPool *pool) {
+    ArenaBlock *block = arena->block;
+    arena->block = NULL;
+    arena->used = 0;
+    if (!block) {
+        return;
+    }
+
+    if (pool && pool->count < ARENA_POOL_MAX && block->capacity <= ARENA_POOL_MAX_BLOCK) {
+        block->next = pool->free_blocks;
+        pool->free_blocks = block;
+        pool->count++;
+    } else {
+        free(block);
+    }
+}
+
+void arena_pool_clear(ArenaPool *pool) {
+    while (pool->free_blocks) {
+        ArenaBlock *block = pool->free_blocks;
+        pool->free_blocks = block->next;
+        free(block);
+    }
+    pool->count = 0;
+}
+
+static int bitset_row_words(int width) {
+    return (width + 63) / 64;
+}
+
+static size_t bitset_words(int width, int height) {
+    return (size_t)bitset_row_words(width) * height;
+}
+
+static size_t board_storage_size(BoardKind kind, int width, int height) {
+    if (kind == BOARD_BITBOARD) {
+        return bitset_words(width, height) * sizeof(BitboardWord) + SPARSE_SHIP_CELLS * sizeof(SparseCell);
+    }
+    if (kind == BOARD_SPARSE) {
+        return SPARSE_SHIP_CELLS * sizeof(SparseCell);
+    }
+    return (size_t)width * height * sizeof(int8_t);
+}
+
+BoardKind board_kind_for(BoardKind preferred, int width, int height) {
+    return (long long)width * height > SPARSE_MIN_CELLS ? BOARD_SPARSE : preferred;
+}
+
+/* A bitboard keeps its ship cells behind its words. */
+static inline SparseCell *sparse_cells(const Board *board) {
+    if (board->kind == BOARD_BITBOARD) {
+        return (SparseCell *)(board_words(board) + board->words);
+    }
+    return (SparseCell *)board->cells;
+}
+
+static inline uint64_t sparse_index(const Board *board, int row, int col) {
+    return (uint64_t)row * board->width + col;
+}
+
+/* Binary search over the ship cells, which are kept sorted. */
+static SparseCell *sparse_find(const Board *board, uint64_t cell) {
+    SparseCell *cells = sparse_cells(board);
+    int low = 0;
+    int high = board->sparse_count;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (cells[middle].cell < cell) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < board->sparse_count && cells[low].cell == cell ? &cells[low] : NULL;
+}
+
+static void sparse_insert(Board *board, uint64_t cell, int ship) {
+    SparseCell *cells = sparse_cells(board);
+    if (board->sparse_count == SPARSE_SHIP_CELLS) {
+        fprintf(stderr, "Sparse board is full\n");
+        return;
+    }
+
+    int at = board->sparse_count;
+    while (at > 0 && cells[at - 1].cell > cell) {
+        cells[at] = cells[at - 1];
+        at--;
+    }
+    cells[at] = (SparseCell){.cell = cell, .ship = (int8_t)ship, .hit = false};
+    board->sparse_count++;
+}
+
+static inline size_t miss_slot(uint64_t key, size_t capacity) {
+    return (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (capacity - 1);
+}
+
+static bool miss_set_contains(const MissSet *set, uint64_t cell) {
+    if (set->count == 0) {
+        return false;
+    }
+    uint64_t key = cell + 1;
+    for (size_t slot = miss_slot(key, set->capacity);; slot = (slot + 1) & (set->capacity - 1)) {
+        if (set->slots[slot] == key) {
+            return true;
+        }
+        if (set->slots[slot] == 0) {
+            return false;
+        }
+    }
+}
+
+static void miss_set_put(MissSet *set, uint64_t key) {
+    size_t slot = miss_slot(key, set->capacity);
+    while (set->slots[slot] != 0) {
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    set->slots[slot] = key;
+    set->count++;
+}
+
+/* Kept at most half full; doubling rehashes every key into the new table. */
+static bool miss_set_add(MissSet *set, uint64_t cell) {
+    if ((set->count + 1) * 2 > set->capacity) {
+        size_t grown = set->capacity ? set->capacity * 2 : 64;
+        uint64_t *slots = calloc(grown, sizeof(uint64_t));
+        if (!slots) {
+            perror("Failed to grow miss set");
+            return false;
+        }
+
+        MissSet resized = {slots, 0, grown};
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->slots[i]) {
+                miss_set_put(&resized, set->slots[i]);
+            }
+        }
+        free(set->slots);
+        *set = resized;
+    }
+
+    miss_set_put(set, cell + 1);
+    return true;
+}
+
+size_t board_size(BoardKind kind, int width, int height) {
+    return sizeof(Board) + board_storage_size(kind, width, height);
+}
+
+void init_board(Board *board, BoardKind kind, int width, int height) {
+    board->kind = kind;
+    board->width = width;
+    board->height = height;
+    board->row_words = kind == BOARD_BITBOARD ? bitset_row_words(width) : 0;
+    board->words = kind == BOARD_BITBOARD ? bitset_words(width, height) : 0;
+    memset(board->ship_cells, 0, sizeof(board->ship_cells));
+    board->ships_remaining = 0;
+    board->sparse_count = 0;
+    memset(board->cells, EMPTY, board_storage_size(kind, width, height));
+
+    /* A sparse board being reset keeps its miss table for the next game. */
+    if (kind == BOARD_SPARSE && board->misses.slots) {
+        memset(board->misses.slots, 0, board->misses.capacity * sizeof(uint64_t));
+        board->misses.count = 0;
+    } else {
+        board->misses = (MissSet){0};
+    }
+
+    if (kind == BOARD_BITBOARD && width % 64 != 0) {
+        uint64_t padding = ~(uint64_t)0 << (width % 64);
+        BitboardWord *words = board_words(board);
+        for (int row = 0; row < height; row++) {
+            words[(size_t)(row + 1) * board->row_words - 1].occupied |= padding;
+        }
+    }
+}
+
+Board *create_board(BoardKind kind, int width, int height) {
+    Board *board = calloc(1, board_size(kind, width, height));
+    if (!board) {
+        perror("Failed to allocate memory for board");
+        return NULL;
+    }
+
+    init_board(board, kind, width, height);
+    return board;
+}
+
+Board *create_board_in(Arena *arena, BoardKind kind, int width, int height) {
+    Board *board = arena_alloc(arena, board_size(kind, width, height));
+    if (!board) {
+        fprintf(stderr, "Failed to allocate board from arena\n");
+        return NULL;
+    }
+
+    init_board(board, kind, width, height);
+    return board;
+}
+
+void copy_board(Board *destination, const Board *source) {
+    MissSet misses = destination->kind == BOARD_SPARSE ? destination->misses : (MissSet){0};
+    memcpy(destination, source, board_size(source->kind, source->width, source->height));
+    if (source->kind != BOARD_SPARSE) {
+        return;
+    }
+
+    /* The copy gets its own miss table rather than sharing the source's. */
+    destination->misses = misses;
+    if (misses.slots) {
+        memset(misses.slots, 0, misses.capacity * sizeof(uint64_t));
+        destination->misses.count = 0;
+    }
+    for (size_t i = 0; i < source->misses.capacity; i++) {
+        if (source->misses.slots[i] && !miss_set_add(&destination->misses, source->misses.slots[i] - 1)) {
+            break;
+        }
+    }
+}
+
+/* Frees what a board holds outside its own block; the board stays usable. */
+void release_board(Board *board) {
+    if (board->kind == BOARD_SPARSE) {
+        free(board->misses.slots);
+        board->misses = (MissSet){0};
+    }
+}
+
+void free_board(Board *board) {
+    if (board) {
+        release_board(board);
+    }
+    free(board);
+}
+
+/* The word holding cell (row, col) of a bitboard; its bit is column_bit(col). */
+static inline BitboardWord *word_at(const Board *board, int row, int col) {
+    return &board_words(board)[(size_t)row * board->row_words + (unsigned)col / 64];
+}
+
+static inline uint64_t column_bit(int col) {
+    return (uint64_t)1 << ((unsigned)col % 64);
+}
+
+int board_get_cell(const Board *board, int row, int col) {
+    if (board->kind == BOARD_DENSE) {
+        return board->cells[cell_offset(board->width, row, col)];
+    }
+    if (board->kind == BOARD_SPARSE) {
+        uint64_t cell = sparse_index(board, row, col);
+        const SparseCell *ship = sparse_find(board, cell);
+        if (ship) {
+            return ship->hit ? HIT : ship->ship;
+        }
+        return miss_set_contains(&board->misses, cell) ? MISS : EMPTY;
+    }
+
+    BitboardWord word = *word_at(board, row, col);
+    uint64_t bit = column_bit(col);
+    if (word.hit & bit) {
+        return HIT;
+    }
+    if (word.miss & bit) {
+        return MISS;
+    }
+    return word.occupied & bit ? sparse_find(board, bit_index(board, row, col))->ship : EMPTY;
+}
+
+bool board_was_shot(const Board *board, int row, int col) {
+    if (board->kind == BOARD_DENSE) {
+        int cell = board->cells[cell_offset(board->width, row, col)];
+        return cell == HIT || cell == MISS;
+    }
+    if (board->kind == BOARD_SPARSE) {
+        uint64_t cell = sparse_index(board, row, col);
+        const SparseCell *ship = sparse_find(board, cell);
+        return ship ? ship->hit : miss_set_contains(&board->misses, cell);
+    }
+
+    const BitboardWord *word = word_at(board, row, col);
+    return ((word->hit | word->miss) & column_bit(col)) != 0;
+}
+
+static bool board_cell_is_empty(const Board *board, int row, int col) {
+    if (board->kind == BOARD_DENSE) {
+        return board->cells[cell_offset(board->width, row, col)] == EMPTY;
+    }
+    if (board->kind == BOARD_SPARSE) {
+        return !sparse_find(board, sparse_index(board, row, col));
+    }
+
+    /* Ships are only placed before any shot, so occupancy alone decides. */
+    return !(word_at(board, row, col)->occupied & column_bit(col));
+}
+
+static void board_place_cell(Board *board, int row, int col, int pieceId) {
+    if (board->kind == BOARD_DENSE) {
+        board->cells[cell_offset(board->width, row, col)] = pieceId;
+        return;
+    }
+    if (board->kind == BOARD_SPARSE) {
+        sparse_insert(board, sparse_index(board, row, col), pieceId);
+        return;
+    }
+
+    word_at(board, row, col)->occupied |= column_bit(col);
+    sparse_insert(board, bit_index(board, row, col), pieceId);
+}
+
+void print_board(const Board *board) {
+    printf("Current Board State:\n");
+    for (int i = 0; i < board->height; i++) {
+        for (int j = 0; j < board->width; j++) {
+            int cell = board_get_cell(board, i, j);
+            if (cell == EMPTY) {
+                printf(" . ");
+            } else if (cell == HIT) {
+                printf(" H ");
+            } else if (cell == MISS) {
+                printf(" M ");
+            } else {
+                printf("%2d ", cell);
+            }
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/*
+ * Every rotation of every base shape, worked out by the compiler. Rotating a
+ * block once maps (x, y) to (y, -x); RX##n/RY##n apply that n times. Each entry
+ * also records the bounding box of its blocks relative to the anchor cell and
+ * the row masks a bitboard tests a placement with.
+ */
+#define RX0(x, y) (x)
+#define RY0(x, y) (y)
+#define RX1(x, y) (y)
+#define RY1(x, y) (-(x))
+#define RX2(x, y) (-(x))
+#define RY2(x, y) (-(y))
+#define RX3(x, y) (-(y))
+#define RY3(x, y) (x)
+
+#define MIN2(a, b) ((a) < (b) ? (a) : (b))
+#define MAX2(a, b) ((a) > (b) ? (a) : (b))
+#define MIN4(a, b, c, d) MIN2(MIN2(a, b), MIN2(c, d))
+#define MAX4(a, b, c, d) MAX2(MAX2(a, b), MAX2(c, d))
+
+#define MIN_X(n, x0, y0, x1, y1, x2, y2, x3, y3) MIN4(RX##n(x0, y0), RX##n(x1, y1), RX##n(x2, y2), RX##n(x3, y3))
+#define MIN_Y(n, x0, y0, x1, y1, x2, y2, x3, y3) MIN4(RY##n(x0, y0), RY##n(x1, y1), RY##n(x2, y2), RY##n(x3, y3))
+
+/* The column bit of block (x, y) if it lies in row `r` of the bounding box. */
+#define BLOCK_BIT(n, r, x, y, ...)                                                          \
+    ((RX##n(x, y) - MIN_X(n, __VA_ARGS__) == (r)) << (RY##n(x, y) - MIN_Y(n, __VA_ARGS__)))
+
+#define ROW_MASK(n, r, x0, y0, x1, y1, x2, y2, x3, y3)                                      \
+    (BLOCK_BIT(n, r, x0, y0, x0, y0, x1, y1, x2, y2, x3, y3) |                              \
+     BLOCK_BIT(n, r, x1, y1, x0, y0, x1, y1, x2, y2, x3, y3) |                              \
+     BLOCK_BIT(n, r, x2, y2, x0, y0, x1, y1, x2, y2, x3, y3) |                              \
+     BLOCK_BIT(n, r, x3, y3, x0, y0, x1, y1, x2, y2, x3, y3))
+
+#define ROTATED_SHAPE(n, x0, y0, x1, y1, x2, y2, x3, y3) {                                \
+    {{RX##n(x0, y0), RY##n(x0, y0)}, {RX##n(x1, y1), RY##n(x1, y1)},                        \
+     {RX##n(x2, y2), RY##n(x2, y2)}, {RX##n(x3, y3), RY##n(x3, y3)}},                       \
+    MIN_X(n, x0, y0, x1, y1, x2, y2, x3, y3),                                               \
+    MAX4(RX##n(x0, y0), RX##n(x1, y1), RX##n(x2, y2), RX##n(x3, y3)),                       \
+    MIN_Y(n, x0, y0, x1, y1, x2, y2, x3, y3),                                               \
+    MAX4(RY##n(x0, y0), RY##n(x1, y1), RY##n(x2, y2), RY##n(x3, y3)),                       \
+    {ROW_MASK(n, 0, x0, y0, x1, y1, x2, y2, x3, y3), ROW_MASK(n, 1, x0, y0, x1, y1, x2, y2, x3, y3), \
+     ROW_MASK(n, 2, x0, y0, x1, y1, x2, y2, x3, y3), ROW_MASK(n, 3, x0, y0, x1, y1, x2, y2, x3, y3)} \
+}
+
+#define ALL_ROTATIONS(...) {                                                                \
+    ROTATED_SHAPE(0, __VA_ARGS__), ROTATED_SHAPE(1, __VA_ARGS__),                           \
+    ROTATED_SHAPE(2, __VA_ARGS__), ROTATED_SHAPE(3, __VA_ARGS__)                            \
+}
+
+const RotatedShape rotated_shapes[SHAPE_COUNT][4] = {
+    ALL_ROTATIONS(0, 0, 1, 0, 2, 0, 3, 0),
+    ALL_ROTATIONS(0, 0, 0, 1, 1, 0, 1, 1),
+    ALL_ROTATIONS(0, 0, 1, 0, 2, 0, 2, 1),
+    ALL_ROTATIONS(0, 0, 1, 0, 2, 0, 2, -1),
+    ALL_ROTATIONS(0, 0, 0, 1, 1, 1, 1, 2),
+    ALL_ROTATIONS(0, 1, 0, 0, 1, 1, 1, 2),
+    ALL_ROTATIONS(0, 0, 1, -1, 1, 0, 1, 1)
+};
+
+void calculate_piece_coordinates(int pieceIndex, int rotationCount, int baseRow, int baseCol, Coordinate pieceCoords[4]) {
+    if (pieceIndex < 0 || pieceIndex >= shape_count ||
+        rotationCount < 0 || rotationCount >= 4) {
+        fprintf(stderr, "Invalid shape index or rotation count\n");
+        return;
+    }
+
+    const RotatedShape *selectedShape = &rotated_shapes[pieceIndex][rotationCount];
+    for (int index = 0; index < 4; index++) {
+        pieceCoords[index].x = baseRow + selectedShape->blocks[index].x;
+        pieceCoords[index].y = baseCol + selectedShape->blocks[index].y;
+    }
+}
+
+static bool piece_fits_on_board(const Board *gameBoard, const RotatedShape *shape, int startRow, int startCol) {
+    return startRow + shape->min_x >= 0 && startRow + shape->max_x < gameBoard->height &&
+           startCol + shape->min_y >= 0 && startCol + shape->max_y < gameBoard->width;
+}
+
+/*
+ * The 64 occupancy bits of `row` starting at column `start`; anything left of
+ * the board or below/above it reads as occupied.
+ */
+static uint64_t occupied_bits_at(const Board *board, int row, long start) {
+    if (row < 0 || row >= board->height) {
+        return ~(uint64_t)0;
+    }
+
+    const BitboardWord *words = board_words(board) + (size_t)row * board->row_words;
+    long word = start >= 0 ? start / 64 : -((-start + 63) / 64);
+    int shift = (int)(start - word * 64);
+
+    uint64_t low = word >= 0 && word < board->row_words ? words[word].occupied : ~(uint64_t)0;
+    if (shift == 0) {
+        return low;
+    }
+    uint64_t high = word + 1 >= 0 && word + 1 < board->row_words ? words[word + 1].occupied : ~(uint64_t)0;
+    return (low >> shift) | (high << (64 - shift));
+}
+
+/*
+ * Whether a piece whose bounding box is on the board overlaps a ship: each
+ * row of the box is one AND of the shape's row mask against the occupancy
+ * word under it, joined with the next word only when the box straddles two.
+ */
+static bool bitboard_piece_overlaps(const Board *board, const RotatedShape *shape, int startRow, int startCol) {
+    const BitboardWord *words = board_words(board) + (size_t)(startRow + shape->min_x) * board->row_words;
+    int col = startCol + shape->min_y;
+    int word = col / 64;
+    int shift = col % 64;
+    bool straddles = shift > 64 - 4 && word + 1 < board->row_words;
+
+    uint64_t overlap = 0;
+    for (int row = 0; row <= shape->max_x - shape->min_x; row++, words += board->row_words) {
+        uint64_t bits = words[word].occupied >> shift;
+        if (straddles) {
+            bits |= words[word + 1].occupied << (64 - shift);
+        }
+        overlap |= bits & shape->row_masks[row];
+    }
+    return overlap != 0;
+}
+
+/*
+ * Validates a piece and, when `pieceId` is non-zero and it fits, places it in
+ * the same pass. A piece whose bounding box is on the board only needs its
+ * cells checked for overlap; otherwise the blocks are walked in order so the
+ * first offending block still decides between 302 and 303.
+ */
+static int place_piece(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol, int pieceId) {
+    if (shapeIndex < 0 || shapeIndex >= shape_count ||
+        numRotations < 0 || numRotations >= 4) {
+        fprintf(stderr, "Invalid shape index or rotation count\n");
+        return -1;
+    }
+
+    const RotatedShape *shape = &rotated_shapes[shapeIndex][numRotations];
+
+    if (gameBoard->kind == BOARD_BITBOARD && piece_fits_on_board(gameBoard, shape, startRow, startCol)) {
+        if (bitboard_piece_overlaps(gameBoard, shape, startRow, startCol)) {
+            return 303;
+        }
+    } else if (piece_fits_on_board(gameBoard, shape, startRow, startCol)) {
+        for (int idx = 0; idx < 4; idx++) {
+            if (!board_cell_is_empty(gameBoard, startRow + shape->blocks[idx].x, startCol + shape->blocks[idx].y)) {
+                return 303;
+            }
+        }
+    } else {
+        for (int idx = 0; idx < 4; idx++) {
+            int row = startRow + shape->blocks[idx].x;
+            int col = startCol + shape->blocks[idx].y;
+
+            if (row < 0 || row >= gameBoard->height || col < 0 || col >= gameBoard->width) {
+                return 302;
+            }
+
+            if (!board_cell_is_empty(gameBoard, row, col)) {
+                return 303;
+            }
+        }
+    }
+
+    if (pieceId == 0) {
+        return 0;
+    }
+
+    for (int idx = 0; idx < 4; idx++) {
+        board_place_cell(gameBoard, startRow + shape->blocks[idx].x, startCol + shape->blocks[idx].y, pieceId);
+    }
+
+    if (pieceId >= 1 && pieceId <= MAX_SHIPS) {
+        if (gameBoard->ship_cells[pieceId - 1] == 0) {
+            gameBoard->ships_remaining++;
+        }
+        gameBoard->ship_cells[pieceId - 1] += 4;
+    }
+
+    return 0;
+}
+
+int insert_piece_on_board(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol, int pieceId) {
+    return place_piece(gameBoard, shapeIndex, numRotations, startRow, startCol, pieceId);
+}
+
+int check_valid_piece_placement(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol) {
+    return place_piece(gameBoard, shapeIndex, numRotations, startRow, startCol, 0);
+}
+
+/*
+ * Counts the anchor cells where the piece would pass check_valid_piece_placement().
+ * A bitboard answers 64 anchors per word: the anchor mask is the AND of the free
+ * bits under each of the four blocks, each read at that block's offset.
+ */
+long count_valid_placements(const Board *board, int shapeIndex, int numRotations) {
+    long count = 0;
+
+    const RotatedShape *shape = &rotated_shapes[shapeIndex][numRotations];
+    const Coordinate *offsets = shape->blocks;
+
+    if (board->kind == BOARD_DENSE) {
+        /* Only anchors whose bounding box is on the board can fit at all. */
+        for (int row = -shape->min_x; row < board->height - shape->max_x; row++) {
+            for (int col = -shape->min_y; col < board->width - shape->max_y; col++) {
+                bool fits = true;
+                for (int idx = 0; idx < 4 && fits; idx++) {
+                    fits = board->cells[cell_offset(board->width, row + offsets[idx].x, col + offsets[idx].y)] == EMPTY;
+                }
+                count += fits;
+            }
+        }
+        return count;
+    }
+
+    if (board->kind == BOARD_SPARSE) {
+        for (int row = -shape->min_x; row < board->height - shape->max_x; row++) {
+            for (int col = -shape->min_y; col < board->width - shape->max_y; col++) {
+                bool fits = true;
+                for (int idx = 0; idx < 4 && fits; idx++) {
+                    fits = board_cell_is_empty(board, row + offsets[idx].x, col + offsets[idx].y);
+                }
+                count += fits;
+            }
+        }
+        return count;
+    }
+
+    for (int row = 0; row < board->height; row++) {
+        for (int word = 0; word < board->row_words; word++) {
+            long base = (long)word * 64;
+            uint64_t free_anchors = ~(uint64_t)0;
+            for (int idx = 0; idx < 4; idx++) {
+                free_anchors &= ~occupied_bits_at(board, row + offsets[idx].x, base + offsets[idx].y);
+            }
+            if (word == board->row_words - 1 && board->width % 64 != 0) {
+                free_anchors &= ~(~(uint64_t)0 << (board->width % 64));
+            }
+            count += __builtin_popcountll(free_anchors);
+        }
+    }
+
+    return count;
+}
+
+void random_fleet(Board *scratch, uint64_t *rng, int values[MAX_SHIPS * 4]) {
+    for (;;) {
+        init_board(scratch, scratch->kind, scratch->width, scratch->height);
+        int placed = 0;
+        for (int tries = 0; placed < MAX_SHIPS && tries < MAX_PLACEMENT_TRIES; tries++) {
+            int shape = random_below(rng, SHAPE_COUNT);
+            int rotation = random_below(rng, 4);
+            int row = random_below(rng, scratch->height);
+            int col = random_below(rng, scratch->width);
+            if (insert_piece_on_board(scratch, shape, rotation, row, col, placed + 1) == 0) {
+                int *piece = &values[placed * 4];
+                piece[0] = shape + 1;
+                piece[1] = rotation + 1;
+                piece[2] = row;
+                piece[3] = col;
+                placed++;
+            }
+        }
+        if (placed == MAX_SHIPS) {
+            return;
+        }
+    }
+}
+
+bool is_ship_sunk(const Board *board, int piece_id) {
+    return board->ship_cells[piece_id - 1] == 0;
+}
+
+int get_remaining_ships(const Board *board) {
+    return board->ships_remaining;
+}
+
+void shot_log_init(ShotLog *log) {
+    memset(log, 0, sizeof(*log));
+}
+
+static bool grow_entries(ShotEntry **entries, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+
+    size_t grown = *capacity ? *capacity * 2 : 64;
+    while (grown < needed) {
+        grown *= 2;
+    }
+
+    ShotEntry *resized = realloc(*entries, grown * sizeof(ShotEntry));
+    if (!resized) {
+        perror("Failed to grow shot log");
+        return false;
+    }
+    *entries = resized;
+    *capacity = grown;
+    return true;
+}
+
+bool shot_log_append(ShotLog *log, int row, int col, char result) {
+    if (!grow_entries(&log->entries, &log->capacity, log->count + 1)) {
+        return false;
+    }
+    log->entries[log->count++] = (ShotEntry){.row = row, .col = col, .result = result};
+    return true;
+}
+
+static int compare_shots(const void *a, const void *b) {
+    const ShotEntry *left = a;
+    const ShotEntry *right = b;
+    if (left->row != right->row) {
+        return left->row < right->row ? -1 : 1;
+    }
+    return (left->col > right->col) - (left->col < right->col);
+}
+
+/*
+ * Sorts the shots fired since the last call and merges them into the sorted
+ * copy from the back, so the cost is the new shots' sort plus one pass.
+ * Returns NULL only if memory runs out.
+ */
+const ShotEntry *shot_log_sorted(ShotLog *log) {
+    size_t added = log->count - log->sorted_count;
+    if (added == 0) {
+        return log->sorted ? log->sorted : log->entries;
+    }
+
+    if (!grow_entries(&log->sorted, &log->sorted_capacity, log->count)) {
+        return NULL;
+    }
+
+    ShotEntry *fresh = malloc(added * sizeof(ShotEntry));
+    if (!fresh) {
+        perror("Failed to sort shot log");
+        return NULL;
+    }
+    memcpy(fresh, log->entries + log->sorted_count, added * sizeof(ShotEntry));
+    qsort(fresh, added, sizeof(ShotEntry), compare_shots);
+
+    size_t old_index = log->sorted_count;
+    size_t new_index = added;
+    size_t out = log->count;
+    while (new_index > 0) {
+        if (old_index > 0 && compare_shots(&log->sorted[old_index - 1], &fresh[new_index - 1]) > 0) {
+            log->sorted[--out] = log->sorted[--old_index];
+        } else {
+            log->sorted[--out] = fresh[--new_index];
+        }
+    }
+
+    free(fresh);
+    log->sorted_count = log->count;
+    return log->sorted;
+}
+
+void shot_log_clear(ShotLog *log) {
+    log->count = 0;
+    log->sorted_count = 0;
+}
+
+void shot_log_free(ShotLog *log) {
+    free(log->entries);
+    free(log->sorted);
+    shot_log_init(log);
+}
+
+/* A repeated shot is detected on the target board itself, which already knows every cell that was fired at. */
+int validate_shot_coordinates(int row, int col, const Board *board) {
+    if (row < 0 || row >= board->height || col < 0 || col >= board->width) {
+        return 400;
+    }
+    if (board_was_shot(board, row, col)) {
+        return 401;
+    }
+    return 0;
+}
+
+char process_shot(Board *opponent_board, ShotLog *shot_log, int row, int col) {
+    int piece_id;
+
+    if (opponent_board->kind == BOARD_DENSE) {
+        size_t offset = cell_offset(opponent_board->width, row, col);
+        piece_id = opponent_board->cells[offset];
+        opponent_board->cells[offset] = piece_id > 0 ? HIT : MISS;
+    } else if (opponent_board->kind == BOARD_SPARSE) {
+        uint64_t cell = sparse_index(opponent_board, row, col);
+        SparseCell *ship = sparse_find(opponent_board, cell);
+        if (ship) {
+            piece_id = ship->ship;
+            ship->hit = true;
+        } else {
+            piece_id = EMPTY;
+            miss_set_add(&opponent_board->misses, cell);
+        }
+    } else {
+        BitboardWord *word = word_at(opponent_board, row, col);
+        uint64_t bit = column_bit(col);
+        if (word->occupied & bit) {
+            piece_id = sparse_find(opponent_board, bit_index(opponent_board, row, col))->ship;
+            word->hit |= bit;
+        } else {
+            piece_id = EMPTY;
+            word->miss |= bit;
+        }
+    }
+
+    char shot_result;
+
+    if (piece_id > 0) {
+        shot_result = 'H';
+
+        if (--opponent_board->ship_cells[piece_id - 1] == 0) {
+            opponent_board->ships_remaining--;
+        }
+    } else {
+        shot_result = 'M';
+    }
+
+    if (shot_log_append(shot_log, row, col, shot_result)) {
+        shot_log->entries[shot_log->count - 1].ships = (uint8_t)opponent_board->ships_remaining;
+    }
+
+    return shot_result;
+}
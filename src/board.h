@@ -0,0 +1,241 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_SHIPS 5
+
+typedef enum {
+    EMPTY = 0,
+    HIT = -1,
+    MISS = -2
+} CellState;
+
+/*
+ * BOARD_DENSE keeps one signed byte per cell holding a CellState or ship id.
+ * BOARD_BITBOARD keeps one bit per cell in each of three bitsets: the ship
+ * cells, the hits and the misses. Bitset rows are padded to whole 64-bit words
+ * so a row can be tested 64 columns at a time; the padding columns are marked
+ * occupied so they never look free. Which ship a cell holds is looked up in a
+ * sorted list of the ship cells, like a sparse board's.
+ * BOARD_SPARSE keeps only the ship cells, sorted by cell index with a hit flag
+ * each, and a hash set of the cells that were missed, so it takes memory in
+ * proportion to the ships and shots instead of the board's area.
+ */
+typedef enum {
+    BOARD_DENSE,
+    BOARD_BITBOARD,
+    BOARD_SPARSE
+} BoardKind;
+
+/* Boards with more cells than this are kept sparse whatever kind was asked for. */
+#define SPARSE_MIN_CELLS (1 << 20)
+#define SPARSE_SHIP_CELLS (MAX_SHIPS * 4)
+
+typedef struct {
+    uint64_t cell;
+    int8_t ship;
+    bool hit;
+} SparseCell;
+
+/* Open addressing over cell index + 1, so a zero slot is free. */
+typedef struct {
+    uint64_t *slots;
+    size_t count;
+    size_t capacity;
+} MissSet;
+
+/*
+ * 64 columns of a bitboard row. The three bitsets are interleaved word by
+ * word, so a shot reads and updates everything it needs in one place.
+ */
+typedef struct {
+    uint64_t occupied;
+    uint64_t hit;
+    uint64_t miss;
+} BitboardWord;
+
+/*
+ * Cell storage lives in one contiguous block right behind the header: row-major
+ * bytes for a dense board, `words` BitboardWords followed by SPARSE_SHIP_CELLS
+ * SparseCells keyed by bit index for a bitboard, SPARSE_SHIP_CELLS SparseCells
+ * for a sparse board, whose `misses` live outside the block and are freed by
+ * release_board().
+ *
+ * ship_cells[id - 1] counts the cells of ship `id` that have not been hit yet
+ * and ships_remaining counts the ships with at least one such cell, so a shot
+ * can update the sunk state without rescanning the grid.
+ */
+typedef struct {
+    BoardKind kind;
+    int width;
+    int height;
+    int row_words;
+    size_t words;
+    int ship_cells[MAX_SHIPS];
+    int ships_remaining;
+    int sparse_count;
+    MissSet misses;
+    alignas(uint64_t) int8_t cells[];
+} Board;
+
+typedef struct {
+    int x;
+    int y;
+} Coordinate;
+
+typedef struct {
+    Coordinate blocks[4];
+} Shape;
+
+#define SHAPE_COUNT 7
+
+/*
+ * One rotation of a base shape: block offsets plus their bounding box, and
+ * for each row of the box a mask of its blocks' columns counted from min_y.
+ */
+typedef struct {
+    Coordinate blocks[4];
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+    uint8_t row_masks[4];
+} RotatedShape;
+
+extern const Shape base_shapes[];
+extern const int shape_count;
+extern const RotatedShape rotated_shapes[SHAPE_COUNT][4];
+
+static inline size_t cell_offset(int width, int row, int col) {
+    return (size_t)row * width + col;
+}
+
+static inline BitboardWord *board_words(const Board *board) {
+    return (BitboardWord *)board->cells;
+}
+
+static inline size_t bit_index(const Board *board, int row, int col) {
+    return (size_t)row * board->row_words * 64 + col;
+}
+
+static inline bool bitset_test(const uint64_t *bits, size_t index) {
+    return (bits[index >> 6] >> (index & 63)) & 1;
+}
+
+static inline void bitset_set(uint64_t *bits, size_t index) {
+    bits[index >> 6] |= (uint64_t)1 << (index & 63);
+}
+
+/*
+ * A bump allocator over one block. Each session carves its boards and shot
+ * histories out of a single arena, and finished arenas are parked in a small
+ * per-worker pool so the next game of a similar size reuses the block instead
+ * of going back to malloc.
+ */
+#define ARENA_POOL_MAX 64
+#define ARENA_POOL_MAX_BLOCK (1 << 20)
+
+typedef struct ArenaBlock {
+    size_t capacity;
+    struct ArenaBlock *next;
+    max_align_t data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *block;
+    size_t used;
+} Arena;
+
+typedef struct {
+    ArenaBlock *free_blocks;
+    int count;
+} ArenaPool;
+
+bool arena_open(Arena *arena, ArenaPool *pool, size_t size);
+void *arena_alloc(Arena *arena, size_t size);
+void arena_close(Arena *arena, ArenaPool *pool);
+void arena_pool_clear(ArenaPool *pool);
+
+/* Space arena_alloc() needs for `size` bytes, including worst-case padding. */
+static inline size_t arena_size(size_t size) {
+    return size + alignof(max_align_t);
+}
+
+BoardKind board_kind_for(BoardKind preferred, int width, int height);
+size_t board_size(BoardKind kind, int width, int height);
+void init_board(Board *board, BoardKind kind, int width, int height);
+Board *create_board(BoardKind kind, int width, int height);
+Board *create_board_in(Arena *arena, BoardKind kind, int width, int height);
+void copy_board(Board *destination, const Board *source);
+void release_board(Board *board);
+void free_board(Board *board);
+void print_board(const Board *board);
+
+int board_get_cell(const Board *board, int row, int col);
+bool board_was_shot(const Board *board, int row, int col);
+
+void calculate_piece_coordinates(int pieceIndex, int rotationCount, int baseRow, int baseCol, Coordinate pieceCoords[4]);
+int insert_piece_on_board(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol, int pieceId);
+int check_valid_piece_placement(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol);
+long count_valid_placements(const Board *board, int shapeIndex, int numRotations);
+
+bool is_ship_sunk(const Board *board, int piece_id);
+int get_remaining_ships(const Board *board);
+
+/* xorshift64*, for the bots and tools that make up games; `state` must not be 0. */
+static inline uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline int random_below(uint64_t *state, int bound) {
+    return (int)(next_random(state) % (uint64_t)bound);
+}
+
+/*
+ * Fills `values` with the 20 values of a valid Initialize packet for a random
+ * fleet, placing it piece by piece on `scratch`, which is left holding it.
+ */
+void random_fleet(Board *scratch, uint64_t *rng, int values[MAX_SHIPS * 4]);
+
+/*
+ * Every shot a player has fired, in the order fired, so a query costs time in
+ * proportion to the shots taken rather than to the board area. `sorted` is a
+ * row-major copy that shot_log_sorted() brings up to date by merging in only
+ * the shots fired since it last ran.
+ */
+typedef struct {
+    int row;
+    int col;
+    char result;
+    /* Ships the opponent still had afloat once the shot landed. */
+    uint8_t ships;
+} ShotEntry;
+
+typedef struct {
+    ShotEntry *entries;
+    size_t count;
+    size_t capacity;
+    ShotEntry *sorted;
+    size_t sorted_count;
+    size_t sorted_capacity;
+} ShotLog;
+
+void shot_log_init(ShotLog *log);
+bool shot_log_append(ShotLog *log, int row, int col, char result);
+const ShotEntry *shot_log_sorted(ShotLog *log);
+void shot_log_clear(ShotLog *log);
+void shot_log_free(ShotLog *log);
+
+int validate_shot_coordinates(int row, int col, const Board *board);
+char process_shot(Board *opponent_board, ShotLog *shot_log, int row, int col);
+
+#endif
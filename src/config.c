@@ -0,0 +1,245 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#define DEFAULT_PORT_LOBBY 2200
+#define DEFAULT_PORT_PLAYER1 2201
+#define DEFAULT_PORT_PLAYER2 2202
+#define DEFAULT_PORT_METRICS 2203
+#define DEFAULT_PORT_SPECTATORS 2204
+#define DEFAULT_PORT_AI 2205
+#define DEFAULT_LISTEN_BACKLOG 1024
+#define DEFAULT_MAX_WAITING 1024
+#define CONFIG_LINE_MAX 1024
+
+typedef enum {
+    OPTION_INT,
+    OPTION_LONG,
+    OPTION_FLAG,
+    OPTION_PATH,
+    OPTION_BOARD,
+    OPTION_IO_BACKEND,
+    OPTION_LOG_LEVEL
+} OptionType;
+
+typedef struct {
+    const char *name;
+    OptionType type;
+    size_t offset;
+    long long min;
+    long long max;
+    const char *help;
+} Option;
+
+#define FIELD(field) offsetof(ServerConfig, field)
+
+static const Option options[] = {
+    {"workers", OPTION_INT, FIELD(workers), 1, 1024, "worker threads (default: one per CPU)"},
+    {"board", OPTION_BOARD, FIELD(board_kind), 0, 0, "dense, bitboard or sparse"},
+    {"io-backend", OPTION_IO_BACKEND, FIELD(io_backend), 0, 0, "epoll or io_uring"},
+    {"lobby-port", OPTION_INT, FIELD(lobby_port), 0, 65535, "port either player connects to, 0 to disable"},
+    {"player1-port", OPTION_INT, FIELD(player_ports[0]), 1, 65535, "port Player 1 connects to"},
+    {"player2-port", OPTION_INT, FIELD(player_ports[1]), 1, 65535, "port Player 2 connects to"},
+    {"metrics-port", OPTION_INT, FIELD(metrics_port), 0, 65535, "loopback metrics port, 0 to disable"},
+    {"spectator-port", OPTION_INT, FIELD(spectator_port), 0, 65535, "port spectators connect to, 0 to disable"},
+    {"ai-port", OPTION_INT, FIELD(ai_port), 0, 65535, "port a player connects to for a game against the built-in AI, 0 to disable"},
+    {"listen-backlog", OPTION_INT, FIELD(listen_backlog), 1, 65535, "listen() backlog of the player ports"},
+    {"log-level", OPTION_LOG_LEVEL, FIELD(log_level), 0, 0, "debug, info, warn or error"},
+    {"journal", OPTION_PATH, FIELD(journal_dir), 0, 0, "directory to journal games to"},
+    {"handoff", OPTION_PATH, FIELD(handoff_path), 0, 0, "Unix socket to hand games over to a restarted server"},
+    {"verbose", OPTION_FLAG, FIELD(verbose), 0, 0, "print every board placed"},
+    {"max-board-cells", OPTION_LONG, FIELD(max_board_cells), 0, LLONG_MAX, "largest board area Player 1 may ask for"},
+    {"max-sessions", OPTION_INT, FIELD(max_sessions), 0, INT_MAX, "sessions in play at once"},
+    {"max-waiting", OPTION_INT, FIELD(max_waiting), 0, INT_MAX, "paired players that may wait for a session"},
+    {"max-connections", OPTION_INT, FIELD(max_connections), 0, INT_MAX, "open player connections"},
+    {"max-memory", OPTION_INT, FIELD(max_memory_mb), 0, INT_MAX, "resident memory, in MB, above which sessions wait"},
+    {"max-cpu", OPTION_INT, FIELD(max_cpu_percent), 0, 100, "worker CPU use, in percent, above which sessions wait"},
+    {"packet-rate", OPTION_INT, FIELD(packet_rate), 0, INT_MAX, "packets per second per connection"},
+    {"packet-burst", OPTION_INT, FIELD(packet_burst), 0, INT_MAX, "packets a connection may send at once (default: packet-rate)"},
+    {"turn-timeout", OPTION_INT, FIELD(turn_timeout_ms), 0, INT_MAX, "milliseconds a player has to move before forfeiting"},
+    {"idle-timeout", OPTION_INT, FIELD(idle_timeout_ms), 0, INT_MAX, "milliseconds of silence before a player forfeits"},
+    {"max-spectators", OPTION_INT, FIELD(max_spectators), 0, INT_MAX, "spectators watching one session"}
+};
+
+#define OPTION_COUNT (sizeof(options) / sizeof(options[0]))
+
+void config_defaults(ServerConfig *config) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    memset(config, 0, sizeof(*config));
+    config->workers = cpus < 1 ? 1 : cpus > 1024 ? 1024 : (int)cpus;
+    config->board_kind = BOARD_DENSE;
+    config->io_backend = IO_BACKEND_EPOLL;
+    config->lobby_port = DEFAULT_PORT_LOBBY;
+    config->player_ports[0] = DEFAULT_PORT_PLAYER1;
+    config->player_ports[1] = DEFAULT_PORT_PLAYER2;
+    config->metrics_port = DEFAULT_PORT_METRICS;
+    config->spectator_port = DEFAULT_PORT_SPECTATORS;
+    config->ai_port = DEFAULT_PORT_AI;
+    config->listen_backlog = DEFAULT_LISTEN_BACKLOG;
+    config->log_level = LOG_INFO;
+    config->max_waiting = DEFAULT_MAX_WAITING;
+}
+
+void config_free(ServerConfig *config) {
+    free(config->journal_dir);
+    free(config->handoff_path);
+    config->journal_dir = NULL;
+    config->handoff_path = NULL;
+}
+
+static const Option *find_option(const char *name) {
+    for (size_t i = 0; i < OPTION_COUNT; i++) {
+        if (strcmp(options[i].name, name) == 0) {
+            return &options[i];
+        }
+    }
+    return NULL;
+}
+
+bool config_has_option(const char *name, bool *flag) {
+    const Option *option = find_option(name);
+    if (!option) {
+        return false;
+    }
+    *flag = option->type == OPTION_FLAG;
+    return true;
+}
+
+bool config_set(ServerConfig *config, const char *name, const char *value, char *error, size_t size) {
+    const Option *option = find_option(name);
+    if (!option) {
+        snprintf(error, size, "unknown option '%s'", name);
+        return false;
+    }
+
+    void *field = (char *)config + option->offset;
+    switch (option->type) {
+    case OPTION_INT:
+    case OPTION_LONG: {
+        char *end_ptr;
+        errno = 0;
+        long long number = strtoll(value, &end_ptr, 10);
+        if (errno || end_ptr == value || *end_ptr != '\0' || number < option->min || number > option->max) {
+            if (option->max == LLONG_MAX || option->max == INT_MAX) {
+                snprintf(error, size, "%s expects a number of at least %lld", name, option->min);
+            } else {
+                snprintf(error, size, "%s expects a number between %lld and %lld", name, option->min, option->max);
+            }
+            return false;
+        }
+        if (option->type == OPTION_INT) {
+            *(int *)field = (int)number;
+        } else {
+            *(long long *)field = number;
+        }
+        return true;
+    }
+    case OPTION_FLAG:
+        if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+            *(bool *)field = value[0] == 't';
+            return true;
+        }
+        snprintf(error, size, "%s expects 'true' or 'false'", name);
+        return false;
+    case OPTION_PATH:
+        if (value[0] == '\0') {
+            snprintf(error, size, "%s expects a path", name);
+            return false;
+        }
+        free(*(char **)field);
+        *(char **)field = strdup(value);
+        return *(char **)field != NULL;
+    case OPTION_BOARD:
+        if (strcmp(value, "dense") == 0) {
+            *(BoardKind *)field = BOARD_DENSE;
+        } else if (strcmp(value, "bitboard") == 0) {
+            *(BoardKind *)field = BOARD_BITBOARD;
+        } else if (strcmp(value, "sparse") == 0) {
+            *(BoardKind *)field = BOARD_SPARSE;
+        } else {
+            snprintf(error, size, "%s expects 'dense', 'bitboard' or 'sparse'", name);
+            return false;
+        }
+        return true;
+    case OPTION_IO_BACKEND:
+        if (strcmp(value, "epoll") == 0) {
+            *(IoBackend *)field = IO_BACKEND_EPOLL;
+        } else if (strcmp(value, "io_uring") == 0) {
+            *(IoBackend *)field = IO_BACKEND_URING;
+        } else {
+            snprintf(error, size, "%s expects 'epoll' or 'io_uring'", name);
+            return false;
+        }
+        return true;
+    case OPTION_LOG_LEVEL:
+        if (log_parse_level(value, field) == -1) {
+            snprintf(error, size, "%s expects debug, info, warn or error", name);
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+static char *trim(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return text;
+}
+
+bool config_load(ServerConfig *config, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "[Server] Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char line[CONFIG_LINE_MAX];
+    int number = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        char *text = trim(line);
+        if (text[0] == '\0' || text[0] == '#') {
+            continue;
+        }
+
+        char error[256];
+        char *equals = strchr(text, '=');
+        if (!equals) {
+            snprintf(error, sizeof(error), "expected 'name = value'");
+        } else {
+            *equals = '\0';
+            if (config_set(config, trim(text), trim(equals + 1), error, sizeof(error))) {
+                continue;
+            }
+        }
+        fprintf(stderr, "[Server] %s:%d: %s\n", path, number, error);
+        ok = false;
+    }
+
+    fclose(file);
+    return ok;
+}
+
+void config_usage(FILE *stream, const char *program) {
+    fprintf(stream, "Usage: %s [--config FILE] [--OPTION VALUE]...\n", program);
+    fprintf(stream, "Options apply in order, so flags after --config override the file.\n");
+    for (size_t i = 0; i < OPTION_COUNT; i++) {
+        fprintf(stream, "  --%-16s %s\n", options[i].name, options[i].help);
+    }
+}
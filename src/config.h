@@ -0,0 +1,88 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "board.h"
+#include "log.h"
+
+/* How workers wait for and move player bytes. */
+typedef enum {
+    IO_BACKEND_EPOLL,
+    IO_BACKEND_URING
+} IoBackend;
+
+/*
+ * Everything the server can be told at start-up. Each option has one name,
+ * used both as "--name VALUE" on the command line and as "name = VALUE" in a
+ * config file, and a limit of 0 means no limit.
+ */
+typedef struct {
+    int workers;
+    BoardKind board_kind;
+    /* io_uring falls back to epoll on kernels that cannot run it. */
+    IoBackend io_backend;
+    int player_ports[2];
+    /* One port for both players, who are paired by the Begin they send. */
+    int lobby_port;
+    /* A player who connects here plays Player 1 against the built-in AI. */
+    int ai_port;
+    int metrics_port;
+    int spectator_port;
+    int listen_backlog;
+    LogLevel log_level;
+    char *journal_dir;
+    /* Unix socket a restarted server takes the running one's games over through. */
+    char *handoff_path;
+    bool verbose;
+
+    /* Largest board, in cells, Player 1 may ask for. */
+    long long max_board_cells;
+    /* Sessions in play at once; pairs beyond that wait for a free slot. */
+    int max_sessions;
+    /* Pairs allowed to wait for admission before new ones are turned away. */
+    int max_waiting;
+    /* Open player connections, whether in a game, waiting or unpaired. */
+    int max_connections;
+    /* Budgets that, once exceeded, hold new sessions back like max_sessions. */
+    int max_memory_mb;
+    int max_cpu_percent;
+    /*
+     * Packets per second a connection may send, with bursts of up to
+     * `packet_burst`, or a second's worth if that is 0.
+     */
+    int packet_rate;
+    int packet_burst;
+    /*
+     * How long the player a session waits on may take to move the game on,
+     * and may go without sending anything, before it forfeits.
+     */
+    int turn_timeout_ms;
+    int idle_timeout_ms;
+    /* Spectators one session may have watching it. */
+    int max_spectators;
+} ServerConfig;
+
+void config_defaults(ServerConfig *config);
+void config_free(ServerConfig *config);
+
+/*
+ * Sets the option called `name` from its text form. A flag takes "true" or
+ * "false". On failure writes why to `error` and returns false.
+ */
+bool config_set(ServerConfig *config, const char *name, const char *value, char *error, size_t size);
+
+/* Whether `name` is an option, and if so whether it is a flag, which takes no value on the command line. */
+bool config_has_option(const char *name, bool *flag);
+
+/*
+ * Reads "name = value" lines; blank lines and those starting with '#' are
+ * skipped. Problems are reported on stderr with their line number.
+ */
+bool config_load(ServerConfig *config, const char *path);
+
+void config_usage(FILE *stream, const char *program);
+
+#endif
@@ -0,0 +1,479 @@
+#include <string.h>
+
+#include "engine.h"
+
+static void reply_to(GameStep *step, int player, Reply reply) {
+    step->has_reply[player] = true;
+    step->replies[player] = reply;
+}
+
+static void reply_error(GameStep *step, int player, int code) {
+    reply_to(step, player, (Reply){.type = REPLY_ERROR, .value = code});
+}
+
+static void reply_accept(GameStep *step, int player) {
+    reply_to(step, player, (Reply){.type = REPLY_ACCEPT});
+}
+
+static void reply_halt(GameStep *step, int player, bool won) {
+    reply_to(step, player, (Reply){.type = REPLY_HALT, .value = won});
+}
+
+static void await_player(Game *game, GamePhase phase, int player) {
+    game->phase = phase;
+    game->active = player;
+}
+
+void game_init(Game *game, BoardKind kind, ArenaPool *pool) {
+    memset(game, 0, sizeof(*game));
+    game->kind = kind;
+    game->pool = pool;
+    for (int p = 0; p < 2; p++) {
+        shot_log_init(&game->shot_log[p]);
+    }
+    await_player(game, PHASE_BEGIN_P1, 0);
+}
+
+void game_release(Game *game) {
+    for (int p = 0; p < 2; p++) {
+        shot_log_free(&game->shot_log[p]);
+        if (game->boards[p]) {
+            release_board(game->boards[p]);
+        }
+        game->boards[p] = NULL;
+    }
+    if (game->scratch_board) {
+        release_board(game->scratch_board);
+    }
+    game->scratch_board = NULL;
+    arena_close(&game->arena, game->pool);
+    game->phase = PHASE_OVER;
+}
+
+/*
+ * Both boards and the scratch board used to validate Initialize packets come
+ * out of one arena sized for exactly those three blocks. Past SPARSE_MIN_CELLS
+ * the boards are sparse whatever kind the game was set up with.
+ */
+static bool allocate_boards(Game *game) {
+    game->kind = board_kind_for(game->kind, game->width, game->height);
+    size_t size = 3 * arena_size(board_size(game->kind, game->width, game->height));
+
+    if (!arena_open(&game->arena, game->pool, size)) {
+        return false;
+    }
+
+    for (int p = 0; p < 2; p++) {
+        game->boards[p] = create_board_in(&game->arena, game->kind, game->width, game->height);
+    }
+    game->scratch_board = create_board_in(&game->arena, game->kind, game->width, game->height);
+
+    return game->boards[0] && game->boards[1] && game->scratch_board;
+}
+
+static void halt_game(Game *game, GameStep *step, int loser) {
+    reply_halt(step, loser, false);
+    game->winner = 1 - loser;
+    await_player(game, PHASE_HALT_LOSER_ACK, loser);
+}
+
+/* Ends the game with both halts at once; nobody is left to acknowledge. */
+static void forfeit_outright(Game *game, GameStep *step, int player) {
+    reply_halt(step, player, false);
+    reply_halt(step, 1 - player, true);
+    game->phase = PHASE_OVER;
+}
+
+static int validate_piece_parameters(int piece_type, int rotation) {
+    if (piece_type < 1 || piece_type > 7) {
+        return 300;
+    }
+    if (rotation < 1 || rotation > 4) {
+        return 301;
+    }
+    return 0;
+}
+
+static int validate_and_place_pieces(Board *temp_board, const Packet *packet, int num_pieces, int *lowest_error) {
+    for (int i = 0; i < num_pieces; i++) {
+        const int *fields = &packet->values[i * 4];
+        int piece_type = fields[0];
+        int rotation = fields[1];
+        int ref_row = fields[2];
+        int ref_col = fields[3];
+
+        int param_error = validate_piece_parameters(piece_type, rotation);
+
+        if (param_error && (*lowest_error == 0 || *lowest_error > param_error)) {
+            *lowest_error = param_error;
+        }
+
+        if (param_error) {
+            continue;
+        }
+
+        int placement_error = insert_piece_on_board(temp_board, piece_type - 1, rotation - 1, ref_row, ref_col, i + 1);
+
+        if (placement_error && (*lowest_error == 0 || *lowest_error > placement_error)) {
+            *lowest_error = placement_error;
+        }
+    }
+
+    return *lowest_error;
+}
+
+/* Returns 0 once the board is placed, otherwise the error code to send. */
+static int process_initialization_packet(Board *gameBoard, Board *scratchBoard, const Packet *initPacket) {
+    const int expectedPieces = 5;
+    int lowestErrorCode = 0;
+
+    if (initPacket->type != PACKET_INITIALIZE || !initPacket->spaced) {
+        return 101;
+    }
+
+    if (initPacket->tokens != expectedPieces * 4 || initPacket->integers != expectedPieces * 4) {
+        return 201;
+    }
+
+    init_board(scratchBoard, gameBoard->kind, gameBoard->width, gameBoard->height);
+    validate_and_place_pieces(scratchBoard, initPacket, expectedPieces, &lowestErrorCode);
+
+    if (lowestErrorCode != 0) {
+        return lowestErrorCode;
+    }
+
+    copy_board(gameBoard, scratchBoard);
+    return 0;
+}
+
+/* Returns -1 for a rejected shot, 1 if it sank the last ship and 0 otherwise. */
+static int process_shoot_action(Reply *response, Board *opponentBoard, ShotLog *shotLog, const Packet *shootPacket) {
+    if (shootPacket->tokens != 2 || shootPacket->integers != 2) {
+        *response = (Reply){.type = REPLY_ERROR, .value = 202};
+        return -1;
+    }
+
+    int targetRow = shootPacket->values[0];
+    int targetCol = shootPacket->values[1];
+
+    int validationErrorCode = validate_shot_coordinates(targetRow, targetCol, opponentBoard);
+    if (validationErrorCode) {
+        *response = (Reply){.type = REPLY_ERROR, .value = validationErrorCode};
+        return -1;
+    }
+
+    char shotOutcome = process_shot(opponentBoard, shotLog, targetRow, targetCol);
+    int remaining_ships = get_remaining_ships(opponentBoard);
+
+    *response = (Reply){.type = REPLY_SHOT, .value = remaining_ships, .shot = shotOutcome};
+
+    return remaining_ships == 0 ? 1 : 0;
+}
+
+/*
+ * "Q" lists every shot in row-major order. "Q <n>" lists only the shots after
+ * the first n, in the order they were fired, so a client that remembers how
+ * many entries it has seen never receives them again.
+ */
+static Reply query_response(ShotLog *shot_log, const Board *opponent_board, int since) {
+    Reply response = {
+        .type = REPLY_QUERY,
+        .value = get_remaining_ships(opponent_board)
+    };
+
+    if (since < 0) {
+        response.shots = shot_log_sorted(shot_log);
+        response.shot_count = response.shots ? shot_log->count : 0;
+    } else {
+        size_t skipped = (size_t)since < shot_log->count ? (size_t)since : shot_log->count;
+        response.shots = shot_log->entries + skipped;
+        response.shot_count = shot_log->count - skipped;
+    }
+    return response;
+}
+
+static void apply_begin(Game *game, int player, const Packet *packet, GameStep *step) {
+    if (packet->type == PACKET_FORFEIT && packet->bare) {
+        forfeit_outright(game, step, player);
+        step->event = GAME_EVENT_FORFEIT;
+        return;
+    }
+
+    if (packet->type != PACKET_BEGIN) {
+        reply_error(step, player, 100);
+        step->event = GAME_EVENT_WRONG_PACKET;
+        return;
+    }
+
+    if (player == 0) {
+        if (packet->tokens == 2 && packet->integers == 2 && !packet->trailing_space &&
+            packet->values[0] >= 10 && packet->values[1] >= 10 &&
+            (game->max_cells == 0 || (long long)packet->values[0] * packet->values[1] <= game->max_cells)) {
+            game->width = packet->values[0];
+            game->height = packet->values[1];
+            reply_accept(step, player);
+            step->event = GAME_EVENT_BEGIN_ACCEPTED;
+            await_player(game, PHASE_BEGIN_P2, 1);
+        } else {
+            reply_error(step, player, 200);
+            step->event = GAME_EVENT_BEGIN_INVALID;
+        }
+        return;
+    }
+
+    if (packet->bare) {
+        reply_accept(step, player);
+        if (!allocate_boards(game)) {
+            step->event = GAME_EVENT_OUT_OF_MEMORY;
+            game->phase = PHASE_OVER;
+            return;
+        }
+        step->event = GAME_EVENT_BEGIN_ACCEPTED;
+        await_player(game, PHASE_INIT_P1, 0);
+    } else if (packet->spaced) {
+        reply_error(step, player, 200);
+        step->event = GAME_EVENT_BEGIN_INVALID;
+    } else {
+        reply_error(step, player, 100);
+        step->event = GAME_EVENT_WRONG_PACKET;
+    }
+}
+
+static void apply_initialize(Game *game, int player, const Packet *packet, GameStep *step) {
+    if (packet->type == PACKET_FORFEIT && packet->bare) {
+        forfeit_outright(game, step, player);
+        step->event = GAME_EVENT_FORFEIT;
+        return;
+    }
+
+    int error = process_initialization_packet(game->boards[player], game->scratch_board, packet);
+    if (error) {
+        reply_error(step, player, error);
+        step->event = GAME_EVENT_BOARD_INVALID;
+        return;
+    }
+
+    memcpy(game->placements[player], packet->values, sizeof(game->placements[player]));
+    reply_accept(step, player);
+    step->event = GAME_EVENT_BOARD_READY;
+    if (player == 0) {
+        await_player(game, PHASE_INIT_P2, 1);
+    } else {
+        await_player(game, PHASE_TURN, 0);
+    }
+}
+
+static void apply_turn(Game *game, int player, const Packet *packet, GameStep *step) {
+    int opponent = 1 - player;
+    Board *opponent_board = game->boards[opponent];
+    ShotLog *shot_log = &game->shot_log[player];
+
+    if (packet->type == PACKET_SHOOT && packet->spaced) {
+        Reply response;
+        int result = process_shoot_action(&response, opponent_board, shot_log, packet);
+        reply_to(step, player, response);
+        if (result == 1) {
+            step->event = GAME_EVENT_WINNING_SHOT;
+            halt_game(game, step, opponent);
+        } else if (result == 0) {
+            step->event = GAME_EVENT_SHOT;
+            await_player(game, PHASE_TURN, opponent);
+        } else {
+            step->event = GAME_EVENT_SHOT_INVALID;
+        }
+    } else if (packet->type == PACKET_QUERY && packet->bare) {
+        reply_to(step, player, query_response(shot_log, opponent_board, -1));
+        step->event = GAME_EVENT_QUERY;
+    } else if (packet->type == PACKET_QUERY && packet->spaced && packet->tokens == 1 &&
+               packet->integers == 1 && packet->values[0] >= 0) {
+        reply_to(step, player, query_response(shot_log, opponent_board, packet->values[0]));
+        step->event = GAME_EVENT_QUERY;
+    } else if (packet->type == PACKET_FORFEIT && packet->bare) {
+        step->event = GAME_EVENT_FORFEIT;
+        halt_game(game, step, player);
+    } else {
+        reply_error(step, player, 102);
+        step->event = GAME_EVENT_WRONG_PACKET;
+    }
+}
+
+static void apply_halt_ack(Game *game, GameStep *step) {
+    step->event = GAME_EVENT_HALT_ACK;
+    if (game->phase == PHASE_HALT_LOSER_ACK) {
+        reply_halt(step, game->winner, true);
+        await_player(game, PHASE_HALT_WINNER_ACK, game->winner);
+    } else {
+        game->phase = PHASE_OVER;
+    }
+}
+
+/*
+ * Applies one packet from `player`, who must be the active player, and says
+ * what to send back. Any packet acknowledges a halt.
+ */
+void game_apply(Game *game, int player, const Packet *packet, GameStep *step) {
+    step->has_reply[0] = false;
+    step->has_reply[1] = false;
+    step->event = GAME_EVENT_WRONG_PACKET;
+
+    switch (game->phase) {
+    case PHASE_BEGIN_P1:
+    case PHASE_BEGIN_P2:
+        apply_begin(game, player, packet, step);
+        break;
+    case PHASE_INIT_P1:
+    case PHASE_INIT_P2:
+        apply_initialize(game, player, packet, step);
+        break;
+    case PHASE_TURN:
+        apply_turn(game, player, packet, step);
+        break;
+    case PHASE_HALT_LOSER_ACK:
+    case PHASE_HALT_WINNER_ACK:
+        apply_halt_ack(game, step);
+        break;
+    case PHASE_OVER:
+        break;
+    }
+}
+
+/*
+ * The active player went away. While a halt is being acknowledged that only
+ * skips the acknowledgement; at any other point the game ends.
+ */
+void game_disconnect(Game *game, GameStep *step) {
+    step->has_reply[0] = false;
+    step->has_reply[1] = false;
+
+    if (game->phase == PHASE_HALT_LOSER_ACK || game->phase == PHASE_HALT_WINNER_ACK) {
+        apply_halt_ack(game, step);
+    } else {
+        step->event = GAME_EVENT_FORFEIT;
+        game->phase = PHASE_OVER;
+    }
+}
+
+/*
+ * The active player let its deadline pass. Until the game is decided that
+ * forfeits it, with both players told straight away since the one who timed
+ * out cannot be counted on to acknowledge; during a halt it only skips the
+ * acknowledgement.
+ */
+void game_timeout(Game *game, GameStep *step) {
+    step->has_reply[0] = false;
+    step->has_reply[1] = false;
+
+    if (game->phase == PHASE_HALT_LOSER_ACK || game->phase == PHASE_HALT_WINNER_ACK) {
+        apply_halt_ack(game, step);
+    } else if (game->phase != PHASE_OVER) {
+        step->event = GAME_EVENT_TIMEOUT;
+        forfeit_outright(game, step, game->active);
+    }
+}
+
+/*
+ * Fixed-size header, then each placed board's Initialize values and each
+ * player's shots as row and column, all in host byte order: a snapshot only
+ * travels between processes on one machine.
+ */
+typedef struct {
+    uint8_t phase;
+    uint8_t active;
+    uint8_t winner;
+    uint8_t boards_placed;
+    int32_t width;
+    int32_t height;
+    uint32_t shots[2];
+} SnapshotHeader;
+
+static int boards_placed(GamePhase phase) {
+    return phase >= PHASE_TURN ? 2 : phase == PHASE_INIT_P2 ? 1 : 0;
+}
+
+bool game_snapshot(const Game *game, OutputBuffer *out) {
+    SnapshotHeader header = {
+        .phase = (uint8_t)game->phase,
+        .active = (uint8_t)game->active,
+        .winner = (uint8_t)game->winner,
+        .boards_placed = (uint8_t)boards_placed(game->phase),
+        .width = game->width,
+        .height = game->height,
+        .shots = {(uint32_t)game->shot_log[0].count, (uint32_t)game->shot_log[1].count}
+    };
+    size_t size = sizeof(header) + header.boards_placed * sizeof(game->placements[0]) +
+                  (header.shots[0] + header.shots[1]) * 2 * sizeof(int32_t);
+    if (!output_reserve(out, size)) {
+        return false;
+    }
+
+    char *cursor = out->data + out->length;
+    memcpy(cursor, &header, sizeof(header));
+    cursor += sizeof(header);
+    for (int p = 0; p < header.boards_placed; p++) {
+        memcpy(cursor, game->placements[p], sizeof(game->placements[p]));
+        cursor += sizeof(game->placements[p]);
+    }
+    for (int p = 0; p < 2; p++) {
+        for (size_t i = 0; i < game->shot_log[p].count; i++) {
+            int32_t coordinates[2] = {game->shot_log[p].entries[i].row, game->shot_log[p].entries[i].col};
+            memcpy(cursor, coordinates, sizeof(coordinates));
+            cursor += sizeof(coordinates);
+        }
+    }
+    out->length += size;
+    return true;
+}
+
+size_t game_restore(Game *game, const void *snapshot, size_t length) {
+    const char *cursor = snapshot;
+    SnapshotHeader header;
+
+    if (length < sizeof(header)) {
+        return 0;
+    }
+    memcpy(&header, cursor, sizeof(header));
+    cursor += sizeof(header);
+    size_t size = sizeof(header) + header.boards_placed * sizeof(game->placements[0]) +
+                  ((size_t)header.shots[0] + header.shots[1]) * 2 * sizeof(int32_t);
+    if (header.phase >= PHASE_OVER || header.active > 1 || header.winner > 1 ||
+        header.boards_placed != boards_placed(header.phase) || size > length ||
+        ((header.shots[0] || header.shots[1]) && header.phase < PHASE_TURN)) {
+        return 0;
+    }
+
+    game->phase = header.phase;
+    game->active = header.active;
+    game->winner = header.winner;
+    game->width = header.width;
+    game->height = header.height;
+    if (game->phase >= PHASE_INIT_P1) {
+        if (game->width < 10 || game->height < 10 || !allocate_boards(game)) {
+            return 0;
+        }
+    }
+
+    Packet placement = {.type = PACKET_INITIALIZE, .spaced = true, .tokens = PACKET_MAX_VALUES,
+                        .integers = PACKET_MAX_VALUES};
+    for (int p = 0; p < header.boards_placed; p++) {
+        memcpy(placement.values, cursor, sizeof(placement.values));
+        cursor += sizeof(placement.values);
+        if (process_initialization_packet(game->boards[p], game->scratch_board, &placement) != 0) {
+            return 0;
+        }
+        memcpy(game->placements[p], placement.values, sizeof(game->placements[p]));
+    }
+
+    /* Player p's shots landed on the other player's board. */
+    for (int p = 0; p < 2; p++) {
+        for (uint32_t i = 0; i < header.shots[p]; i++) {
+            int32_t coordinates[2];
+            memcpy(coordinates, cursor, sizeof(coordinates));
+            cursor += sizeof(coordinates);
+            if (validate_shot_coordinates(coordinates[0], coordinates[1], game->boards[1 - p]) ||
+                !process_shot(game->boards[1 - p], &game->shot_log[p], coordinates[0], coordinates[1])) {
+                return 0;
+            }
+        }
+    }
+    return size;
+}
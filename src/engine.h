@@ -0,0 +1,89 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+
+#include "board.h"
+#include "protocol.h"
+
+/*
+ * The rules of one game with no transport attached. The phase says which
+ * packet is expected next and `active` says which player it must come from.
+ * The server feeds it packets read from sockets; the self-play runner feeds
+ * it packets its bots make up.
+ */
+typedef enum {
+    PHASE_BEGIN_P1,
+    PHASE_BEGIN_P2,
+    PHASE_INIT_P1,
+    PHASE_INIT_P2,
+    PHASE_TURN,
+    PHASE_HALT_LOSER_ACK,
+    PHASE_HALT_WINNER_ACK,
+    PHASE_OVER
+} GamePhase;
+
+/* What a step did, for callers that log or count. */
+typedef enum {
+    GAME_EVENT_BEGIN_ACCEPTED,
+    GAME_EVENT_BEGIN_INVALID,
+    GAME_EVENT_WRONG_PACKET,
+    GAME_EVENT_FORFEIT,
+    GAME_EVENT_BOARD_READY,
+    GAME_EVENT_BOARD_INVALID,
+    GAME_EVENT_SHOT,
+    GAME_EVENT_SHOT_INVALID,
+    GAME_EVENT_WINNING_SHOT,
+    GAME_EVENT_QUERY,
+    GAME_EVENT_HALT_ACK,
+    GAME_EVENT_OUT_OF_MEMORY,
+    GAME_EVENT_TIMEOUT
+} GameEvent;
+
+/*
+ * The outcome of one game_apply(): at most one reply per player. A query
+ * reply points into the game's shot log and is only valid until the next
+ * call on the same game.
+ */
+typedef struct {
+    GameEvent event;
+    bool has_reply[2];
+    Reply replies[2];
+} GameStep;
+
+typedef struct {
+    GamePhase phase;
+    int active;
+    int winner;
+    int width;
+    int height;
+    BoardKind kind;
+    /* Largest width * height Player 1 may ask for; 0 means no limit. */
+    long long max_cells;
+    ArenaPool *pool;
+    Arena arena;
+    Board *boards[2];
+    Board *scratch_board;
+    ShotLog shot_log[2];
+    /* Each player's accepted Initialize, kept so a snapshot can place it again. */
+    int placements[2][PACKET_MAX_VALUES];
+} Game;
+
+void game_init(Game *game, BoardKind kind, ArenaPool *pool);
+void game_apply(Game *game, int player, const Packet *packet, GameStep *step);
+void game_disconnect(Game *game, GameStep *step);
+void game_timeout(Game *game, GameStep *step);
+void game_release(Game *game);
+
+/*
+ * A game in play as a few bytes per shot: its phase, the boards as they were
+ * placed and every shot fired, in order. game_restore() rebuilds it on a game
+ * fresh from game_init() by placing the boards again and firing the shots
+ * again, so hits, sunk ships and the shot logs come back whatever the board
+ * kind. It returns the bytes it used, or 0 for a snapshot that is cut short
+ * or does not describe a game these rules can reach.
+ */
+bool game_snapshot(const Game *game, OutputBuffer *out);
+size_t game_restore(Game *game, const void *snapshot, size_t length);
+
+#endif
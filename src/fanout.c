@@ -0,0 +1,82 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "fanout.h"
+
+#define QUEUE_SLOT(index) ((index) & (FANOUT_QUEUE_MAX - 1))
+
+SharedEvent *shared_event_new(const char *data, size_t length) {
+    SharedEvent *event = malloc(sizeof(SharedEvent) + length);
+    if (!event) {
+        return NULL;
+    }
+    event->refs = 1;
+    event->length = (uint32_t)length;
+    memcpy(event->data, data, length);
+    return event;
+}
+
+void shared_event_release(SharedEvent *event) {
+    if (--event->refs == 0) {
+        free(event);
+    }
+}
+
+bool fanout_push(FanoutQueue *queue, SharedEvent *event) {
+    if (queue->tail - queue->head == FANOUT_QUEUE_MAX) {
+        return false;
+    }
+    shared_event_retain(event);
+    queue->events[QUEUE_SLOT(queue->tail++)] = event;
+    return true;
+}
+
+FanoutResult fanout_flush(FanoutQueue *queue, int fd, uint64_t *sent) {
+    while (!fanout_empty(queue)) {
+        struct iovec iov[FANOUT_QUEUE_MAX];
+        int count = 0;
+        for (uint32_t i = queue->head; i != queue->tail; i++, count++) {
+            SharedEvent *event = queue->events[QUEUE_SLOT(i)];
+            uint32_t skip = i == queue->head ? queue->offset : 0;
+            iov[count].iov_base = event->data + skip;
+            iov[count].iov_len = event->length - skip;
+        }
+
+        ssize_t written = writev(fd, iov, count);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return FANOUT_BLOCKED;
+        }
+        if (written <= 0) {
+            return FANOUT_CLOSED;
+        }
+        *sent += written;
+
+        /* Release what went out whole; a partly sent event stays at the head. */
+        size_t left = (size_t)written;
+        while (left > 0) {
+            SharedEvent *event = queue->events[QUEUE_SLOT(queue->head)];
+            size_t remaining = event->length - queue->offset;
+            if (left < remaining) {
+                queue->offset += (uint32_t)left;
+                break;
+            }
+            left -= remaining;
+            queue->offset = 0;
+            queue->head++;
+            shared_event_release(event);
+        }
+    }
+    return FANOUT_DRAINED;
+}
+
+void fanout_clear(FanoutQueue *queue) {
+    while (!fanout_empty(queue)) {
+        shared_event_release(queue->events[QUEUE_SLOT(queue->head++)]);
+    }
+    queue->offset = 0;
+}
@@ -0,0 +1,65 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FANOUT_QUEUE_MAX 256
+
+/*
+ * One event, encoded once and queued by reference to every watcher of a
+ * session. Only the worker that owns the session touches it, so the count
+ * needs no atomics; the last watcher to send it, or drop it, frees it.
+ */
+typedef struct {
+    uint32_t refs;
+    uint32_t length;
+    char data[];
+} SharedEvent;
+
+/* A new event holding one reference, the caller's. NULL if out of memory. */
+SharedEvent *shared_event_new(const char *data, size_t length);
+
+static inline void shared_event_retain(SharedEvent *event) {
+    event->refs++;
+}
+
+void shared_event_release(SharedEvent *event);
+
+/*
+ * The events one watcher has yet to be sent, oldest first; `offset` is how
+ * much of the oldest already went out. The queue is bounded so a watcher
+ * that stops reading costs the server at most FANOUT_QUEUE_MAX references.
+ */
+typedef struct {
+    SharedEvent *events[FANOUT_QUEUE_MAX];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t offset;
+} FanoutQueue;
+
+typedef enum {
+    FANOUT_DRAINED,
+    FANOUT_BLOCKED,
+    FANOUT_CLOSED
+} FanoutResult;
+
+static inline bool fanout_empty(const FanoutQueue *queue) {
+    return queue->head == queue->tail;
+}
+
+/* Queues a reference to `event`; false, taking none, if the queue is full. */
+bool fanout_push(FanoutQueue *queue, SharedEvent *event);
+
+/*
+ * Sends queued events straight out of the shared buffers, the whole queue in
+ * one writev() each time round, until it drains or the socket would block.
+ * `sent` is increased by the bytes written.
+ */
+FanoutResult fanout_flush(FanoutQueue *queue, int fd, uint64_t *sent);
+
+/* Drops every queued reference. */
+void fanout_clear(FanoutQueue *queue);
+
+#endif
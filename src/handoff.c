@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "handoff.h"
+
+typedef struct {
+    uint8_t kind;
+    uint8_t fd_count;
+    uint16_t reserved;
+    uint32_t length;
+} RecordHeader;
+
+static bool socket_address(const char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+int handoff_listen(const char *path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(fd, 1) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int handoff_connect(const char *path) {
+    struct sockaddr_un address;
+    if (!socket_address(path, &address)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+void handoff_writer_init(HandoffWriter *writer, int fd) {
+    writer->fd = fd;
+    writer->failed = false;
+    writer->length = 0;
+    writer->fd_count = 0;
+}
+
+bool handoff_flush(HandoffWriter *writer) {
+    if (writer->failed) {
+        return false;
+    }
+    if (writer->length == 0) {
+        return true;
+    }
+
+    struct iovec iov = {writer->data, writer->length};
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int) * HANDOFF_MESSAGE_FDS)];
+    } control;
+    struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1};
+
+    if (writer->fd_count > 0) {
+        memset(&control, 0, sizeof(control));
+        message.msg_control = control.space;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * writer->fd_count);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * writer->fd_count);
+        memcpy(CMSG_DATA(cmsg), writer->fds, sizeof(int) * writer->fd_count);
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(writer->fd, &message, MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    if (sent != (ssize_t)writer->length) {
+        writer->failed = true;
+        return false;
+    }
+    writer->length = 0;
+    writer->fd_count = 0;
+    return true;
+}
+
+bool handoff_write(HandoffWriter *writer, HandoffKind kind, const void *payload, size_t length,
+                   const int *fds, int fd_count) {
+    RecordHeader header = {.kind = (uint8_t)kind, .fd_count = (uint8_t)fd_count, .length = (uint32_t)length};
+    size_t first = sizeof(header) + length < HANDOFF_MESSAGE_MAX ? sizeof(header) + length : HANDOFF_MESSAGE_MAX;
+
+    if (writer->failed || fd_count > HANDOFF_MESSAGE_FDS || length > UINT32_MAX) {
+        writer->failed = true;
+        return false;
+    }
+    if (writer->length + first > HANDOFF_MESSAGE_MAX || writer->fd_count + fd_count > HANDOFF_MESSAGE_FDS) {
+        if (!handoff_flush(writer)) {
+            return false;
+        }
+    }
+
+    memcpy(writer->data + writer->length, &header, sizeof(header));
+    writer->length += sizeof(header);
+    memcpy(writer->fds + writer->fd_count, fds, sizeof(int) * fd_count);
+    writer->fd_count += fd_count;
+
+    const char *bytes = payload;
+    while (true) {
+        size_t chunk = HANDOFF_MESSAGE_MAX - writer->length;
+        chunk = length < chunk ? length : chunk;
+        if (chunk == 0) {
+            return true;
+        }
+        memcpy(writer->data + writer->length, bytes, chunk);
+        writer->length += chunk;
+        bytes += chunk;
+        length -= chunk;
+        if (length == 0) {
+            return true;
+        }
+        if (!handoff_flush(writer)) {
+            return false;
+        }
+    }
+}
+
+void handoff_reader_init(HandoffReader *reader, int fd) {
+    reader->fd = fd;
+    reader->length = 0;
+    reader->offset = 0;
+    reader->fd_count = 0;
+    reader->fd_offset = 0;
+    reader->joined = NULL;
+}
+
+void handoff_reader_free(HandoffReader *reader) {
+    free(reader->joined);
+    reader->joined = NULL;
+}
+
+/* Takes the next message; its descriptors replace those of the last one. */
+static bool receive_message(HandoffReader *reader) {
+    struct iovec iov = {reader->data, sizeof(reader->data)};
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int) * HANDOFF_MESSAGE_FDS)];
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.space,
+        .msg_controllen = sizeof(control.space)
+    };
+
+    ssize_t received;
+    do {
+        received = recvmsg(reader->fd, &message, MSG_CMSG_CLOEXEC);
+    } while (received == -1 && errno == EINTR);
+    if (received <= 0 || (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        if (received != -1) {
+            errno = EPROTO;
+        }
+        return false;
+    }
+
+    reader->length = (size_t)received;
+    reader->offset = 0;
+    reader->fd_count = 0;
+    reader->fd_offset = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            reader->fd_count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(reader->fds, CMSG_DATA(cmsg), sizeof(int) * reader->fd_count);
+        }
+    }
+    return true;
+}
+
+bool handoff_read(HandoffReader *reader, HandoffRecord *record) {
+    RecordHeader header;
+
+    handoff_reader_free(reader);
+    if (reader->offset == reader->length && !receive_message(reader)) {
+        return false;
+    }
+    if (reader->length - reader->offset < sizeof(header)) {
+        errno = EPROTO;
+        return false;
+    }
+    memcpy(&header, reader->data + reader->offset, sizeof(header));
+    reader->offset += sizeof(header);
+    if (header.fd_count > reader->fd_count - reader->fd_offset) {
+        errno = EPROTO;
+        return false;
+    }
+
+    record->kind = (HandoffKind)header.kind;
+    record->length = header.length;
+    record->fd_count = header.fd_count;
+    memcpy(reader->record_fds, reader->fds + reader->fd_offset, sizeof(int) * header.fd_count);
+    reader->fd_offset += header.fd_count;
+    record->fds = reader->record_fds;
+
+    size_t available = reader->length - reader->offset;
+    if (header.length <= available) {
+        record->payload = reader->data + reader->offset;
+        reader->offset += header.length;
+        return true;
+    }
+
+    reader->joined = malloc(header.length);
+    if (!reader->joined) {
+        return false;
+    }
+    memcpy(reader->joined, reader->data + reader->offset, available);
+    size_t joined = available;
+    while (joined < header.length) {
+        if (!receive_message(reader)) {
+            return false;
+        }
+        size_t chunk = header.length - joined < reader->length ? header.length - joined : reader->length;
+        memcpy(reader->joined + joined, reader->data, chunk);
+        joined += chunk;
+        reader->offset = chunk;
+    }
+    record->payload = reader->joined;
+    return true;
+}
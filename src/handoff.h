@@ -0,0 +1,99 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hot restart. A server started with --handoff PATH listens on a Unix socket
+ * there; the next server started with the same path connects to it and is
+ * handed the listening sockets, every live session and every player still
+ * waiting for one, after which the old server exits.
+ *
+ * What crosses is a stream of records, each with the descriptors it owns,
+ * packed into SOCK_SEQPACKET messages of at most HANDOFF_MESSAGE_MAX bytes
+ * and HANDOFF_MESSAGE_FDS descriptors, so a record and its descriptors
+ * always arrive in the same recvmsg().
+ */
+#define HANDOFF_MESSAGE_MAX (64 * 1024)
+#define HANDOFF_MESSAGE_FDS 250
+
+typedef enum {
+    /* One listening socket; the payload is which, as a HandoffListener byte. */
+    HANDOFF_LISTENER = 1,
+    /* Both players of a session in play, with its snapshot; just Player 1 against the AI. */
+    HANDOFF_SESSION,
+    /* Both players of a pair that was waiting to become a session, or Player 1 alone. */
+    HANDOFF_PAIR,
+    /* An unpaired player; the payload is its role, 0 or 1. */
+    HANDOFF_PLAYER,
+    /* A lobby player yet to say which role it wants. */
+    HANDOFF_LOBBY,
+    /* The last record; the payload is the next session id, as a uint32_t. */
+    HANDOFF_END
+} HandoffKind;
+
+typedef enum {
+    HANDOFF_LISTENER_PLAYER1,
+    HANDOFF_LISTENER_PLAYER2,
+    HANDOFF_LISTENER_LOBBY,
+    HANDOFF_LISTENER_METRICS,
+    HANDOFF_LISTENER_SPECTATOR,
+    HANDOFF_LISTENER_AI,
+    HANDOFF_LISTENERS
+} HandoffListener;
+
+/*
+ * Records queue here until a message is full; one too long for a message
+ * carries on in the next ones. Descriptors are only lent to the writer: the
+ * caller closes its own copies once handoff_flush() has sent them. After a
+ * failure every later call fails too.
+ */
+typedef struct {
+    int fd;
+    bool failed;
+    size_t length;
+    int fd_count;
+    int fds[HANDOFF_MESSAGE_FDS];
+    char data[HANDOFF_MESSAGE_MAX];
+} HandoffWriter;
+
+typedef struct {
+    HandoffKind kind;
+    const void *payload;
+    size_t length;
+    /* Owned by the reader's caller from here on. */
+    const int *fds;
+    int fd_count;
+} HandoffRecord;
+
+typedef struct {
+    int fd;
+    size_t length;
+    size_t offset;
+    int fd_count;
+    int fd_offset;
+    int fds[HANDOFF_MESSAGE_FDS];
+    char data[HANDOFF_MESSAGE_MAX];
+    /* A record longer than one message, put back together. */
+    char *joined;
+    int record_fds[HANDOFF_MESSAGE_FDS];
+} HandoffReader;
+
+/* The old server's end: a listening socket at `path`, replacing whatever is there. */
+int handoff_listen(const char *path);
+/* The new server's end, or -1 with errno ENOENT or ECONNREFUSED when no server listens at `path`. */
+int handoff_connect(const char *path);
+
+void handoff_writer_init(HandoffWriter *writer, int fd);
+bool handoff_write(HandoffWriter *writer, HandoffKind kind, const void *payload, size_t length,
+                   const int *fds, int fd_count);
+bool handoff_flush(HandoffWriter *writer);
+
+void handoff_reader_init(HandoffReader *reader, int fd);
+/* The next record, valid until the next call; false on a broken or malformed stream. */
+bool handoff_read(HandoffReader *reader, HandoffRecord *record);
+void handoff_reader_free(HandoffReader *reader);
+
+#endif
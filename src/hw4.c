@@ -1,663 +1,3095 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <errno.h>
+#include <glob.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-#define PORT_PLAYER1 2201
-#define PORT_PLAYER2 2202
+#include "ai.h"
+#include "board.h"
+#include "config.h"
+#include "engine.h"
+#include "fanout.h"
+#include "handoff.h"
+#include "journal.h"
+#include "log.h"
+#include "metrics.h"
+#include "mpsc_queue.h"
+#include "protocol.h"
+#include "timer_wheel.h"
+#include "uring.h"
+
 #define BUFFER_SIZE 1024
-#define MAX_SHIPS 5
+#define MAX_EVENTS 256
+#define STEAL_INTERVAL_MS 10
+#define ADMISSION_RETRY_MS 100
+#define INPUT_RING_SIZE 2048
+#define OUTPUT_HIGH_WATER (64 * 1024)
+#define METRICS_REPLY_MAX (16 * 1024)
+#define SPECTATOR_REQUEST_MAX 64
+#define SPECTATOR_LINGER_MS 1000
+#define DIRECTORY_BUCKETS 4096
+#define URING_ENTRIES 1024
+#define URING_BUFFERS 512
+#define URING_BUFFER_SIZE 2048
+#define CLOSE_LINGER_MS 1000
+#define LOBBY_TIMEOUT_MS 30000
+
+typedef struct Connection Connection;
+typedef struct Session Session;
+typedef struct Spectator Spectator;
+typedef struct Worker Worker;
+
+void queue_reply(Connection *conn, const Reply *reply);
+void flush_replies(Connection *conn);
+void release_connection(Connection *conn);
+void wake_worker(Worker *worker);
+void wake_acceptor(void);
 
 typedef enum {
-    EMPTY = 0,
-    HIT = -1,
-    MISS = -2
-} CellState;
+    HANDLE_LISTENER,
+    HANDLE_CONNECTION,
+    HANDLE_WAKEUP,
+    HANDLE_METRICS,
+    HANDLE_SPECTATOR_LISTENER,
+    HANDLE_SPECTATOR,
+    HANDLE_LOBBY_LISTENER,
+    HANDLE_LOBBY,
+    HANDLE_AI_LISTENER,
+    HANDLE_HANDOFF
+} HandleKind;
+
+/* What an io_uring completion is for, kept in the low bits of its data. */
+typedef enum {
+    URING_RECV,
+    URING_SEND,
+    URING_WAKE,
+    URING_OP_MASK = 3
+} UringOp;
+
+/*
+ * Requests are framed by '\n' or, for binary clients, by record size, so a
+ * client may pipeline several of them in one segment or have one split across
+ * segments; bytes wait in the `in` ring until a whole request is there. A text
+ * connection that has never sent a newline is treated as a legacy client: each
+ * read is one packet and replies carry no terminator. Replies queue in `out`
+ * and go out in a single send() per event.
+ *
+ * Under io_uring a multishot receive runs for the whole connection and what
+ * it brings in waits in `received`, standing in for the socket buffer, until
+ * the connection is read. A send in flight owns `sending` while `out` takes
+ * the next replies; a closed connection keeps its fd until that send is done.
+ * A session taken over in a hot restart starts, on either backend, with what
+ * the old server had read and not yet acted on waiting in `received`.
+ */
+struct Connection {
+    HandleKind kind;
+    int fd;
+    int player;
+    Session *session;
+    WireFormat format;
+    bool discarding;
+    /* Packets this connection may still send now, under --packet-rate. */
+    double tokens;
+    uint64_t refilled_ns;
+    uint64_t input_ns;
+    /* Pending only while the game waits on this player. */
+    Timer deadline;
+    uint32_t in_head;
+    uint32_t in_tail;
+    OutputBuffer out;
+    OutputBuffer received;
+    OutputBuffer sending;
+    bool receiving;
+    bool send_armed;
+    bool recv_cancelled;
+    /* The peer hung up, or receiving failed with `recv_error`. */
+    bool hung_up;
+    int recv_error;
+    bool closing;
+    bool ready;
+    Connection *next_ready;
+    char in[INPUT_RING_SIZE];
+};
+
+/*
+ * A session ties a Game to the two sockets playing it. Only the socket of the
+ * player the game is waiting on is armed in epoll, so packets sent out of
+ * turn stay in the kernel buffer until it is their turn, exactly as they did
+ * with the old blocking recv() calls. Under io_uring they wait in the other
+ * connection's `received` instead.
+ *
+ * In a game against the built-in AI, Player 2's connection has no socket:
+ * the AI moves as soon as the game waits on it and its replies go to it
+ * rather than out.
+ */
+struct Session {
+    int id;
+    Worker *worker;
+    Connection players[2];
+    Game game;
+    uint32_t journal_seq;
+    bool uncommitted;
+    /* The awaited player ran out of packets and is not read until its timer fires. */
+    bool throttled;
+    /* When the game started waiting on `awaited_player` in `awaited_phase`. */
+    GamePhase awaited_phase;
+    int awaited_player;
+    uint64_t awaited_ns;
+    Session *prev;
+    Session *next;
+    Session *next_retired;
+    Session *next_commit;
+    Spectator *spectators;
+    int spectator_count;
+    /* Events were queued to spectators since they were last flushed. */
+    bool spectators_behind;
+    /* 1 or 2 once the game is decided, kept for spectators who join late. */
+    int winner;
+    Session *next_in_directory;
+    /* Plays Player 2, or NULL when a client does. */
+    AiPlayer *ai;
+};
+
+/*
+ * A connection watching one session. It sends "W <session>" and from then on
+ * only receives text: "A" and the game so far, then "B <width> <height>" once
+ * Player 1 sets the board, "S <player> <row> <col> <ships> <H|M>" for every
+ * shot that lands, with the ships its target has left, and "H <winner>", or
+ * "H 0" for a game abandoned before it was decided.
+ *
+ * Events reach it by reference through its queue and are written by the
+ * worker that runs the session, edge-triggered and never re-armed, so one
+ * that stops reading holds nobody up; once its queue is full it is cut off.
+ */
+struct Spectator {
+    HandleKind kind;
+    int fd;
+    Session *session;
+    /* Set once it is let in, and still set after its session has ended. */
+    bool attached;
+    Spectator *prev;
+    Spectator *next;
+    /* Every spectator on the worker, watching or not, for shutdown. */
+    Spectator *worker_prev;
+    Spectator *worker_next;
+    Spectator *next_retired;
+    /* Runs from the end of its session until its queue drains. */
+    Timer linger;
+    uint32_t request_length;
+    char request[SPECTATOR_REQUEST_MAX];
+    FanoutQueue queue;
+};
 
 typedef struct {
-    int **grid;
-    int width;
-    int height;
-} Board;
+    HandleKind kind;
+    int fd;
+    int player;
+} Listener;
+
+/*
+ * A player on the lobby port whose role is not known yet. The worker it is
+ * handed to peeks at its first packet, leaving it on the socket for the
+ * session: "B <width> <height>" makes it Player 1 and a bare "B" Player 2.
+ * It then goes on the matchmaking queue, where the acceptor pairs it just
+ * like a player who connected to that player's own port. A player who has
+ * not sent a Begin by its deadline is closed.
+ */
+typedef struct LobbyPlayer {
+    HandleKind kind;
+    int fd;
+    int player;
+    MpscNode node;
+    Timer deadline;
+    struct LobbyPlayer *prev;
+    struct LobbyPlayer *next;
+} LobbyPlayer;
+
+typedef struct PendingConnection {
+    int fd;
+    struct PendingConnection *next;
+} PendingConnection;
 
 typedef struct {
-    int x;
-    int y;
-} Coordinate;
+    PendingConnection *head;
+    PendingConnection *tail;
+    int count;
+} PendingQueue;
+
+/*
+ * A paired pair of connections waiting to be turned into a session. The
+ * acceptor hands these to a worker's inbox; an idle worker may steal them
+ * from a busier worker's inbox before that worker gets round to them. One
+ * taken over from the server before a hot restart carries its session's
+ * snapshot and carries on from there. A player who came to play the AI is
+ * paired with no one: fds[1] is -1.
+ */
+typedef struct PendingPair {
+    int id;
+    int fds[2];
+    char *snapshot;
+    size_t snapshot_length;
+    struct PendingPair *next;
+} PendingPair;
+
+/*
+ * A spectator on its way to a worker: straight from the acceptor, or passed
+ * on with the session it asked for by the worker that read its request.
+ */
+typedef struct PendingSpectator {
+    int fd;
+    int session_id;
+    struct PendingSpectator *next;
+} PendingSpectator;
 
 typedef struct {
-    Coordinate blocks[4];
-} Shape;
-
-const Shape base_shapes[] = {
-    {{{0, 0}, {1, 0}, {2, 0}, {3, 0}}}, 
-    {{{0, 0}, {0, 1}, {1, 0}, {1, 1}}}, 
-    {{{0, 0}, {1, 0}, {2, 0}, {2, 1}}}, 
-    {{{0, 0}, {1, 0}, {2, 0}, {2, -1}}}, 
-    {{{0, 0}, {0, 1}, {1, 1}, {1, 2}}}, 
-    {{{0, 1}, {0, 0}, {1, 1}, {1, 2}}}, 
-    {{{0, 0}, {1, -1}, {1, 0}, {1, 1}}} 
+    pthread_mutex_t lock;
+    PendingPair *head;
+    PendingPair *tail;
+    int count;
+    PendingSpectator *spectators;
+    PendingConnection *lobby;
+} SessionInbox;
+
+/*
+ * Pairs the acceptor is holding back because a session limit or budget is
+ * exceeded, admitted oldest first as room frees up. Memory and CPU use are
+ * sampled at most every ADMISSION_RETRY_MS.
+ */
+typedef struct {
+    PendingPair *head;
+    PendingPair *tail;
+    int count;
+    bool over_budget;
+    uint64_t sampled_ns;
+    uint64_t busy_ns;
+} Admission;
+
+/*
+ * What a hot restart took over from the old server, held until the workers
+ * and the acceptor are up to take it on.
+ */
+typedef struct {
+    int listeners[HANDOFF_LISTENERS];
+    PendingPair *sessions;
+    PendingPair *pairs;
+    PendingPair *last_pair;
+    PendingQueue players[2];
+    PendingConnection *lobby;
+    int session_count;
+} Takeover;
+
+/*
+ * Each worker owns an epoll instance and every session created on it, so
+ * sessions, boards and sockets are only ever touched by one thread. The inbox
+ * is the only state shared with other threads.
+ */
+struct Worker {
+    HandleKind kind;
+    int id;
+    pthread_t thread;
+    int epoll_fd;
+    int wake_fd;
+    SessionInbox inbox;
+    /* Its sessions plus the pairs in its inbox; dispatch_session() picks the lightest worker. */
+    atomic_int load;
+    ArenaPool arena_pool;
+    atomic_bool stopping;
+    Session *sessions;
+    /*
+     * Other events in the same epoll_wait() batch may still point at a finished
+     * session, so its memory is only released once the batch has been handled,
+     * and under io_uring only once the kernel is done with its connections.
+     */
+    Session *retired;
+    /*
+     * Sessions whose journal records are not yet on disk hold back their
+     * replies; one journal_sync() per batch releases all of them together.
+     */
+    Journal journal;
+    Session *commits;
+    /* Taken once per epoll_wait() batch for every timestamp the batch needs. */
+    uint64_t now_ns;
+    TimerWheel timers;
+    Spectator *spectators;
+    Spectator *retired_spectators;
+    TimerWheel lingering;
+    /* Lobby players still to send their first packet. */
+    LobbyPlayer *lobby;
+    TimerWheel lobby_deadlines;
+    /*
+     * Set when --io-backend io_uring could start a ring for this worker. The
+     * epoll instance then only holds the wakeup, spectators and the lobby,
+     * and is itself polled through the ring.
+     */
+    bool uring_enabled;
+    Uring uring;
+    /* Connections the game waits on that have input to read this batch. */
+    Connection *ready;
+    /* Handing its sessions off: nothing more is received, sent or played. */
+    bool quiescing;
+    struct timespec started_at;
+    Metrics metrics;
 };
 
-Board *create_board(int width, int height) {
-    Board *board = malloc(sizeof(Board));
-    if (!board) {
-        perror("Failed to allocate memory for board struct");
-        return NULL;
+static Worker *workers = NULL;
+static int worker_count = 0;
+static volatile sig_atomic_t shutdown_requested = 0;
+static ServerConfig config;
+static int next_session_id = 1;
+
+/*
+ * Sessions handed to workers and not yet destroyed. The acceptor adds to it
+ * when it admits a pair; workers take away as their sessions end.
+ */
+static atomic_int live_sessions;
+static AdmissionMetrics admission_metrics;
+
+/* A session or pending pair dispatched to `worker` is gone. */
+static void release_session_slot(Worker *worker) {
+    atomic_fetch_sub(&live_sessions, 1);
+    atomic_fetch_sub(&worker->load, 1);
+}
+/*
+ * Lets a worker that frees a slot wake the acceptor while pairs wait for one,
+ * or that has put a lobby player on the matchmaking queue.
+ */
+static int admission_wake_fd = -1;
+
+/*
+ * Lobby players whose role is known, pushed by any worker and paired by the
+ * acceptor. Those accepted and not yet paired count towards max-connections.
+ */
+static MpscQueue matchmaking;
+static atomic_int lobby_connections;
+
+/*
+ * Games the last run left unfinished, rebuilt from its journal and waiting
+ * for a client to take them over with "C <session>".
+ */
+static JournalSet recovered;
+static bool *recovered_claimed;
+static pthread_mutex_t recovered_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Index of the recovered game with this id, or -1; the set is sorted by id. */
+static long find_recovered(uint32_t id) {
+    size_t low = 0, high = recovered.count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (recovered.sessions[middle].id < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
+    return low < recovered.count && recovered.sessions[low].id == id ? (long)low : -1;
+}
 
-    board->width = width;
-    board->height = height;
+/*
+ * Which worker runs each live session, so a spectator accepted onto any
+ * worker can be passed to the one running the game it asks for. Sessions are
+ * chained by id; the table is only kept while the spectator port is open.
+ */
+static Session *directory[DIRECTORY_BUCKETS];
+static pthread_mutex_t directory_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool spectators_enabled;
+
+/*
+ * Set by the acceptor once a restarted server has connected to take over.
+ * Each stopping worker then writes its sessions here instead of closing
+ * them, one worker at a time.
+ */
+static HandoffWriter *handoff;
+static pthread_mutex_t handoff_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t uring_data(void *object, UringOp op) {
+    return (uint64_t)(uintptr_t)object | op;
+}
 
-    board->grid = malloc(height * sizeof(int *));
-    if (!board->grid) {
-        perror("Failed to allocate memory for board grid");
-        free(board);
-        return NULL;
-    }
+/* Player 2 of a game against the built-in AI has no connection. */
+static inline bool played_by_ai(const Session *session, int player) {
+    return player == 1 && session->ai;
+}
 
-    for (int i = 0; i < height; i++) {
-        board->grid[i] = calloc(width, sizeof(int));
-        if (!board->grid[i]) {
-            perror("Failed to allocate memory for board row");
-            for (int j = 0; j < i; j++) {
-                free(board->grid[j]);
-            }
-            free(board->grid);
-            free(board);
-            return NULL;
-        }
+static inline int pair_fd_count(const PendingPair *pair) {
+    return pair->fds[1] == -1 ? 1 : 2;
+}
+
+static void close_pair(const PendingPair *pair) {
+    for (int p = 0; p < pair_fd_count(pair); p++) {
+        close(pair->fds[p]);
     }
+}
 
-    return board;
+/* Replies not yet taken by the socket, including any send in flight. */
+static inline size_t pending_output(const Connection *conn) {
+    return conn->out.length + conn->sending.length;
 }
 
-void free_board(Board *board) {
-    if (board) {
-        for (int i = 0; i < board->height; i++) {
-            free(board->grid[i]);
-        }
-        free(board->grid);
-        free(board);
+/*
+ * io_uring's counterpart of arming EPOLLIN: the connection the game waits on
+ * is read before this batch ends if it has bytes waiting or has hung up.
+ * Under epoll it only covers input carried over by a hot restart, which no
+ * EPOLLIN would announce.
+ */
+void queue_readable(Connection *conn) {
+    Session *session = conn->session;
+    Worker *worker = session->worker;
+
+    if (conn->ready || conn->player != session->game.active || session->throttled || session->uncommitted ||
+        session->game.phase == PHASE_OVER || pending_output(conn) >= OUTPUT_HIGH_WATER ||
+        conn->in_tail - conn->in_head == INPUT_RING_SIZE || (conn->received.length == 0 && !conn->hung_up)) {
+        return;
     }
+    conn->ready = true;
+    conn->next_ready = worker->ready;
+    worker->ready = conn;
 }
 
-void print_board(const Board *board) {
-    printf("Current Board State:\n");
-    for (int i = 0; i < board->height; i++) {
-        for (int j = 0; j < board->width; j++) {
-            int cell = board->grid[i][j];
-            if (cell == EMPTY) {
-                printf(" . ");
-            } else if (cell == HIT) {
-                printf(" H ");
-            } else if (cell == MISS) {
-                printf(" M ");
-            } else {
-                printf("%2d ", cell);
-            }
-        }
-        printf("\n");
+/*
+ * Only the player we are waiting on is armed for input; either side is armed
+ * for output while it has replies the socket would not take yet. A client
+ * that lets OUTPUT_HIGH_WATER bytes of replies pile up, or that is over its
+ * packet rate, is not read from until it catches up.
+ */
+void arm_connection(Session *session, int player) {
+    if (session->worker->uring_enabled) {
+        queue_readable(&session->players[player]);
+        return;
+    }
+
+    struct epoll_event event = {0};
+    event.events = EPOLLONESHOT;
+    if (player == session->game.active && !session->throttled &&
+        session->players[player].out.length < OUTPUT_HIGH_WATER) {
+        event.events |= EPOLLIN;
     }
-    printf("\n");
+    if (session->players[player].out.length > 0) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.ptr = &session->players[player];
+    metric_add(&session->worker->metrics.io_syscalls, 1);
+    if (epoll_ctl(session->worker->epoll_fd, EPOLL_CTL_MOD, session->players[player].fd, &event) == -1) {
+        LOG_ERRNO(LOG_ERROR, "[Server] epoll_ctl() failed to arm connection");
+    }
+    if (session->players[player].received.length > 0) {
+        queue_readable(&session->players[player]);
+    }
+}
+
+static inline uint64_t max_ns(uint64_t a, uint64_t b) {
+    return a > b ? a : b;
+}
+
+static inline uint64_t ms_to_ns(int ms) {
+    return (uint64_t)ms * 1000000;
 }
 
-Coordinate rotate(Coordinate coord) {
-    return (Coordinate){.x = coord.y, .y = -coord.x};
+static Session **directory_bucket(int id) {
+    return &directory[(unsigned)id & (DIRECTORY_BUCKETS - 1)];
 }
 
-void calculate_piece_coordinates(int pieceIndex, int rotationCount, int baseRow, int baseCol, Coordinate pieceCoords[4]) {
-    if (pieceIndex < 0 || pieceIndex >= sizeof(base_shapes) / sizeof(base_shapes[0]) ||
-        rotationCount < 0 || rotationCount >= 4) {
-        fprintf(stderr, "Invalid shape index or rotation count\n");
+void directory_add(Session *session) {
+    if (!spectators_enabled) {
         return;
     }
+    pthread_mutex_lock(&directory_lock);
+    Session **bucket = directory_bucket(session->id);
+    session->next_in_directory = *bucket;
+    *bucket = session;
+    pthread_mutex_unlock(&directory_lock);
+}
 
-    const Shape *selectedShape = &base_shapes[pieceIndex];
-    for (int index = 0; index < 4; index++) {
-        Coordinate currentCoord = selectedShape->blocks[index];
-
-        for (int r = 0; r < rotationCount; r++) {
-            currentCoord = rotate(currentCoord);
+void directory_remove(Session *session) {
+    if (!spectators_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&directory_lock);
+    for (Session **link = directory_bucket(session->id); *link; link = &(*link)->next_in_directory) {
+        if (*link == session) {
+            *link = session->next_in_directory;
+            break;
         }
-
-        pieceCoords[index].x = baseRow + currentCoord.x;
-        pieceCoords[index].y = baseCol + currentCoord.y;
     }
+    pthread_mutex_unlock(&directory_lock);
 }
 
-int insert_piece_on_board(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol, int pieceId) {
-    if (shapeIndex < 0 || shapeIndex >= sizeof(base_shapes) / sizeof(base_shapes[0]) ||
-        numRotations < 0 || numRotations >= 4) {
-        fprintf(stderr, "Invalid shape index or rotation count\n");
-        return -1; 
-    }
+/* The worker running session `id`, or NULL. Only that worker may use `session`. */
+Worker *directory_lookup(int id, Session **session) {
+    Worker *owner = NULL;
+    *session = NULL;
 
-    Coordinate pieceCoords[4];
-    calculate_piece_coordinates(shapeIndex, numRotations, startRow, startCol, pieceCoords);
+    pthread_mutex_lock(&directory_lock);
+    for (Session *candidate = *directory_bucket(id); candidate; candidate = candidate->next_in_directory) {
+        if (candidate->id == id) {
+            *session = candidate;
+            owner = candidate->worker;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&directory_lock);
+    return owner;
+}
 
-    for (int idx = 0; idx < 4; idx++) {
-        int row = pieceCoords[idx].x;
-        int col = pieceCoords[idx].y;
+void spectator_inbox_push(Worker *worker, PendingSpectator *pending) {
+    pthread_mutex_lock(&worker->inbox.lock);
+    pending->next = worker->inbox.spectators;
+    worker->inbox.spectators = pending;
+    pthread_mutex_unlock(&worker->inbox.lock);
+    wake_worker(worker);
+}
 
-        if (row < 0 || row >= gameBoard->height || col < 0 || col >= gameBoard->width) {
-            return 302;
+/* Unhooks a spectator whose socket is closed or handed on; it is freed after the batch. */
+void release_spectator(Worker *worker, Spectator *spectator) {
+    Session *session = spectator->session;
+    if (session) {
+        if (spectator->prev) {
+            spectator->prev->next = spectator->next;
+        } else {
+            session->spectators = spectator->next;
         }
-
-        if (gameBoard->grid[row][col] != EMPTY) {
-            return 303;
+        if (spectator->next) {
+            spectator->next->prev = spectator->prev;
         }
+        session->spectator_count--;
+        spectator->session = NULL;
     }
 
-    for (int idx = 0; idx < 4; idx++) {
-        int row = pieceCoords[idx].x;
-        int col = pieceCoords[idx].y;
-        gameBoard->grid[row][col] = pieceId;
+    if (spectator->worker_prev) {
+        spectator->worker_prev->worker_next = spectator->worker_next;
+    } else {
+        worker->spectators = spectator->worker_next;
+    }
+    if (spectator->worker_next) {
+        spectator->worker_next->worker_prev = spectator->worker_prev;
     }
 
-    return 0;
+    timer_cancel(&worker->lingering, &spectator->linger);
+    fanout_clear(&spectator->queue);
+    spectator->fd = -1;
+    spectator->next_retired = worker->retired_spectators;
+    worker->retired_spectators = spectator;
 }
 
-bool validate_packet_header(const char *packet) {
-    return strncmp(packet, "I ", 2) == 0;
+void close_spectator(Worker *worker, Spectator *spectator) {
+    if (spectator->attached) {
+        metric_add(&worker->metrics.spectators_detached, 1);
+    }
+    close(spectator->fd);
+    release_spectator(worker, spectator);
 }
 
-int count_packet_parameters(const char *packet) {
-    int count = 0;
-    for (int i = 2; packet[i] != '\0'; i++) {
-        if (!isspace(packet[i]) && (i == 2 || isspace(packet[i - 1]))) {
-            count++;
-        }
+void free_retired_spectators(Worker *worker) {
+    while (worker->retired_spectators) {
+        Spectator *spectator = worker->retired_spectators;
+        worker->retired_spectators = spectator->next_retired;
+        free(spectator);
     }
-    return count;
 }
 
-int parse_piece(const char *packet, int *offset, int *piece_type, int *rotation, int *ref_row, int *ref_col) {
-    int parsed = sscanf(packet + *offset, "%d %d %d %d", piece_type, rotation, ref_row, ref_col);
-    if (parsed == 4) {
-        *offset += snprintf(NULL, 0, "%d %d %d %d ", *piece_type, *rotation, *ref_row, *ref_col);
+/*
+ * Sends what the socket takes of the spectator's queue; the rest waits for
+ * EPOLLOUT. One whose session is over is closed once it has everything.
+ * Returns whether it is still open.
+ */
+bool flush_spectator(Worker *worker, Spectator *spectator) {
+    uint64_t sent = 0;
+    FanoutResult result = fanout_flush(&spectator->queue, spectator->fd, &sent);
+    metric_add(&worker->metrics.spectator_bytes_out, sent);
+
+    if (result == FANOUT_CLOSED || (result == FANOUT_DRAINED && spectator->attached && !spectator->session)) {
+        close_spectator(worker, spectator);
+        return false;
     }
-    return parsed;
+    return true;
 }
 
-int validate_piece_parameters(int piece_type, int rotation) {
-    if (piece_type < 1 || piece_type > 7) {
-        return 300;
+void flush_spectators(Session *session) {
+    Spectator *spectator = session->spectators;
+    session->spectators_behind = false;
+    while (spectator) {
+        Spectator *next = spectator->next;
+        flush_spectator(session->worker, spectator);
+        spectator = next;
     }
-    if (rotation < 1 || rotation > 4) {
-        return 301;
+}
+
+void reject_spectator(Worker *worker, Spectator *spectator, int code) {
+    OutputBuffer out = {0};
+    if (encode_reply(&(Reply){.type = REPLY_ERROR, .value = code}, WIRE_TEXT, &out)) {
+        send(spectator->fd, out.data, out.length, 0);
     }
-    return 0;
+    output_free(&out);
+    close_spectator(worker, spectator);
+}
+
+static int format_shot(char *line, size_t size, int player, const ShotEntry *shot) {
+    return snprintf(line, size, "S %d %d %d %d %c\n", player + 1, shot->row, shot->col, shot->ships, shot->result);
 }
 
-int check_valid_piece_placement(Board *gameBoard, int shapeIndex, int numRotations, int startRow, int startCol) {
-    if (shapeIndex < 0 || shapeIndex >= sizeof(base_shapes) / sizeof(base_shapes[0]) ||
-        numRotations < 0 || numRotations >= 4) {
-        fprintf(stderr, "Invalid shape index or rotation count\n");
-        return -1; 
+static bool append_text(OutputBuffer *out, const char *text, int length) {
+    if (!output_reserve(out, length)) {
+        return false;
     }
+    memcpy(out->data + out->length, text, length);
+    out->length += length;
+    return true;
+}
 
-    Coordinate pieceCoords[4];
-    calculate_piece_coordinates(shapeIndex, numRotations, startRow, startCol, pieceCoords);
+/* The events a spectator who joins now has missed, in the order they happened. */
+bool describe_game(const Session *session, OutputBuffer *out) {
+    const Game *game = &session->game;
+    char line[64];
 
-    for (int idx = 0; idx < 4; idx++) {
-        int row = pieceCoords[idx].x;
-        int col = pieceCoords[idx].y;
+    if (game->width == 0) {
+        return true;
+    }
+    if (!append_text(out, line, snprintf(line, sizeof(line), "B %d %d\n", game->width, game->height))) {
+        return false;
+    }
 
-        if (row < 0 || row >= gameBoard->height || col < 0 || col >= gameBoard->width) {
-            return 302;
+    /* Players take turns, so the two shot logs interleave, Player 1 first. */
+    const ShotLog *logs = game->shot_log;
+    for (size_t i = 0; i < logs[0].count || i < logs[1].count; i++) {
+        for (int p = 0; p < 2; p++) {
+            if (i < logs[p].count &&
+                !append_text(out, line, format_shot(line, sizeof(line), p, &logs[p].entries[i]))) {
+                return false;
+            }
         }
+    }
 
-        if (gameBoard->grid[row][col] != EMPTY) {
-            return 303;
-        }
+    if (session->winner) {
+        return append_text(out, line, snprintf(line, sizeof(line), "H %d\n", session->winner));
+    }
+    return true;
+}
+
+void attach_spectator(Worker *worker, Spectator *spectator, Session *session) {
+    if (config.max_spectators && session->spectator_count >= config.max_spectators) {
+        LOG(LOG_WARN, "[Server] [Session %d] Already has %d spectators; turning another away",
+            session->id, session->spectator_count);
+        reject_spectator(worker, spectator, 200);
+        return;
     }
 
-    return 0; 
+    OutputBuffer out = {0};
+    SharedEvent *event = NULL;
+    if (encode_reply(&(Reply){.type = REPLY_ACCEPT}, WIRE_TEXT, &out) && describe_game(session, &out)) {
+        event = shared_event_new(out.data, out.length);
+    }
+    output_free(&out);
+    if (!event) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to describe the game to a spectator");
+        close_spectator(worker, spectator);
+        return;
+    }
+
+    spectator->attached = true;
+    spectator->session = session;
+    spectator->next = session->spectators;
+    if (session->spectators) {
+        session->spectators->prev = spectator;
+    }
+    session->spectators = spectator;
+    session->spectator_count++;
+    metric_add(&worker->metrics.spectators_attached, 1);
+    LOG(LOG_INFO, "[Server] [Session %d] Spectator joined; %d watching.", session->id, session->spectator_count);
+
+    fanout_push(&spectator->queue, event);
+    shared_event_release(event);
+    if (session->uncommitted) {
+        session->spectators_behind = true;
+    } else {
+        flush_spectator(worker, spectator);
+    }
 }
 
-int validate_and_place_pieces(Board *temp_board, const char *packet, int num_pieces, int *lowest_error) {
-    int offset = 2; 
-    char *end_ptr;
-    for (int i = 0; i < num_pieces; i++) {
-        int piece_type, rotation, ref_row, ref_col;
+/* Attaches the spectator here if this worker runs the session, or passes it on to the one that does. */
+void watch_session(Worker *worker, Spectator *spectator, int id) {
+    Session *session;
+    Worker *owner = directory_lookup(id, &session);
 
-        piece_type = strtol(packet + offset, &end_ptr, 10);
-        if (packet + offset == end_ptr) {
-            if (*lowest_error == 0 || *lowest_error > 201) *lowest_error = 201;
-            break;
+    if (!owner) {
+        reject_spectator(worker, spectator, 100);
+        return;
+    }
+    if (owner == worker) {
+        attach_spectator(worker, spectator, session);
+        return;
+    }
+
+    PendingSpectator *pending = malloc(sizeof(PendingSpectator));
+    if (!pending) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to pass on spectator");
+        close_spectator(worker, spectator);
+        return;
+    }
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, spectator->fd, NULL);
+    pending->fd = spectator->fd;
+    pending->session_id = id;
+    release_spectator(worker, spectator);
+    spectator_inbox_push(owner, pending);
+}
+
+void start_spectator(Worker *worker, int fd, int session_id) {
+    Spectator *spectator = calloc(1, sizeof(Spectator));
+    if (!spectator) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to allocate spectator");
+        close(fd);
+        return;
+    }
+    spectator->kind = HANDLE_SPECTATOR;
+    spectator->fd = fd;
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = spectator;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        LOG_ERRNO(LOG_ERROR, "[Server] epoll_ctl() failed to register spectator");
+        close(fd);
+        free(spectator);
+        return;
+    }
+
+    spectator->worker_next = worker->spectators;
+    if (worker->spectators) {
+        worker->spectators->worker_prev = spectator;
+    }
+    worker->spectators = spectator;
+
+    if (session_id) {
+        watch_session(worker, spectator, session_id);
+    }
+}
+
+/*
+ * Reads until the socket is drained, as it is edge-triggered. Until its
+ * request is in, bytes go to `request`; after that they are discarded, and
+ * only the end of the stream matters.
+ */
+void read_spectator(Worker *worker, Spectator *spectator) {
+    while (spectator->fd != -1) {
+        char discard[BUFFER_SIZE];
+        bool requesting = !spectator->attached;
+        char *into = requesting ? spectator->request + spectator->request_length : discard;
+        size_t space = requesting ? SPECTATOR_REQUEST_MAX - 1 - spectator->request_length : sizeof(discard);
+
+        ssize_t received = recv(spectator->fd, into, space, 0);
+        if (received == -1 && errno == EINTR) {
+            continue;
+        }
+        if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received <= 0) {
+            close_spectator(worker, spectator);
+            return;
+        }
+        if (!requesting) {
+            continue;
         }
-        offset = end_ptr - packet;
-        while (isspace(packet[offset])) offset++;
 
-        rotation = strtol(packet + offset, &end_ptr, 10);
-        if (packet + offset == end_ptr) {
-            if (*lowest_error == 0 || *lowest_error > 201) *lowest_error = 201;
-            break;
+        spectator->request_length += received;
+        char *newline = memchr(spectator->request, '\n', spectator->request_length);
+        if (!newline) {
+            if (spectator->request_length == SPECTATOR_REQUEST_MAX - 1) {
+                reject_spectator(worker, spectator, 100);
+            }
+            continue;
         }
-        offset = end_ptr - packet;
-        while (isspace(packet[offset])) offset++;
 
-        ref_row = strtol(packet + offset, &end_ptr, 10);
-        if (packet + offset == end_ptr) {
-            if (*lowest_error == 0 || *lowest_error > 201) *lowest_error = 201;
-            break;
+        Packet packet;
+        *newline = '\0';
+        scan_packet(spectator->request, &packet);
+        if (packet.type != PACKET_WATCH || !packet.spaced || packet.tokens != 1 || packet.integers != 1 ||
+            packet.values[0] < 1) {
+            reject_spectator(worker, spectator, 100);
+        } else {
+            watch_session(worker, spectator, packet.values[0]);
         }
-        offset = end_ptr - packet;
-        while (isspace(packet[offset])) offset++;
+    }
+}
 
-        ref_col = strtol(packet + offset, &end_ptr, 10);
-        if (packet + offset == end_ptr) {
-            if (*lowest_error == 0 || *lowest_error > 201) *lowest_error = 201;
-            break;
+void handle_spectator(Worker *worker, Spectator *spectator, uint32_t events) {
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        read_spectator(worker, spectator);
+    }
+    if (spectator->fd == -1 || !(events & EPOLLOUT) || fanout_empty(&spectator->queue)) {
+        return;
+    }
+    /* Events of a step not yet journaled go out with the players' replies. */
+    if (spectator->session && spectator->session->uncommitted) {
+        spectator->session->spectators_behind = true;
+    } else {
+        flush_spectator(worker, spectator);
+    }
+}
+
+/*
+ * Queues one event to every spectator of the session, by reference. One that
+ * already has FANOUT_QUEUE_MAX events waiting is cut off rather than let
+ * the queue grow.
+ */
+void announce(Session *session, const char *text, int length) {
+    Worker *worker = session->worker;
+    SharedEvent *event = shared_event_new(text, length);
+    if (!event) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to allocate spectator event");
+        return;
+    }
+
+    Spectator *spectator = session->spectators;
+    while (spectator) {
+        Spectator *next = spectator->next;
+        if (!fanout_push(&spectator->queue, event)) {
+            LOG(LOG_WARN, "[Server] [Session %d] Spectator fell %d events behind; disconnecting it",
+                session->id, FANOUT_QUEUE_MAX);
+            metric_add(&worker->metrics.spectators_dropped, 1);
+            close_spectator(worker, spectator);
         }
-        offset = end_ptr - packet;
-        while (isspace(packet[offset])) offset++;
+        spectator = next;
+    }
+    shared_event_release(event);
 
-        int param_error = validate_piece_parameters(piece_type, rotation);
+    session->spectators_behind = true;
+    metric_add(&worker->metrics.spectator_events, 1);
+}
 
-        if (param_error && (*lowest_error == 0 || *lowest_error > param_error)) {
-            *lowest_error = param_error;
+void announce_game_step(Session *session, int player, const GameStep *step) {
+    Game *game = &session->game;
+    bool decided = false;
+    char line[64];
+
+    /* The first halt sent to a loser decides the game. */
+    for (int p = 0; p < 2; p++) {
+        if (step->has_reply[p] && step->replies[p].type == REPLY_HALT && !step->replies[p].value &&
+            !session->winner) {
+            session->winner = 2 - p;
+            decided = true;
         }
+    }
+    if (!session->spectators) {
+        return;
+    }
 
-        piece_type--;
-        rotation--;
+    if (step->event == GAME_EVENT_BEGIN_ACCEPTED && player == 0) {
+        announce(session, line, snprintf(line, sizeof(line), "B %d %d\n", game->width, game->height));
+    } else if ((step->event == GAME_EVENT_SHOT || step->event == GAME_EVENT_WINNING_SHOT) &&
+               game->shot_log[player].count > 0) {
+        const ShotLog *log = &game->shot_log[player];
+        announce(session, line, format_shot(line, sizeof(line), player, &log->entries[log->count - 1]));
+    }
+    if (decided) {
+        announce(session, line, snprintf(line, sizeof(line), "H %d\n", session->winner));
+    }
+}
 
-        int placement_error = check_valid_piece_placement(temp_board, piece_type, rotation, ref_row, ref_col);
+/*
+ * The session is going away: its spectators are told how it ended and then
+ * closed, each as soon as it has been sent everything, or after
+ * SPECTATOR_LINGER_MS if it will not take it.
+ */
+void end_spectating(Session *session) {
+    Worker *worker = session->worker;
 
-        if (placement_error && (*lowest_error == 0 || *lowest_error > placement_error)) {
-            *lowest_error = placement_error;
+    if (session->game.phase == PHASE_OVER && !session->winner) {
+        announce(session, "H 0\n", 4);
+    }
+    while (session->spectators) {
+        Spectator *spectator = session->spectators;
+        session->spectators = spectator->next;
+        if (session->spectators) {
+            session->spectators->prev = NULL;
         }
-       
-        if (placement_error == 0 && param_error == 0) {
-            insert_piece_on_board(temp_board, piece_type, rotation, ref_row, ref_col, i + 1);
+        spectator->session = NULL;
+        if (flush_spectator(worker, spectator)) {
+            timer_schedule(&worker->lingering, &spectator->linger, worker->now_ns + ms_to_ns(SPECTATOR_LINGER_MS));
         }
     }
-
-    return *lowest_error;
+    session->spectator_count = 0;
 }
 
+void spectator_linger_passed(Timer *timer, void *context) {
+    Spectator *spectator = (Spectator *)((char *)timer - offsetof(Spectator, linger));
+    close_spectator(context, spectator);
+}
 
+void destroy_session(Session *session) {
+    Worker *worker = session->worker;
 
-int process_initialization_packet(int connectionFd, Board *gameBoard, const char *initPacket) {
-    const int expectedPieces = 5;
-    int lowestErrorCode = 0;
+    LOG(LOG_INFO, "[Server] [Session %d] Game over. Cleaning up resources...", session->id);
 
-    if (!validate_packet_header(initPacket)) {
-        send(connectionFd, "E 101", strlen("E 101"), 0);
-        return -1;
+    directory_remove(session);
+    if (session->spectators) {
+        end_spectating(session);
     }
 
-    if (count_packet_parameters(initPacket) != expectedPieces * 4) {
-        send(connectionFd, "E 201", strlen("E 201"), 0);
-        return -1;
+    /* A game cut short by shutdown stays open in the journal to be resumed. */
+    if (worker->journal.base && session->game.phase == PHASE_OVER) {
+        journal_mark(&worker->journal, JOURNAL_CLOSE, session->id, session->journal_seq);
     }
 
-    Board *tempBoard = create_board(gameBoard->width, gameBoard->height);
-    if (!tempBoard) {
-        perror("Failed to allocate memory for temporary board");
-        exit(EXIT_FAILURE);
+    for (int p = 0; p < 2; p++) {
+        timer_cancel(&worker->timers, &session->players[p].deadline);
+        if (played_by_ai(session, p)) {
+            continue;
+        } else if (worker->uring_enabled) {
+            release_connection(&session->players[p]);
+        } else {
+            close(session->players[p].fd);
+            output_free(&session->players[p].out);
+        }
     }
-
-    validate_and_place_pieces(tempBoard, initPacket, expectedPieces, &lowestErrorCode);
-
-    if (lowestErrorCode != 0) {
-        char errorMessage[BUFFER_SIZE];
-        snprintf(errorMessage, sizeof(errorMessage), "E %d", lowestErrorCode);
-        send(connectionFd, errorMessage, strlen(errorMessage), 0);
-        free_board(tempBoard);
-        return -1;
+    game_release(&session->game);
+    metric_add(&worker->metrics.sessions_finished, 1);
+    release_session_slot(worker);
+    if (metric_read(&admission_metrics.sessions_waiting)) {
+        wake_acceptor();
     }
 
-    for (int i = 0; i < gameBoard->height; i++) {
-        memcpy(gameBoard->grid[i], tempBoard->grid[i], gameBoard->width * sizeof(int));
+    if (session->prev) {
+        session->prev->next = session->next;
+    } else {
+        worker->sessions = session->next;
+    }
+    if (session->next) {
+        session->next->prev = session->prev;
     }
 
-    free_board(tempBoard);
-
-    send(connectionFd, "A", strlen("A"), 0);
-    return 0;
+    session->next_retired = worker->retired;
+    worker->retired = session;
 }
 
-
-bool is_ship_sunk(Board *board, int piece_id) {
-    for (int i = 0; i < board->height; i++) {
-        for (int j = 0; j < board->width; j++) {
-            if (board->grid[i][j] == piece_id) {
-                return false;
-            }
-        }
-    }
-    return true;
+static inline bool connection_busy(const Connection *conn) {
+    return conn->receiving || conn->send_armed;
 }
 
-void update_sunk_ships(bool sunk_ships[], Board *board) {
-    for (int ship_id = 1; ship_id <= MAX_SHIPS; ship_id++) {
-        if (!sunk_ships[ship_id - 1]) {
-            if (is_ship_sunk(board, ship_id)) {
-                sunk_ships[ship_id - 1] = true;
+/*
+ * Frees the sessions retired this batch. Under io_uring one whose receives
+ * are still being cancelled, or whose last replies are still going out, is
+ * kept for a later batch; once the ring is gone nothing is in flight.
+ */
+void free_retired_sessions(Worker *worker) {
+    Session *waiting = NULL;
+
+    while (worker->retired) {
+        Session *session = worker->retired;
+        worker->retired = session->next_retired;
+
+        if (worker->uring_enabled &&
+            (connection_busy(&session->players[0]) || connection_busy(&session->players[1]))) {
+            session->next_retired = waiting;
+            waiting = session;
+            continue;
+        }
+        for (int p = 0; p < 2; p++) {
+            Connection *conn = &session->players[p];
+            if (conn->closing && conn->fd != -1) {
+                close(conn->fd);
             }
+            output_free(&conn->out);
+            output_free(&conn->received);
+            output_free(&conn->sending);
         }
-    }
-}
-
-int get_remaining_ships(bool sunk_ships[]) {
-    int remaining = 0;
-    for (int i = 0; i < MAX_SHIPS; i++) {
-        if (!sunk_ships[i]) {
-            remaining++;
+        if (session->ai) {
+            ai_free(session->ai);
+            free(session->ai);
         }
+        free(session);
     }
-    return remaining;
+    worker->retired = waiting;
 }
 
-char **initialize_shot_history(int width, int height) {
-    char **history = malloc(height * sizeof(char *));
-    if (!history) {
-        perror("Failed to allocate shot history");
-        exit(EXIT_FAILURE);
+void queue_reply(Connection *conn, const Reply *reply) {
+    if (!encode_reply(reply, conn->format, &conn->out)) {
+        LOG(LOG_ERROR, "[Server] Failed to grow output buffer, dropping reply on fd %d", conn->fd);
     }
+}
 
-    for (int i = 0; i < height; i++) {
-        history[i] = calloc(width, sizeof(char));
-        if (!history[i]) {
-            perror("Failed to allocate shot history row");
-            for (int j = 0; j < i; j++) {
-                free(history[j]);
-            }
-            free(history);
-            exit(EXIT_FAILURE);
+/* Sends as much queued output as the socket takes; the rest waits for EPOLLOUT. */
+void flush_replies(Connection *conn) {
+    size_t sent = 0;
+    while (sent < conn->out.length) {
+        metric_add(&conn->session->worker->metrics.io_syscalls, 1);
+        ssize_t written = send(conn->fd, conn->out.data + sent, conn->out.length - sent, 0);
+        if (written > 0) {
+            sent += written;
+        } else if (written == -1 && errno == EINTR) {
+            continue;
+        } else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            /* The peer is gone; its next read reports that. */
+            sent = conn->out.length;
         }
     }
 
-    return history;
+    output_consume(&conn->out, sent);
+    metric_add(&conn->session->worker->metrics.bytes_out, sent);
 }
 
-void free_shot_history(char **history, int height) {
-    if (history) {
-        for (int i = 0; i < height; i++) {
-            free(history[i]);
-        }
-        free(history);
+/*
+ * Keeps a multishot receive running on the connection, unless the peer has
+ * hung up or a ring's worth of bytes is already waiting to be read. A
+ * receive that cannot be queued counts as the connection failing.
+ */
+void start_receiving(Connection *conn) {
+    Worker *worker = conn->session->worker;
+
+    if (conn->receiving || conn->hung_up || conn->closing || conn->received.length >= INPUT_RING_SIZE ||
+        worker->quiescing) {
+        return;
+    }
+    if (!uring_recv_multishot(&worker->uring, conn->fd, uring_data(conn, URING_RECV))) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to queue a receive");
+        conn->hung_up = true;
+        conn->recv_error = errno;
+        return;
     }
+    conn->receiving = true;
+    conn->recv_cancelled = false;
 }
 
-bool parse_shoot_packet(const char *packet, int *row, int *col) {
-    char extra;
-    if (sscanf(packet, "S %d %d %c", row, col, &extra) != 2) {
+/*
+ * Queues a send of the replies in `out`, unless one is already in flight.
+ * A linked send does not wait for a full socket, so the send it holds back
+ * is never stuck behind a client that stopped reading.
+ */
+bool start_sending(Connection *conn, bool link) {
+    Worker *worker = conn->session->worker;
+
+    if (conn->send_armed || conn->fd == -1 || pending_output(conn) == 0 || (worker->quiescing && !conn->closing)) {
         return false;
     }
+    if (conn->sending.length == 0) {
+        OutputBuffer swap = conn->sending;
+        conn->sending = conn->out;
+        conn->out = swap;
+    }
+    if (!uring_send(&worker->uring, conn->fd, conn->sending.data, conn->sending.length,
+                    uring_data(conn, URING_SEND), link)) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to queue a send");
+        conn->sending.length = 0;
+        return false;
+    }
+    conn->send_armed = true;
     return true;
 }
 
-int validate_shot_coordinates(int row, int col, const Board *board, char **shot_history) {
-    if (row < 0 || row >= board->height || col < 0 || col >= board->width) {
-        return 400;
+/*
+ * Sends both players' queued replies. Under io_uring a step that answers
+ * both, such as the shot that ends the game, goes out as one linked chain.
+ */
+void flush_session(Session *session) {
+    Connection *players = session->players;
+
+    if (session->worker->uring_enabled) {
+        bool chain = !players[0].send_armed && !players[1].send_armed &&
+                     pending_output(&players[0]) > 0 && pending_output(&players[1]) > 0;
+        start_sending(&players[0], chain);
+        start_sending(&players[1], false);
+        return;
     }
-    if (shot_history[row][col] != EMPTY) {
-        return 401;
+    for (int p = 0; p < 2; p++) {
+        if (players[p].out.length > 0) {
+            flush_replies(&players[p]);
+        }
     }
-    return 0;
 }
 
-char process_shot(Board *opponent_board, char **shot_history, int row, int col, bool sunk_ships[]) {
-    int piece_id = opponent_board->grid[row][col];
-    char shot_result;
-
-    if (piece_id > 0) {
-        shot_result = 'H';
-        shot_history[row][col] = 'H';
-        opponent_board->grid[row][col] = HIT;
-
-        update_sunk_ships(sunk_ships, opponent_board);
+/*
+ * Closes a finished session's connection under io_uring: its receive is
+ * cancelled, and a send still in flight gets CLOSE_LINGER_MS to finish
+ * before the fd is closed behind it.
+ */
+void release_connection(Connection *conn) {
+    Worker *worker = conn->session->worker;
+
+    conn->closing = true;
+    if (conn->receiving && !uring_cancel(&worker->uring, uring_data(conn, URING_RECV))) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to cancel a receive");
+    }
+    if (conn->send_armed) {
+        timer_schedule(&worker->timers, &conn->deadline, worker->now_ns + ms_to_ns(CLOSE_LINGER_MS));
     } else {
-        shot_result = 'M';
-        shot_history[row][col] = 'M';
-        opponent_board->grid[row][col] = MISS;
+        close(conn->fd);
+        conn->fd = -1;
     }
+}
+
+static inline char ring_byte(const Connection *conn, uint32_t offset) {
+    return conn->in[(conn->in_head + offset) & (INPUT_RING_SIZE - 1)];
+}
 
-    return shot_result;
+static void ring_copy(Connection *conn, char *frame, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        frame[i] = ring_byte(conn, i);
+    }
+    frame[length] = '\0';
 }
 
-int process_shoot_action(int connectionFd, Board *opponentBoard, char **shotHistory, bool sunk_ships[], int opponentConnectionFd, const char *shootPacket) {
-    int targetRow, targetCol;
+/*
+ * Under io_uring, "reading" takes what the connection's receive already
+ * brought in, and reports its hang-up once that is used up. Under epoll it
+ * only takes input a hot restart carried over, before the socket is read.
+ */
+static ssize_t take_received(Connection *conn, struct iovec iov[2], size_t space) {
+    size_t length = conn->received.length < space ? conn->received.length : space;
+    if (length == 0) {
+        errno = conn->hung_up ? conn->recv_error : EAGAIN;
+        return conn->hung_up && !conn->recv_error ? 0 : -1;
+    }
 
-    if (!parse_shoot_packet(shootPacket, &targetRow, &targetCol)) {
-        send(connectionFd, "E 202", strlen("E 202"), 0);
-        return -1;
+    size_t first = length < iov[0].iov_len ? length : iov[0].iov_len;
+    memcpy(iov[0].iov_base, conn->received.data, first);
+    memcpy(iov[1].iov_base, conn->received.data + first, length - first);
+    output_consume(&conn->received, length);
+    if (conn->session->worker->uring_enabled) {
+        start_receiving(conn);
     }
+    return (ssize_t)length;
+}
 
-    int validationErrorCode = validate_shot_coordinates(targetRow, targetCol, opponentBoard, shotHistory);
-    if (validationErrorCode) {
-        char errorMsg[BUFFER_SIZE];
-        snprintf(errorMsg, sizeof(errorMsg), "E %d", validationErrorCode);
-        send(connectionFd, errorMsg, strlen(errorMsg), 0);
+/*
+ * Reads whatever the socket has into the free part of the ring. A legacy
+ * connection reads at most one packet's worth, as the old recv() did. Its
+ * very first byte tells a binary client apart, and after that it becomes a
+ * text connection as soon as it sends a newline.
+ */
+ssize_t fill_input(Connection *conn) {
+    Worker *worker = conn->session->worker;
+    uint32_t used = conn->in_tail - conn->in_head;
+    size_t space = INPUT_RING_SIZE - used;
+    if (space == 0) {
+        errno = EAGAIN;
         return -1;
     }
+    if (conn->format == WIRE_LEGACY && space > BUFFER_SIZE - 1) {
+        space = BUFFER_SIZE - 1;
+    }
 
-    char shotOutcome = process_shot(opponentBoard, shotHistory, targetRow, targetCol, sunk_ships);
-    int remaining_ships = get_remaining_ships(sunk_ships);
-
-    char response[BUFFER_SIZE];
-    snprintf(response, sizeof(response), "R %d %c", remaining_ships, shotOutcome);
-    send(connectionFd, response, strlen(response), 0);
+    size_t start = conn->in_tail & (INPUT_RING_SIZE - 1);
+    size_t first = INPUT_RING_SIZE - start < space ? INPUT_RING_SIZE - start : space;
+    struct iovec iov[2] = {
+        {conn->in + start, first},
+        {conn->in, space - first}
+    };
 
-    if (remaining_ships == 0) {
- 
-        send(opponentConnectionFd, "H 0", strlen("H 0"), 0);
+    ssize_t bytes_received;
+    if (worker->uring_enabled || conn->received.length > 0) {
+        bytes_received = take_received(conn, iov, space);
+    } else {
+        metric_add(&worker->metrics.io_syscalls, 1);
+        bytes_received = readv(conn->fd, iov, space > first ? 2 : 1);
+    }
+    if (bytes_received > 0) {
+        size_t in_first = (size_t)bytes_received < first ? (size_t)bytes_received : first;
+        if (conn->format == WIRE_LEGACY && conn->in_tail == 0 &&
+            ((uint8_t)conn->in[start] & BINARY_FLAG)) {
+            conn->format = WIRE_BINARY;
+        } else if (conn->format == WIRE_LEGACY &&
+                   (memchr(iov[0].iov_base, '\n', in_first) ||
+                    memchr(iov[1].iov_base, '\n', bytes_received - in_first))) {
+            conn->format = WIRE_TEXT;
+        }
+        conn->in_tail += bytes_received;
+        conn->input_ns = worker->now_ns;
+        metric_add(&worker->metrics.bytes_in, bytes_received);
+    }
+    return bytes_received;
+}
 
-        char ack[BUFFER_SIZE];
-        int bytes_received = recv(opponentConnectionFd, ack, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
-            perror("[Server] Failed to receive acknowledgment from losing player");
-          
+/*
+ * Moves the next complete line out of the ring, without its '\n' (or "\r\n").
+ * A line longer than a packet is cut at BUFFER_SIZE - 1 bytes and the rest of
+ * it is skipped, so it is answered like any other malformed packet.
+ */
+static bool next_line(Connection *conn, char *frame) {
+    while (conn->in_head != conn->in_tail) {
+        uint32_t used = conn->in_tail - conn->in_head;
+        uint32_t limit = used < BUFFER_SIZE ? used : BUFFER_SIZE;
+        uint32_t length = 0;
+        while (length < limit && ring_byte(conn, length) != '\n') {
+            length++;
         }
 
-  
-        send(connectionFd, "H 1", strlen("H 1"), 0);
+        if (length == limit) {
+            if (used < BUFFER_SIZE) {
+                if (conn->discarding) {
+                    conn->in_head = conn->in_tail;
+                }
+                return false;
+            }
+            if (conn->discarding) {
+                conn->in_head += limit;
+                continue;
+            }
+            ring_copy(conn, frame, BUFFER_SIZE - 1);
+            conn->in_head += BUFFER_SIZE - 1;
+            conn->discarding = true;
+            return true;
+        }
 
-        bytes_received = recv(connectionFd, ack, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
-            perror("[Server] Failed to receive acknowledgment from winning player");
-          
+        if (conn->discarding) {
+            conn->in_head += length + 1;
+            conn->discarding = false;
+            continue;
         }
 
-        return 1; 
+        ring_copy(conn, frame, length);
+        if (length > 0 && frame[length - 1] == '\r') {
+            frame[length - 1] = '\0';
+        }
+        conn->in_head += length + 1;
+        return true;
     }
-
-    return 0; 
+    return false;
 }
 
+/* Takes the next complete request off a text or binary connection. */
+bool next_request(Connection *conn, Packet *packet) {
+    if (conn->format == WIRE_BINARY) {
+        uint32_t used = conn->in_tail - conn->in_head;
+        if (used == 0) {
+            return false;
+        }
 
-void append_shot_entry(char *response, char shot, int row, int col) {
-    int len = strlen(response);
-    snprintf(response + len, BUFFER_SIZE - len, " %c %d %d", shot, row, col);
-}
+        size_t size = binary_record_size((uint8_t)ring_byte(conn, 0));
+        if (used < size) {
+            return false;
+        }
 
-void construct_query_response(char **shot_history, const Board *opponent_board, int remaining_ships, char *response) {
-    snprintf(response, BUFFER_SIZE, "G %d", remaining_ships);
+        uint8_t record[BINARY_RECORD_MAX];
+        for (size_t i = 0; i < size; i++) {
+            record[i] = (uint8_t)ring_byte(conn, i);
+        }
+        conn->in_head += size;
+        decode_binary_record(record, packet);
+        return true;
+    }
 
-    for (int i = 0; i < opponent_board->height; i++) {
-        for (int j = 0; j < opponent_board->width; j++) {
-            if (shot_history[i][j] == 'H' || shot_history[i][j] == 'M') {
-                append_shot_entry(response, shot_history[i][j], i, j);
-            }
+    if (conn->format == WIRE_TEXT) {
+        char buffer[BUFFER_SIZE];
+        if (next_line(conn, buffer)) {
+            scan_packet(buffer, packet);
+            return true;
         }
     }
+    return false;
 }
 
-void handle_query_packet(int conn_fd, char **shot_history, Board *opponent_board, bool sunk_ships[]) {
-    int remaining_ships = get_remaining_ships(sunk_ships);
-    char response[BUFFER_SIZE] = {0};
-    construct_query_response(shot_history, opponent_board, remaining_ships, response);
-
-    send(conn_fd, response, strlen(response), 0);
-}
+/* Logs what a step did, the way the server always has. */
+void log_game_step(Session *session, int player, GamePhase before, const Packet *packet, const GameStep *step) {
+    Game *game = &session->game;
+    bool begin_phase = before == PHASE_BEGIN_P1 || before == PHASE_BEGIN_P2;
 
-bool wait_for_begin_packet(int conn_fd, int *board_width, int *board_height, int opponent_fd, bool is_player1) {
-    char buffer[BUFFER_SIZE];
-    while (true) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(conn_fd, buffer, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
-            perror("[Server] Failed to receive Begin or Forfeit packet");
-            exit(EXIT_FAILURE);
+    switch (step->event) {
+    case GAME_EVENT_BEGIN_ACCEPTED:
+        if (player == 0) {
+            LOG(LOG_INFO, "[Server] [Session %d] Valid Begin packet received from Player 1. Board size: %dx%d", session->id, game->width, game->height);
+            LOG(LOG_INFO, "[Server] [Session %d] Awaiting 'Begin' packet from Player 2...", session->id);
+        } else {
+            LOG(LOG_INFO, "[Server] [Session %d] Valid Begin packet received from Player 2.", session->id);
+            LOG(LOG_INFO, "[Server] [Session %d] Awaiting 'Initialize' packet from Player 1...", session->id);
         }
-        buffer[bytes_received] = '\0';
+        break;
+    case GAME_EVENT_BEGIN_INVALID:
+        if (player == 0) {
+            LOG(LOG_WARN, "[Server] [Session %d] Invalid board dimensions or malformed Begin packet from Player 1", session->id);
+        } else {
+            LOG(LOG_WARN, "[Server] [Session %d] Invalid Begin packet format for Player 2", session->id);
+        }
+        break;
+    case GAME_EVENT_WRONG_PACKET:
+        if (begin_phase && packet && packet->type == PACKET_BEGIN) {
+            LOG(LOG_WARN, "[Server] [Session %d] Invalid packet type received during Begin phase from Player 2", session->id);
+        } else if (begin_phase) {
+            LOG(LOG_WARN, "[Server] [Session %d] Invalid packet type received during Begin phase", session->id);
+        }
+        break;
+    case GAME_EVENT_FORFEIT:
+        if (packet && begin_phase) {
+            LOG(LOG_INFO, "[Server] [Session %d] Player forfeited during Begin phase. Game halted.", session->id);
+        } else if (packet && (before == PHASE_INIT_P1 || before == PHASE_INIT_P2)) {
+            LOG(LOG_INFO, "[Server] [Session %d] Player forfeited during Initialize phase. Game halted.", session->id);
+        }
+        break;
+    case GAME_EVENT_BOARD_READY:
+        LOG(LOG_INFO, "[Server] [Session %d] Player %d's board initialized successfully.", session->id, player + 1);
+        if (config.verbose) {
+            print_board(game->boards[player]);
+        }
+        if (player == 0) {
+            LOG(LOG_INFO, "[Server] [Session %d] Awaiting 'Initialize' packet from Player 2...", session->id);
+        } else {
+            LOG(LOG_INFO, "[Server] [Session %d] Both players have initialized their boards. Game starting...", session->id);
+            LOG(LOG_INFO, "[Server] [Session %d] Player 1's turn...", session->id);
+        }
+        break;
+    case GAME_EVENT_SHOT:
+        LOG(LOG_INFO, "[Server] [Session %d] Player %d's turn...", session->id, game->active + 1);
+        break;
+    case GAME_EVENT_OUT_OF_MEMORY:
+        LOG(LOG_INFO, "[Server] [Session %d] Valid Begin packet received from Player 2.", session->id);
+        LOG(LOG_ERROR, "[Server] [Session %d] Failed to allocate boards", session->id);
+        break;
+    default:
+        break;
+    }
+}
 
-        if (strncmp(buffer, "B", 1) == 0) {
-            if (is_player1) {
+void deliver_game_step(Session *session, int player, GamePhase before, const Packet *packet, const GameStep *step) {
+    Metrics *metrics = &session->worker->metrics;
 
-                char remaining_chars;
-                int parsed = sscanf(buffer, "B %d %d%c", board_width, board_height, &remaining_chars);
-                if (parsed == 2 && *board_width >= 10 && *board_height >= 10) {
-                    send(conn_fd, "A", strlen("A"), 0);
-                    printf("[Server] Valid Begin packet received from Player 1. Board size: %dx%d\n", *board_width, *board_height);
-                    return true;
-                } else {
-                    send(conn_fd, "E 200", strlen("E 200"), 0);
-                    fprintf(stderr, "[Server] Invalid board dimensions or malformed Begin packet from Player 1\n");
-                }
+    for (int p = 0; p < 2; p++) {
+        if (step->has_reply[p]) {
+            if (played_by_ai(session, p)) {
+                ai_observe(session->ai, &step->replies[p]);
             } else {
-
-                if (strcmp(buffer, "B") == 0 || strcmp(buffer, "B\n") == 0) {
-                    send(conn_fd, "A", strlen("A"), 0);
-                    printf("[Server] Valid Begin packet received from Player 2.\n");
-                    return true;
-                } else if (strncmp(buffer, "B ", 2) == 0) {
-                    send(conn_fd, "E 200", strlen("E 200"), 0);
-                    fprintf(stderr, "[Server] Invalid Begin packet format for Player 2\n");
-                } else {
-
-                    send(conn_fd, "E 100", strlen("E 100"), 0);
-                    fprintf(stderr, "[Server] Invalid packet type received during Begin phase from Player 2\n");
-                }
+                queue_reply(&session->players[p], &step->replies[p]);
+            }
+            if (step->replies[p].type == REPLY_ERROR) {
+                metrics_record_error(metrics, step->replies[p].value);
             }
-        } else if (strcmp(buffer, "F") == 0 || strcmp(buffer, "F\n") == 0) {
-            send(conn_fd, "H 0", strlen("H 0"), 0);
-            send(opponent_fd, "H 1", strlen("H 1"), 0);
-            printf("[Server] Player forfeited during Begin phase. Game halted.\n");
-            exit(EXIT_SUCCESS);
-        } else {
-            send(conn_fd, "E 100", strlen("E 100"), 0);
-            fprintf(stderr, "[Server] Invalid packet type received during Begin phase\n");
         }
     }
-}
 
+    if (step->event == GAME_EVENT_SHOT || step->event == GAME_EVENT_WINNING_SHOT) {
+        metric_add(&metrics->turns, 1);
+    }
+    announce_game_step(session, player, step);
+    log_game_step(session, player, before, packet, step);
+}
 
-void wait_for_initialize_packet(int conn_fd, Board *player_board, int opponent_fd) {
-    char buffer[BUFFER_SIZE];
-    while (true) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(conn_fd, buffer, BUFFER_SIZE, 0);
-        if (bytes_received <= 0) {
-            perror("[Server] Failed to receive Initialize or Forfeit packet");
-            exit(EXIT_FAILURE);
-        }
-        buffer[bytes_received] = '\0';
+/* Journals a step that moved the game on; its replies then wait for the sync. */
+void journal_game_step(Session *session, int player, const Packet *packet, uint8_t event_flag,
+                       GamePhase before, int before_active, const GameStep *step) {
+    Worker *worker = session->worker;
+    if (!worker->journal.base) {
+        return;
+    }
 
-        if (strcmp(buffer, "F") == 0 || strcmp(buffer, "F\n") == 0) {
-            send(conn_fd, "H 0", strlen("H 0"), 0);
-            send(opponent_fd, "H 1", strlen("H 1"), 0);
-            printf("[Server] Player forfeited during Initialize phase. Game halted.\n");
-            exit(EXIT_SUCCESS);
+    if (!journal_step(&worker->journal, session->id, session->journal_seq, player, packet, event_flag,
+                      before, before_active, &session->game, step)) {
+        if (session->game.phase != before || session->game.active != before_active) {
+            LOG_ERRNO(LOG_ERROR, "[Server] Failed to append to the journal");
         }
+        return;
+    }
 
-        if (process_initialization_packet(conn_fd, player_board, buffer) == 0) {
-            printf("[Server] Player's board initialized successfully.\n");
-            print_board(player_board);
-            break;
-        }
+    session->journal_seq++;
+    if (!session->uncommitted) {
+        session->uncommitted = true;
+        session->next_commit = worker->commits;
+        worker->commits = session;
     }
 }
 
-bool process_turn(int conn_fd, Board *opponent_board, char **shot_history, bool sunk_ships[], int opponent_fd) {
-    while (true) {
-        char buffer[BUFFER_SIZE];
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(conn_fd, buffer, BUFFER_SIZE, 0);
+/* --max-board-cells, and no more than the AI can play against. */
+void set_board_limit(Session *session) {
+    session->game.max_cells = config.max_board_cells;
+    if (session->ai && (!session->game.max_cells || session->game.max_cells > AI_MAX_CELLS)) {
+        session->game.max_cells = AI_MAX_CELLS;
+    }
+}
 
-        if (bytes_received <= 0) {
-            perror("[Server] Failed to receive packet from player");
-            return false;
+/*
+ * Takes the first packet of a new pair as "C <session>": the game of that id
+ * the journal recovered is rebuilt here and carries on with these two
+ * connections, under its old id.
+ */
+void resume_session(Session *session, const Packet *packet) {
+    JournalSession *saved = NULL;
+    long index = -1;
+
+    if (packet->spaced && packet->tokens == 1 && packet->integers == 1) {
+        pthread_mutex_lock(&recovered_lock);
+        index = find_recovered((uint32_t)packet->values[0]);
+        if (index != -1 && !recovered_claimed[index]) {
+            recovered_claimed[index] = true;
+            saved = &recovered.sessions[index];
         }
+        pthread_mutex_unlock(&recovered_lock);
+    }
 
-        buffer[bytes_received] = '\0';
+    if (!saved) {
+        queue_reply(&session->players[0], &(Reply){.type = REPLY_ERROR, .value = 100});
+        return;
+    }
 
-        if (strncmp(buffer, "S ", 2) == 0) {
-            int result = process_shoot_action(conn_fd, opponent_board, shot_history, sunk_ships, opponent_fd, buffer);
-            if (result == 1) {
-                return false;
-            } else if (result == 0) {
+    game_release(&session->game);
+    game_init(&session->game, config.board_kind, &session->worker->arena_pool);
+    int mismatches = journal_replay(saved, &session->game, NULL, NULL);
+    set_board_limit(session);
+
+    /* The AI only plays boards it can afford; a bigger game stays for a human pair. */
+    if (session->ai && (long long)session->game.width * session->game.height > AI_MAX_CELLS) {
+        LOG(LOG_INFO, "[Server] [Session %d] Session %d is too big a board for the AI; not resuming it",
+            session->id, (int)saved->id);
+        pthread_mutex_lock(&recovered_lock);
+        recovered_claimed[index] = false;
+        pthread_mutex_unlock(&recovered_lock);
+        game_release(&session->game);
+        game_init(&session->game, config.board_kind, &session->worker->arena_pool);
+        set_board_limit(session);
+        queue_reply(&session->players[0], &(Reply){.type = REPLY_ERROR, .value = 100});
+        return;
+    }
 
+    LOG(LOG_INFO, "[Server] [Session %d] Resumed as session %d after %d journaled packets.",
+        session->id, (int)saved->id, (int)saved->count);
+    if (mismatches) {
+        LOG(LOG_WARN, "[Server] [Session %d] %d replayed packets were answered differently", (int)saved->id, mismatches);
+    }
+
+    directory_remove(session);
+    session->id = (int)saved->id;
+    directory_add(session);
+    session->journal_seq = (uint32_t)saved->count;
+    /* Whoever played Player 2 before, the AI carries on for them. */
+    if (session->ai && !ai_resume(session->ai, &session->game, 1)) {
+        LOG(LOG_ERROR, "[Server] [Session %d] The AI could not catch up; it forfeits", session->id);
+    }
+    queue_reply(&session->players[0], &(Reply){.type = REPLY_ACCEPT});
+}
+
+/*
+ * Tops up the connection's packet allowance for the time since it was last
+ * topped up and says whether it may send another packet now. One that may
+ * not leaves the session throttled until its timer fires as it earns one.
+ */
+bool connection_may_send(Session *session, Connection *conn) {
+    if (!config.packet_rate) {
+        return true;
+    }
+
+    uint64_t now = session->worker->now_ns;
+    conn->tokens += (now - conn->refilled_ns) * (double)config.packet_rate / 1e9;
+    if (conn->tokens > config.packet_burst) {
+        conn->tokens = config.packet_burst;
+    }
+    conn->refilled_ns = now;
+
+    if (conn->tokens >= 1) {
+        session->throttled = false;
+        return true;
+    }
+    if (!session->throttled) {
+        session->throttled = true;
+        metric_add(&session->worker->metrics.packets_throttled, 1);
+    }
+    return false;
+}
+
+void dispatch_packet(Session *session, int player, const Packet *packet) {
+    GamePhase before = session->game.phase;
+    int before_active = session->game.active;
+    GameStep step;
+    uint64_t started = metrics_now_ns();
+
+    if (config.packet_rate) {
+        session->players[player].tokens -= 1;
+    }
+    if (packet->type == PACKET_RESUME && before == PHASE_BEGIN_P1 && config.journal_dir) {
+        resume_session(session, packet);
+    } else {
+        game_apply(&session->game, player, packet, &step);
+        journal_game_step(session, player, packet, 0, before, before_active, &step);
+        deliver_game_step(session, player, before, packet, &step);
+    }
+    metrics_record_packet(&session->worker->metrics, packet->type, metrics_now_ns() - started);
+}
+
+/* The AI's move, made the moment the game waits on it. */
+void play_ai_move(Session *session) {
+    Metrics *metrics = &session->worker->metrics;
+    Packet packet;
+    uint64_t started = metrics_now_ns();
+
+    ai_next_packet(session->ai, &session->game, &packet);
+    metric_add(&metrics->ai_moves, 1);
+    metric_add(&metrics->ai_move_ns, metrics_now_ns() - started);
+    dispatch_packet(session, 1, &packet);
+}
+
+/*
+ * Pipelined requests run as long as the player we wait on has one buffered,
+ * and the AI answers in between.
+ */
+void run_buffered_requests(Session *session) {
+    Packet packet;
+    while (session->game.phase != PHASE_OVER) {
+        if (played_by_ai(session, session->game.active)) {
+            play_ai_move(session);
+            continue;
+        }
+        Connection *conn = &session->players[session->game.active];
+        if (pending_output(conn) >= OUTPUT_HIGH_WATER || conn->in_head == conn->in_tail ||
+            !connection_may_send(session, conn) || !next_request(conn, &packet)) {
+            break;
+        }
+        dispatch_packet(session, session->game.active, &packet);
+    }
+}
+
+/*
+ * Keeps one timer on the connection the game waits on, set for the earliest
+ * of its turn deadline, its idle deadline and, while it is throttled, the
+ * moment it earns its next packet. The other connection has none. The turn
+ * clock restarts whenever the game moves on to another phase or player.
+ */
+void schedule_deadline(Session *session) {
+    Worker *worker = session->worker;
+    Game *game = &session->game;
+    int player = game->active;
+    Connection *conn = &session->players[player];
+
+    if (game->phase != session->awaited_phase || player != session->awaited_player) {
+        session->awaited_phase = game->phase;
+        session->awaited_player = player;
+        session->awaited_ns = worker->now_ns;
+    }
+    timer_cancel(&worker->timers, &session->players[1 - player].deadline);
+
+    uint64_t deadline = UINT64_MAX;
+    if (config.turn_timeout_ms) {
+        deadline = session->awaited_ns + ms_to_ns(config.turn_timeout_ms);
+    }
+    if (config.idle_timeout_ms) {
+        uint64_t idle = max_ns(conn->input_ns, session->awaited_ns) + ms_to_ns(config.idle_timeout_ms);
+        deadline = idle < deadline ? idle : deadline;
+    }
+    if (session->throttled) {
+        uint64_t earned = conn->refilled_ns + (uint64_t)((1 - conn->tokens) * 1e9 / config.packet_rate);
+        deadline = earned < deadline ? earned : deadline;
+    }
+
+    if (deadline == UINT64_MAX) {
+        timer_cancel(&worker->timers, &conn->deadline);
+    } else {
+        timer_schedule(&worker->timers, &conn->deadline, deadline);
+    }
+}
+
+/*
+ * Ends one round of work on a session: queued replies go out, a finished
+ * session is torn down, and otherwise the sockets are re-armed.
+ */
+void finish_session_cycle(Session *session) {
+    if (session->uncommitted) {
+        return;
+    }
+    /* A forfeit or a session taken over can leave the game waiting on the AI. */
+    if (played_by_ai(session, session->game.active) && session->game.phase != PHASE_OVER) {
+        run_buffered_requests(session);
+        if (session->uncommitted) {
+            return;
+        }
+    }
+
+    flush_session(session);
+    if (session->spectators_behind) {
+        flush_spectators(session);
+    }
+
+    if (session->game.phase == PHASE_OVER) {
+        destroy_session(session);
+        return;
+    }
+
+    for (int p = 0; p < 2; p++) {
+        if (p == session->game.active || pending_output(&session->players[p]) > 0) {
+            arm_connection(session, p);
+        }
+    }
+    schedule_deadline(session);
+}
+
+/* The player the game waits on went away, or let its deadline pass. */
+void end_awaited_turn(Session *session, int player, bool timed_out) {
+    GamePhase before = session->game.phase;
+    int before_active = session->game.active;
+    GameStep step;
+
+    if (timed_out) {
+        game_timeout(&session->game, &step);
+    } else {
+        game_disconnect(&session->game, &step);
+    }
+    journal_game_step(session, player, NULL, timed_out ? JOURNAL_FLAG_TIMEOUT : JOURNAL_FLAG_DISCONNECT,
+                      before, before_active, &step);
+    deliver_game_step(session, player, before, NULL, &step);
+}
+
+void handle_session_readable(Session *session, int player) {
+    Connection *conn = &session->players[player];
+    Packet packet;
+
+    if (!connection_may_send(session, conn)) {
+        finish_session_cycle(session);
+        return;
+    }
+
+    ssize_t bytes_received = fill_input(conn);
+
+    if (bytes_received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        finish_session_cycle(session);
+        return;
+    }
+
+    if (bytes_received <= 0) {
+        switch (session->game.phase) {
+        case PHASE_BEGIN_P1:
+        case PHASE_BEGIN_P2:
+            LOG_ERRNO(LOG_ERROR, "[Server] Failed to receive Begin or Forfeit packet");
+            break;
+        case PHASE_INIT_P1:
+        case PHASE_INIT_P2:
+            LOG_ERRNO(LOG_ERROR, "[Server] Failed to receive Initialize or Forfeit packet");
+            break;
+        case PHASE_TURN:
+            LOG_ERRNO(LOG_ERROR, "[Server] Failed to receive packet from player");
+            break;
+        case PHASE_HALT_LOSER_ACK:
+            LOG_ERRNO(LOG_ERROR, "[Server] Failed to receive acknowledgment from losing player");
+            break;
+        case PHASE_HALT_WINNER_ACK:
+            LOG_ERRNO(LOG_ERROR, "[Server] Failed to receive acknowledgment from winning player");
+            break;
+        case PHASE_OVER:
+            break;
+        }
+
+        end_awaited_turn(session, player, false);
+    } else if (conn->format == WIRE_LEGACY) {
+        char buffer[BUFFER_SIZE];
+        ring_copy(conn, buffer, conn->in_tail - conn->in_head);
+        conn->in_head = conn->in_tail;
+        scan_packet(buffer, &packet);
+        dispatch_packet(session, player, &packet);
+    }
+
+    run_buffered_requests(session);
+    finish_session_cycle(session);
+}
+
+/* Called when a side that had replies backed up becomes writable. */
+void handle_session_writable(Session *session) {
+    flush_session(session);
+    run_buffered_requests(session);
+    finish_session_cycle(session);
+}
+
+/*
+ * A multishot receive completed: bytes go to `received` and the buffer back
+ * to the kernel. Past a ring's worth the receive is cancelled, and started
+ * again once the session has read them, so a flooding client is held back
+ * by TCP as it would be under epoll.
+ */
+void connection_received(Worker *worker, Connection *conn, const UringCompletion *completion) {
+    if (completion->buffer >= 0) {
+        if (completion->result > 0 && !conn->closing) {
+            if (output_reserve(&conn->received, completion->result)) {
+                memcpy(conn->received.data + conn->received.length, uring_buffer(&worker->uring, completion->buffer),
+                       completion->result);
+                conn->received.length += completion->result;
+            } else {
+                LOG(LOG_ERROR, "[Server] Failed to grow input buffer, dropping fd %d", conn->fd);
+                conn->hung_up = true;
+                conn->recv_error = ENOMEM;
+            }
+        }
+        uring_recycle(&worker->uring, completion->buffer);
+    }
+    if (!completion->more) {
+        conn->receiving = false;
+    }
+    if (conn->closing) {
+        return;
+    }
+
+    if (completion->result == 0) {
+        conn->hung_up = true;
+    } else if (completion->result < 0 && completion->result != -ENOBUFS && completion->result != -ECANCELED) {
+        conn->hung_up = true;
+        conn->recv_error = -completion->result;
+    }
+    if (conn->receiving && !conn->recv_cancelled && conn->received.length >= INPUT_RING_SIZE) {
+        conn->recv_cancelled = uring_cancel(&worker->uring, uring_data(conn, URING_RECV));
+    }
+    start_receiving(conn);
+    queue_readable(conn);
+}
+
+/*
+ * A send completed. The rest of a short one, one cancelled with its chain
+ * and whatever queued meanwhile go out next; a failed one drops the
+ * connection's replies like flush_replies() does. Replies backing up past
+ * OUTPUT_HIGH_WATER held reading back, so that resumes here.
+ */
+void connection_sent(Worker *worker, Connection *conn, int result) {
+    Session *session = conn->session;
+
+    conn->send_armed = false;
+    if (result > 0) {
+        output_consume(&conn->sending, result);
+        metric_add(&worker->metrics.bytes_out, result);
+    } else if (result != -EAGAIN && result != -ECANCELED) {
+        conn->sending.length = 0;
+        conn->out.length = 0;
+    }
+    start_sending(conn, false);
+
+    if (conn->closing) {
+        if (!conn->send_armed) {
+            timer_cancel(&worker->timers, &conn->deadline);
+            close(conn->fd);
+            conn->fd = -1;
+        }
+        return;
+    }
+    if (worker->quiescing) {
+        return;
+    }
+    if (!conn->send_armed && conn->player == session->game.active && conn->in_head != conn->in_tail &&
+        !session->uncommitted && session->game.phase != PHASE_OVER) {
+        handle_session_writable(session);
+    } else {
+        queue_readable(conn);
+    }
+}
+
+/*
+ * What a session needs besides its game to carry on in another process:
+ * what each player sent that was not acted on yet, the replies not yet sent
+ * and the times its deadlines and packet allowance run from. Those are
+ * CLOCK_MONOTONIC, the same clock in both processes, so a restart neither
+ * gives a player more time nor takes any away. Each player's input and
+ * output follow in that order, then the game's own snapshot.
+ */
+typedef struct {
+    uint32_t id;
+    uint32_t journal_seq;
+    uint8_t awaited_phase;
+    uint8_t awaited_player;
+    uint8_t throttled;
+    uint8_t winner;
+    uint64_t awaited_ns;
+    struct {
+        uint8_t format;
+        uint8_t discarding;
+        uint32_t input;
+        uint32_t output;
+        double tokens;
+        uint64_t refilled_ns;
+        uint64_t input_ns;
+    } players[2];
+} SessionSnapshot;
+
+static bool append_bytes(OutputBuffer *out, const char *bytes, size_t length) {
+    if (!output_reserve(out, length)) {
+        return false;
+    }
+    memcpy(out->data + out->length, bytes, length);
+    out->length += length;
+    return true;
+}
+
+bool snapshot_session(const Session *session, OutputBuffer *out) {
+    SessionSnapshot header = {
+        .id = (uint32_t)session->id,
+        .journal_seq = session->journal_seq,
+        .awaited_phase = (uint8_t)session->awaited_phase,
+        .awaited_player = (uint8_t)session->awaited_player,
+        .throttled = session->throttled,
+        .winner = (uint8_t)session->winner,
+        .awaited_ns = session->awaited_ns
+    };
+    for (int p = 0; p < 2; p++) {
+        const Connection *conn = &session->players[p];
+        header.players[p].format = (uint8_t)conn->format;
+        header.players[p].discarding = conn->discarding;
+        header.players[p].input = conn->in_tail - conn->in_head + (uint32_t)conn->received.length;
+        header.players[p].output = (uint32_t)pending_output(conn);
+        header.players[p].tokens = conn->tokens;
+        header.players[p].refilled_ns = conn->refilled_ns;
+        header.players[p].input_ns = conn->input_ns;
+    }
+    if (!append_bytes(out, (const char *)&header, sizeof(header))) {
+        return false;
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const Connection *conn = &session->players[p];
+        uint32_t buffered = conn->in_tail - conn->in_head;
+        if (!output_reserve(out, buffered)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < buffered; i++) {
+            out->data[out->length++] = ring_byte(conn, i);
+        }
+        if (!append_bytes(out, conn->received.data, conn->received.length) ||
+            !append_bytes(out, conn->sending.data, conn->sending.length) ||
+            !append_bytes(out, conn->out.data, conn->out.length)) {
+            return false;
+        }
+    }
+    return game_snapshot(&session->game, out);
+}
+
+/* Puts a snapshot from snapshot_session() back on a session fresh from create_session(). */
+bool restore_session(Session *session, const char *snapshot, size_t length) {
+    SessionSnapshot header;
+
+    if (length < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, snapshot, sizeof(header));
+    snapshot += sizeof(header);
+    length -= sizeof(header);
+    if (header.awaited_player > 1 || header.awaited_phase > PHASE_OVER || header.winner > 2) {
+        return false;
+    }
+
+    session->journal_seq = header.journal_seq;
+    session->awaited_phase = header.awaited_phase;
+    session->awaited_player = header.awaited_player;
+    session->awaited_ns = header.awaited_ns;
+    session->throttled = header.throttled;
+    session->winner = header.winner;
+    for (int p = 0; p < 2; p++) {
+        Connection *conn = &session->players[p];
+        size_t input = header.players[p].input;
+        size_t output = header.players[p].output;
+        if (header.players[p].format > WIRE_BINARY || input > length || output > length - input) {
+            return false;
+        }
+        conn->format = header.players[p].format;
+        conn->discarding = header.players[p].discarding;
+        conn->tokens = header.players[p].tokens;
+        conn->refilled_ns = header.players[p].refilled_ns;
+        conn->input_ns = header.players[p].input_ns;
+        if (!append_bytes(&conn->received, snapshot, input) ||
+            !append_bytes(&conn->out, snapshot + input, output)) {
+            return false;
+        }
+        snapshot += input + output;
+        length -= input + output;
+    }
+    return game_restore(&session->game, snapshot, length) == length;
+}
+
+/*
+ * Starts the session for a pair, or carries on the one a pair taken over in
+ * a hot restart brings with it, under its old id.
+ */
+Session *create_session(Worker *worker, const PendingPair *pair) {
+    Session *session = calloc(1, sizeof(Session));
+    if (!session) {
+        LOG_ERRNO(LOG_ERROR, "Failed to allocate memory for session");
+        return NULL;
+    }
+
+    session->id = pair->id;
+    session->worker = worker;
+    session->awaited_ns = worker->now_ns;
+    if (pair->fds[1] == -1) {
+        session->ai = malloc(sizeof(AiPlayer));
+        if (!session->ai) {
+            LOG_ERRNO(LOG_ERROR, "Failed to allocate memory for the AI");
+            free(session);
+            return NULL;
+        }
+        ai_start(session->ai, metrics_now_ns() ^ (uint64_t)pair->id);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        session->players[p].kind = HANDLE_CONNECTION;
+        session->players[p].fd = pair->fds[p];
+        session->players[p].player = p;
+        session->players[p].session = session;
+        session->players[p].tokens = config.packet_burst;
+        session->players[p].refilled_ns = worker->now_ns;
+        session->players[p].input_ns = worker->now_ns;
+        if (worker->uring_enabled || played_by_ai(session, p)) {
+            continue;
+        }
+
+        /* Registered disarmed; only the side the game waits on gets armed. */
+        metric_add(&worker->metrics.io_syscalls, 1);
+        struct epoll_event event = {0};
+        event.events = EPOLLONESHOT;
+        event.data.ptr = &session->players[p];
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, pair->fds[p], &event) == -1) {
+            LOG_ERRNO(LOG_ERROR, "[Server] epoll_ctl() failed to register connection");
+            if (p == 1) {
+                epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, pair->fds[0], NULL);
+            }
+            free(session->ai);
+            free(session);
+            return NULL;
+        }
+    }
+
+    game_init(&session->game, config.board_kind, &worker->arena_pool);
+    set_board_limit(session);
+    if (pair->snapshot && !restore_session(session, pair->snapshot, pair->snapshot_length)) {
+        LOG(LOG_ERROR, "[Server] [Session %d] Could not be restored from its snapshot; dropping it", session->id);
+        if (!worker->uring_enabled) {
+            for (int p = 0; p < pair_fd_count(pair); p++) {
+                epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, pair->fds[p], NULL);
+            }
+        }
+        game_release(&session->game);
+        for (int p = 0; p < 2; p++) {
+            output_free(&session->players[p].received);
+            output_free(&session->players[p].out);
+        }
+        free(session->ai);
+        free(session);
+        return NULL;
+    }
+    /* The AI remembers its shots from the game's own log. */
+    if (pair->snapshot && session->ai && !ai_resume(session->ai, &session->game, 1)) {
+        LOG(LOG_ERROR, "[Server] [Session %d] The AI could not catch up; it forfeits", session->id);
+    }
+
+    session->next = worker->sessions;
+    if (worker->sessions) {
+        worker->sessions->prev = session;
+    }
+    worker->sessions = session;
+    directory_add(session);
+    metric_add(&worker->metrics.sessions_started, 1);
+
+    if (pair->snapshot) {
+        LOG(LOG_INFO, "[Server] [Session %d] Taken over on worker %d.", session->id, worker->id);
+    } else if (session->ai) {
+        metric_add(&worker->metrics.ai_sessions_started, 1);
+        LOG(LOG_INFO, "[Server] [Session %d] Started on worker %d against the AI. Awaiting 'Begin' packet from Player 1...", session->id, worker->id);
+    } else {
+        LOG(LOG_INFO, "[Server] [Session %d] Started on worker %d. Awaiting 'Begin' packet from Player 1...", session->id, worker->id);
+    }
+    if (worker->uring_enabled) {
+        start_receiving(&session->players[0]);
+        if (!session->ai) {
+            start_receiving(&session->players[1]);
+        }
+    }
+    /* Replies the old server had not sent yet go out now. */
+    finish_session_cycle(session);
+    return session;
+}
+
+void push_pending(PendingQueue *queue, int fd) {
+    PendingConnection *pending = malloc(sizeof(PendingConnection));
+    if (!pending) {
+        LOG_ERRNO(LOG_ERROR, "Failed to queue connection");
+        close(fd);
+        return;
+    }
+    pending->fd = fd;
+    pending->next = NULL;
+
+    if (queue->tail) {
+        queue->tail->next = pending;
+    } else {
+        queue->head = pending;
+    }
+    queue->tail = pending;
+    queue->count++;
+}
+
+int pop_pending(PendingQueue *queue) {
+    PendingConnection *pending = queue->head;
+    int fd = pending->fd;
+
+    queue->head = pending->next;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    queue->count--;
+    free(pending);
+    return fd;
+}
+
+void inbox_push(SessionInbox *inbox, PendingPair *pair) {
+    pair->next = NULL;
+
+    pthread_mutex_lock(&inbox->lock);
+    if (inbox->tail) {
+        inbox->tail->next = pair;
+    } else {
+        inbox->head = pair;
+    }
+    inbox->tail = pair;
+    inbox->count++;
+    pthread_mutex_unlock(&inbox->lock);
+}
+
+/* Detaches up to `max` of the oldest pending pairs from the inbox. */
+PendingPair *inbox_take(SessionInbox *inbox, int max, int *taken) {
+    *taken = 0;
+
+    pthread_mutex_lock(&inbox->lock);
+    PendingPair *head = inbox->head;
+    PendingPair *last = NULL;
+    PendingPair *cursor = head;
+    while (cursor && *taken < max) {
+        last = cursor;
+        cursor = cursor->next;
+        (*taken)++;
+    }
+    if (last) {
+        last->next = NULL;
+        inbox->head = cursor;
+        if (!cursor) {
+            inbox->tail = NULL;
+        }
+        inbox->count -= *taken;
+    }
+    pthread_mutex_unlock(&inbox->lock);
+
+    return last ? head : NULL;
+}
+
+void start_pending_sessions(Worker *worker, PendingPair *pairs) {
+    while (pairs) {
+        PendingPair *pair = pairs;
+        pairs = pair->next;
+
+        if (!create_session(worker, pair)) {
+            close_pair(pair);
+            release_session_slot(worker);
+        }
+        free(pair->snapshot);
+        free(pair);
+    }
+}
+
+void wake_acceptor(void) {
+    uint64_t one = 1;
+    if (write(admission_wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to wake the acceptor");
+    }
+}
+
+void start_lobby_player(Worker *worker, int fd) {
+    LobbyPlayer *player = calloc(1, sizeof(LobbyPlayer));
+    if (!player) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to allocate lobby player");
+        close(fd);
+        atomic_fetch_sub(&lobby_connections, 1);
+        return;
+    }
+    player->kind = HANDLE_LOBBY;
+    player->fd = fd;
+
+    /*
+     * Edge-triggered, so a partial binary record left on the socket waits
+     * for the rest of it instead of being reported again and again.
+     */
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = player;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        LOG_ERRNO(LOG_ERROR, "[Server] epoll_ctl() failed to register lobby player");
+        close(fd);
+        free(player);
+        atomic_fetch_sub(&lobby_connections, 1);
+        return;
+    }
+
+    player->next = worker->lobby;
+    if (worker->lobby) {
+        worker->lobby->prev = player;
+    }
+    worker->lobby = player;
+
+    int timeout_ms = config.idle_timeout_ms ? config.idle_timeout_ms : LOBBY_TIMEOUT_MS;
+    timer_schedule(&worker->lobby_deadlines, &player->deadline, worker->now_ns + ms_to_ns(timeout_ms));
+}
+
+/* Takes the player out of this worker's lobby, to be paired or closed. */
+void unlink_lobby_player(Worker *worker, LobbyPlayer *player) {
+    timer_cancel(&worker->lobby_deadlines, &player->deadline);
+    if (player->prev) {
+        player->prev->next = player->next;
+    } else {
+        worker->lobby = player->next;
+    }
+    if (player->next) {
+        player->next->prev = player->prev;
+    }
+}
+
+void close_lobby_player(Worker *worker, LobbyPlayer *player) {
+    unlink_lobby_player(worker, player);
+    close(player->fd);
+    free(player);
+    atomic_fetch_sub(&lobby_connections, 1);
+}
+
+void lobby_deadline_passed(Timer *timer, void *context) {
+    LobbyPlayer *player = (LobbyPlayer *)((char *)timer - offsetof(LobbyPlayer, deadline));
+    LOG(LOG_INFO, "[Server] A player sent no Begin to the lobby in time. Closing it...");
+    close_lobby_player(context, player);
+}
+
+/*
+ * Frames the first request in `peeked` the way the session will when it
+ * reads it, and says how many bytes it takes. A partial binary record
+ * returns 0.
+ */
+static size_t peek_request(char *peeked, size_t length, Packet *packet, WireFormat *format) {
+    if ((uint8_t)peeked[0] & BINARY_FLAG) {
+        size_t size = binary_record_size((uint8_t)peeked[0]);
+        if (length < size) {
+            return 0;
+        }
+        *format = WIRE_BINARY;
+        decode_binary_record((const uint8_t *)peeked, packet);
+        return size;
+    }
+
+    char *newline = memchr(peeked, '\n', length);
+    peeked[length] = '\0';
+    if (!newline) {
+        /* A legacy client's first read is its first packet. */
+        *format = WIRE_LEGACY;
+        scan_packet(peeked, packet);
+        return length;
+    }
+
+    *format = WIRE_TEXT;
+    *newline = '\0';
+    if (newline > peeked && newline[-1] == '\r') {
+        newline[-1] = '\0';
+    }
+    scan_packet(peeked, packet);
+    return newline - peeked + 1;
+}
+
+/*
+ * A Begin sends the player to the matchmaking queue, a Forfeit leaves the
+ * lobby, and anything else gets the "E 100" the Begin phase would give it
+ * and is taken off the socket. Being edge-triggered, it goes on until the
+ * socket is drained or holds only part of a binary record.
+ */
+void handle_lobby_player(Worker *worker, LobbyPlayer *player) {
+    for (;;) {
+        char peeked[BUFFER_SIZE];
+        ssize_t length = recv(player->fd, peeked, sizeof(peeked) - 1, MSG_PEEK);
+        if (length == -1 && errno == EINTR) continue;
+        if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+        Packet packet;
+        WireFormat format;
+        size_t size = length > 0 ? peek_request(peeked, length, &packet, &format) : 0;
+        if (length > 0 && !size) {
+            /* The rest of the record is still to come. */
+            return;
+        }
+
+        if (size && packet.type == PACKET_FORFEIT) {
+            /* Taken off first, so the close is not turned into a reset. */
+            recv(player->fd, peeked, size, 0);
+        }
+        if (length <= 0 || packet.type == PACKET_FORFEIT) {
+            LOG(LOG_INFO, "[Server] A player left the lobby before being paired.");
+            close_lobby_player(worker, player);
+            return;
+        }
+
+        if (packet.type == PACKET_BEGIN) {
+            player->player = packet.bare ? 1 : 0;
+            epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, player->fd, NULL);
+            unlink_lobby_player(worker, player);
+            mpsc_push(&matchmaking, &player->node);
+            wake_acceptor();
+            return;
+        }
+
+        OutputBuffer out = {0};
+        if (recv(player->fd, peeked, size, 0) == (ssize_t)size &&
+            encode_reply(&(Reply){.type = REPLY_ERROR, .value = 100}, format, &out)) {
+            send(player->fd, out.data, out.length, 0);
+        }
+        output_free(&out);
+        metrics_record_error(&worker->metrics, 100);
+    }
+}
+
+PendingConnection *inbox_take_lobby(SessionInbox *inbox) {
+    pthread_mutex_lock(&inbox->lock);
+    PendingConnection *lobby = inbox->lobby;
+    inbox->lobby = NULL;
+    pthread_mutex_unlock(&inbox->lock);
+    return lobby;
+}
+
+PendingSpectator *inbox_take_spectators(SessionInbox *inbox) {
+    pthread_mutex_lock(&inbox->lock);
+    PendingSpectator *spectators = inbox->spectators;
+    inbox->spectators = NULL;
+    pthread_mutex_unlock(&inbox->lock);
+    return spectators;
+}
+
+void start_pending_spectators(Worker *worker, PendingSpectator *spectators) {
+    while (spectators) {
+        PendingSpectator *pending = spectators;
+        spectators = pending->next;
+        start_spectator(worker, pending->fd, pending->session_id);
+        free(pending);
+    }
+}
+
+void wake_worker(Worker *worker) {
+    uint64_t one = 1;
+    if (write(worker->wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to wake worker");
+    }
+}
+
+/*
+ * Called by a worker with nothing to do: take half of the oldest pairs still
+ * queued on the most backed-up other worker, so a hot worker's backlog is
+ * started elsewhere instead of waiting for it.
+ */
+void steal_pending_sessions(Worker *worker) {
+    Worker *victim = NULL;
+    int backlog = 0;
+
+    for (int i = 1; i < worker_count; i++) {
+        Worker *candidate = &workers[(worker->id + i) % worker_count];
+        pthread_mutex_lock(&candidate->inbox.lock);
+        int count = candidate->inbox.count;
+        pthread_mutex_unlock(&candidate->inbox.lock);
+
+        if (count > backlog) {
+            backlog = count;
+            victim = candidate;
+        }
+    }
+
+    if (!victim) {
+        return;
+    }
+
+    int taken;
+    PendingPair *pairs = inbox_take(&victim->inbox, (backlog + 1) / 2, &taken);
+    if (taken > 0) {
+        atomic_fetch_sub(&victim->load, taken);
+        atomic_fetch_add(&worker->load, taken);
+        metric_add(&worker->metrics.sessions_stolen, taken);
+        start_pending_sessions(worker, pairs);
+    }
+}
+
+/* Makes the batch's journal records durable, then lets their replies go. */
+void commit_journal(Worker *worker) {
+    if (!worker->commits) {
+        return;
+    }
+    if (!journal_sync(&worker->journal)) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to sync the journal");
+    }
+
+    while (worker->commits) {
+        Session *session = worker->commits;
+        worker->commits = session->next_commit;
+        session->uncommitted = false;
+        finish_session_cycle(session);
+    }
+}
+
+/*
+ * The timer of the connection a session waits on went off: a throttled
+ * player that has earned a packet is read from again, and one past its turn
+ * or idle deadline forfeits. On a finished session's connection it means
+ * the last replies did not get out within CLOSE_LINGER_MS.
+ */
+void connection_deadline_passed(Timer *timer, void *context) {
+    Connection *conn = (Connection *)((char *)timer - offsetof(Connection, deadline));
+    Session *session = conn->session;
+    Worker *worker = context;
+    uint64_t now = worker->now_ns;
+
+    /* A closed connection's last send is taking too long; fail it. */
+    if (conn->closing) {
+        shutdown(conn->fd, SHUT_RDWR);
+        return;
+    }
+
+    /* Held back for the journal; the commit re-arms its timer. */
+    if (session->uncommitted) {
+        return;
+    }
+
+    if (session->throttled && connection_may_send(session, conn)) {
+        run_buffered_requests(session);
+        finish_session_cycle(session);
+        return;
+    }
+
+    bool turn_over = config.turn_timeout_ms && now >= session->awaited_ns + ms_to_ns(config.turn_timeout_ms);
+    bool idle = config.idle_timeout_ms &&
+                now >= max_ns(conn->input_ns, session->awaited_ns) + ms_to_ns(config.idle_timeout_ms);
+    if (!turn_over && !idle) {
+        schedule_deadline(session);
+        return;
+    }
+
+    if (turn_over) {
+        LOG(LOG_WARN, "[Server] [Session %d] Player %d did not move within %d ms; forfeiting them",
+            session->id, conn->player + 1, config.turn_timeout_ms);
+        metric_add(&worker->metrics.turn_timeouts, 1);
+    } else {
+        LOG(LOG_WARN, "[Server] [Session %d] Player %d sent nothing for %d ms; forfeiting them",
+            session->id, conn->player + 1, config.idle_timeout_ms);
+        metric_add(&worker->metrics.idle_timeouts, 1);
+    }
+    end_awaited_turn(session, conn->player, true);
+    finish_session_cycle(session);
+}
+
+void handle_events(Worker *worker, const struct epoll_event *events, int ready) {
+    for (int i = 0; i < ready; i++) {
+        HandleKind kind = *(HandleKind *)events[i].data.ptr;
+        if (kind == HANDLE_WAKEUP) {
+            uint64_t wakeups;
+            if (read(worker->wake_fd, &wakeups, sizeof(wakeups)) == -1 && errno != EAGAIN) {
+                LOG_ERRNO(LOG_ERROR, "[Server] Failed to read worker wakeup");
+            }
+
+            int taken;
+            start_pending_sessions(worker, inbox_take(&worker->inbox, INT_MAX, &taken));
+            start_pending_spectators(worker, inbox_take_spectators(&worker->inbox));
+            for (PendingConnection *pending = inbox_take_lobby(&worker->inbox), *next; pending; pending = next) {
+                next = pending->next;
+                start_lobby_player(worker, pending->fd);
+                free(pending);
+            }
+        } else if (kind == HANDLE_LOBBY) {
+            handle_lobby_player(worker, events[i].data.ptr);
+        } else if (kind == HANDLE_SPECTATOR) {
+            Spectator *spectator = events[i].data.ptr;
+            if (spectator->fd != -1) {
+                handle_spectator(worker, spectator, events[i].events);
+            }
+        } else {
+            Connection *conn = events[i].data.ptr;
+            Session *session = conn->session;
+            if (session->game.phase == PHASE_OVER) {
+                continue;
+            }
+            /* A side only armed to drain its replies is not read from. */
+            if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && session->game.active == conn->player) {
+                handle_session_readable(session, conn->player);
+            } else {
+                handle_session_writable(session);
+            }
+        }
+    }
+}
+
+/* How long a worker may wait for events before its timers or stealing need it. */
+static int worker_wait_ms(const Worker *worker) {
+    int timeout = worker_count > 1 ? STEAL_INTERVAL_MS : -1;
+    bool timing = worker->timers.pending || worker->lingering.pending || worker->lobby_deadlines.pending;
+    return timing && (timeout == -1 || timeout > TIMER_TICK_MS) ? TIMER_TICK_MS : timeout;
+}
+
+/* Reads the connections queued by queue_readable(), including any queued meanwhile. */
+void run_ready_connections(Worker *worker) {
+    while (worker->ready) {
+        Connection *conn = worker->ready;
+        worker->ready = conn->next_ready;
+        conn->ready = false;
+
+        Session *session = conn->session;
+        if (session->game.phase != PHASE_OVER && !session->uncommitted && session->game.active == conn->player) {
+            handle_session_readable(session, conn->player);
+        }
+    }
+}
+
+void run_epoll_loop(Worker *worker) {
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!atomic_load(&worker->stopping)) {
+        int ready = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, worker_wait_ms(worker));
+        metric_add(&worker->metrics.io_syscalls, 1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            LOG_ERRNO(LOG_ERROR, "[Server] epoll_wait() failed");
+            break;
+        }
+        worker->now_ns = metrics_now_ns();
+
+        if (ready == 0 && worker_count > 1) {
+            steal_pending_sessions(worker);
+        }
+        handle_events(worker, events, ready);
+        run_ready_connections(worker);
+
+        timer_wheel_advance(&worker->timers, worker->now_ns, connection_deadline_passed, worker);
+        timer_wheel_advance(&worker->lingering, worker->now_ns, spectator_linger_passed, worker);
+        timer_wheel_advance(&worker->lobby_deadlines, worker->now_ns, lobby_deadline_passed, worker);
+
+        do {
+            run_ready_connections(worker);
+            commit_journal(worker);
+        } while (worker->ready);
+        free_retired_sessions(worker);
+        free_retired_spectators(worker);
+        metric_add(&worker->metrics.busy_ns, metrics_now_ns() - worker->now_ns);
+    }
+}
+
+/* The worker's epoll instance became readable: handle what it has, all of it. */
+void drain_events(Worker *worker) {
+    struct epoll_event events[MAX_EVENTS];
+    int ready;
+
+    do {
+        ready = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, 0);
+        metric_add(&worker->metrics.io_syscalls, 1);
+        if (ready > 0) {
+            handle_events(worker, events, ready);
+        }
+    } while (ready == MAX_EVENTS);
+}
+
+/*
+ * The io_uring loop: one io_uring_enter() per batch submits every receive,
+ * send and cancel queued by the last batch and waits for the next
+ * completions, so a turn costs no read, send or epoll_ctl() calls of its
+ * own. Spectators, lobby players and wakeups stay on the epoll instance,
+ * which the ring polls.
+ */
+void run_uring_loop(Worker *worker) {
+    Uring *ring = &worker->uring;
+    bool polling = false;
+
+    while (!atomic_load(&worker->stopping)) {
+        if (!polling) {
+            polling = uring_poll_multishot(ring, worker->epoll_fd, uring_data(worker, URING_WAKE));
+            if (!polling) {
+                LOG_ERRNO(LOG_ERROR, "[Server] Failed to poll worker events");
                 break;
             }
-           
-        } else if (strcmp(buffer, "Q") == 0 || strcmp(buffer, "Q\n") == 0) {
-            handle_query_packet(conn_fd, shot_history, opponent_board, sunk_ships);
-           
-        } else if (strcmp(buffer, "F") == 0 || strcmp(buffer, "F\n") == 0) {
-            send(conn_fd, "H 0", strlen("H 0"), 0);
-            char ack[BUFFER_SIZE];
-            recv(conn_fd, ack, BUFFER_SIZE, 0);
-            send(opponent_fd, "H 1", strlen("H 1"), 0);
-            recv(opponent_fd, ack, BUFFER_SIZE, 0);
-            return false; 
+        }
+
+        int ready = uring_wait(ring, worker_wait_ms(worker));
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            LOG_ERRNO(LOG_ERROR, "[Server] io_uring_enter() failed");
+            break;
+        }
+        worker->now_ns = metrics_now_ns();
+
+        if (ready == 0 && worker_count > 1) {
+            steal_pending_sessions(worker);
+        }
+        UringCompletion completion;
+        while (uring_next(ring, &completion)) {
+            void *object = (void *)(uintptr_t)(completion.data & ~(uint64_t)URING_OP_MASK);
+            if (!object) {
+                /* A cancel that found nothing left to cancel. */
+                continue;
+            }
+            switch ((UringOp)(completion.data & URING_OP_MASK)) {
+            case URING_RECV:
+                connection_received(worker, object, &completion);
+                break;
+            case URING_SEND:
+                connection_sent(worker, object, completion.result);
+                break;
+            case URING_WAKE:
+                polling = completion.more;
+                drain_events(worker);
+                break;
+            default:
+                break;
+            }
+        }
+        run_ready_connections(worker);
+
+        timer_wheel_advance(&worker->timers, worker->now_ns, connection_deadline_passed, worker);
+        timer_wheel_advance(&worker->lingering, worker->now_ns, spectator_linger_passed, worker);
+        timer_wheel_advance(&worker->lobby_deadlines, worker->now_ns, lobby_deadline_passed, worker);
+
+        /* Replies released by the commit can let more buffered input be read, and so on. */
+        do {
+            run_ready_connections(worker);
+            commit_journal(worker);
+        } while (worker->ready);
+        free_retired_sessions(worker);
+        free_retired_spectators(worker);
+        metric_add(&worker->metrics.io_syscalls, ring->syscalls);
+        ring->syscalls = 0;
+        metric_add(&worker->metrics.busy_ns, metrics_now_ns() - worker->now_ns);
+    }
+}
+
+/*
+ * Under io_uring a session can only be handed off once the kernel is done
+ * with its connections. Receives are cancelled, keeping what they already
+ * brought in, and sends too, leaving what they had not sent in `sending`;
+ * their completions get up to CLOSE_LINGER_MS to arrive.
+ */
+void quiesce_connections(Worker *worker) {
+    Uring *ring = &worker->uring;
+    uint64_t deadline = metrics_now_ns() + ms_to_ns(CLOSE_LINGER_MS);
+    bool busy = false;
+
+    worker->quiescing = true;
+    for (Session *session = worker->sessions; session; session = session->next) {
+        for (int p = 0; p < 2; p++) {
+            Connection *conn = &session->players[p];
+            if (conn->receiving && !conn->recv_cancelled) {
+                conn->recv_cancelled = uring_cancel(ring, uring_data(conn, URING_RECV));
+            }
+            if (conn->send_armed) {
+                uring_cancel(ring, uring_data(conn, URING_SEND));
+            }
+            busy = busy || connection_busy(conn);
+        }
+    }
+
+    while (busy && metrics_now_ns() < deadline) {
+        if (uring_wait(ring, TIMER_TICK_MS) == -1 && errno != EINTR) {
+            LOG_ERRNO(LOG_ERROR, "[Server] io_uring_enter() failed");
+            break;
+        }
+        worker->now_ns = metrics_now_ns();
+        UringCompletion completion;
+        while (uring_next(ring, &completion)) {
+            void *object = (void *)(uintptr_t)(completion.data & ~(uint64_t)URING_OP_MASK);
+            if (!object) {
+                continue;
+            }
+            if ((completion.data & URING_OP_MASK) == URING_RECV) {
+                connection_received(worker, object, &completion);
+            } else if ((completion.data & URING_OP_MASK) == URING_SEND) {
+                connection_sent(worker, object, completion.result);
+            }
+        }
+
+        busy = false;
+        for (Session *session = worker->sessions; session && !busy; session = session->next) {
+            busy = connection_busy(&session->players[0]) || connection_busy(&session->players[1]);
+        }
+    }
+    if (busy) {
+        LOG(LOG_WARN, "[Server] Worker %d still has I/O in flight; handing its sessions off anyway", worker->id);
+    }
+}
+
+/*
+ * Passes what this worker holds for players to the server taking over rather
+ * than closing it: its sessions with their snapshots, the pairs and lobby
+ * players still in its inbox and its lobby. Spectators are closed as they
+ * are on shutdown and may watch again from the new server. If the new server
+ * goes away part-way, what is left is closed as on shutdown.
+ */
+void hand_off_sessions(Worker *worker) {
+    while (worker->spectators) {
+        close_spectator(worker, worker->spectators);
+    }
+    if (worker->uring_enabled) {
+        quiesce_connections(worker);
+    }
+
+    int taken;
+    PendingPair *pairs = inbox_take(&worker->inbox, INT_MAX, &taken);
+    PendingConnection *lobby = inbox_take_lobby(&worker->inbox);
+    OutputBuffer snapshot = {0};
+    int sessions = 0;
+
+    pthread_mutex_lock(&handoff_lock);
+    for (Session *session = worker->sessions; session; session = session->next) {
+        int fds[2] = {session->players[0].fd, session->players[1].fd};
+        snapshot.length = 0;
+        if (snapshot_session(session, &snapshot)) {
+            handoff_write(handoff, HANDOFF_SESSION, snapshot.data, snapshot.length, fds, session->ai ? 1 : 2);
+            sessions++;
+        } else {
+            LOG(LOG_ERROR, "[Server] [Session %d] Failed to snapshot; it ends here", session->id);
+        }
+    }
+    /* Sessions taken over from the last server may still be waiting to start. */
+    for (PendingPair *pair = pairs; pair; pair = pair->next) {
+        if (pair->snapshot) {
+            handoff_write(handoff, HANDOFF_SESSION, pair->snapshot, pair->snapshot_length, pair->fds,
+                          pair_fd_count(pair));
         } else {
-            send(conn_fd, "E 102", strlen("E 102"), 0);
+            handoff_write(handoff, HANDOFF_PAIR, NULL, 0, pair->fds, pair_fd_count(pair));
+        }
+    }
+    for (PendingConnection *pending = lobby; pending; pending = pending->next) {
+        handoff_write(handoff, HANDOFF_LOBBY, NULL, 0, &pending->fd, 1);
+    }
+    for (LobbyPlayer *player = worker->lobby; player; player = player->next) {
+        handoff_write(handoff, HANDOFF_LOBBY, NULL, 0, &player->fd, 1);
+    }
+    bool sent = handoff_flush(handoff);
+    pthread_mutex_unlock(&handoff_lock);
+    output_free(&snapshot);
+
+    if (!sent) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to hand sessions off to the new server");
+    }
+    LOG(LOG_INFO, "[Server] Worker %d handed off %d sessions.", worker->id, sent ? sessions : 0);
+
+    /* Our copies of what was sent are closed; the new server holds its own. */
+    for (Session *session = worker->sessions, *next; sent && session; session = next) {
+        next = session->next;
+        directory_remove(session);
+        for (int p = 0; p < 2; p++) {
+            timer_cancel(&worker->timers, &session->players[p].deadline);
+            if (!played_by_ai(session, p)) {
+                close(session->players[p].fd);
+            }
+            session->players[p].fd = -1;
+        }
+        game_release(&session->game);
+        release_session_slot(worker);
+        worker->sessions = next;
+        session->next_retired = worker->retired;
+        worker->retired = session;
+    }
+    while (pairs) {
+        PendingPair *pair = pairs;
+        pairs = pair->next;
+        close_pair(pair);
+        release_session_slot(worker);
+        free(pair->snapshot);
+        free(pair);
+    }
+    for (PendingConnection *next; lobby; lobby = next) {
+        next = lobby->next;
+        close(lobby->fd);
+        atomic_fetch_sub(&lobby_connections, 1);
+        free(lobby);
+    }
+    while (sent && worker->lobby) {
+        close_lobby_player(worker, worker->lobby);
+    }
+}
+
+void *worker_main(void *arg) {
+    Worker *worker = arg;
+
+    log_register_thread();
+    clock_gettime(CLOCK_MONOTONIC, &worker->started_at);
+    worker->now_ns = metrics_now_ns();
+    timer_wheel_init(&worker->timers, worker->now_ns);
+    timer_wheel_init(&worker->lingering, worker->now_ns);
+    timer_wheel_init(&worker->lobby_deadlines, worker->now_ns);
+
+    /* The ring is set up here, as it only accepts requests from this thread. */
+    if (config.io_backend == IO_BACKEND_URING) {
+        worker->uring_enabled = uring_init(&worker->uring, URING_ENTRIES, URING_BUFFERS, URING_BUFFER_SIZE);
+        if (!worker->uring_enabled) {
+            LOG_ERRNO(LOG_WARN, "[Server] io_uring is unavailable; falling back to epoll");
+        }
+    }
+    if (worker->uring_enabled) {
+        run_uring_loop(worker);
+    } else {
+        run_epoll_loop(worker);
+    }
+
+    if (handoff) {
+        hand_off_sessions(worker);
+    }
+    while (worker->sessions) {
+        destroy_session(worker->sessions);
+    }
+    while (worker->spectators) {
+        close_spectator(worker, worker->spectators);
+    }
+    while (worker->lobby) {
+        close_lobby_player(worker, worker->lobby);
+    }
+    /* Closing the ring cancels whatever the sessions still had in flight. */
+    if (worker->uring_enabled) {
+        uring_free(&worker->uring);
+        worker->uring_enabled = false;
+    }
+    free_retired_sessions(worker);
+    free_retired_spectators(worker);
+    arena_pool_clear(&worker->arena_pool);
+
+    int taken;
+    PendingPair *pairs = inbox_take(&worker->inbox, INT_MAX, &taken);
+    while (pairs) {
+        PendingPair *pair = pairs;
+        pairs = pair->next;
+        close_pair(pair);
+        release_session_slot(worker);
+        free(pair->snapshot);
+        free(pair);
+    }
+    PendingSpectator *spectators = inbox_take_spectators(&worker->inbox);
+    while (spectators) {
+        PendingSpectator *pending = spectators;
+        spectators = pending->next;
+        close(pending->fd);
+        free(pending);
+    }
+    for (PendingConnection *pending = inbox_take_lobby(&worker->inbox), *next; pending; pending = next) {
+        next = pending->next;
+        close(pending->fd);
+        atomic_fetch_sub(&lobby_connections, 1);
+        free(pending);
+    }
+
+    return NULL;
+}
+
+void start_workers(int count) {
+    workers = aligned_alloc(alignof(Worker), count * sizeof(Worker));
+    if (!workers) {
+        perror("Failed to allocate workers");
+        exit(EXIT_FAILURE);
+    }
+    memset(workers, 0, count * sizeof(Worker));
+    worker_count = count;
+
+    for (int i = 0; i < count; i++) {
+        Worker *worker = &workers[i];
+        worker->kind = HANDLE_WAKEUP;
+        worker->id = i;
+        pthread_mutex_init(&worker->inbox.lock, NULL);
+
+        worker->epoll_fd = epoll_create1(0);
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK);
+        if (worker->epoll_fd == -1 || worker->wake_fd == -1) {
+            perror("[Server] Failed to create worker event loop");
+            exit(EXIT_FAILURE);
+        }
+
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.ptr = worker;
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &event) == -1) {
+            perror("[Server] epoll_ctl() failed to register worker wakeup");
+            exit(EXIT_FAILURE);
+        }
+
+        if (config.journal_dir) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/worker-%d.journal", config.journal_dir, i);
+            if (!journal_open(&worker->journal, path)) {
+                perror("[Server] Failed to open journal");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    /* Workers leave SIGINT/SIGTERM to the acceptor thread. */
+    sigset_t blocked, previous;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            fprintf(stderr, "[Server] Failed to start worker %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    printf("[Server] Started %d worker thread%s.\n", count, count == 1 ? "" : "s");
+}
+
+/*
+ * Reads every worker journal the last run left, keeps the games that were
+ * still in play and rewrites them as the whole of worker 0's journal, so the
+ * files only ever hold live games and those of the current run. The rewrite
+ * lands by rename(); a crash part-way leaves records that load as duplicates.
+ */
+void recover_journal(void) {
+    if (mkdir(config.journal_dir, 0755) == -1 && errno != EEXIST) {
+        perror("[Server] Failed to create journal directory");
+        exit(EXIT_FAILURE);
+    }
+
+    char pattern[PATH_MAX];
+    snprintf(pattern, sizeof(pattern), "%s/worker-*.journal", config.journal_dir);
+    glob_t found = {0};
+    if (glob(pattern, 0, NULL, &found) != 0) {
+        globfree(&found);
+        return;
+    }
+
+    JournalSet loaded;
+    if (!journal_load(&loaded, found.gl_pathv, (int)found.gl_pathc)) {
+        perror("[Server] Failed to read journal");
+        exit(EXIT_FAILURE);
+    }
+    if ((int)loaded.highest_id >= next_session_id) {
+        next_session_id = (int)loaded.highest_id + 1;
+    }
+
+    ArenaPool pool = {0};
+    recovered.sessions = calloc(loaded.count ? loaded.count : 1, sizeof(JournalSession));
+    recovered_claimed = calloc(loaded.count ? loaded.count : 1, sizeof(bool));
+    if (!recovered.sessions || !recovered_claimed) {
+        perror("[Server] Failed to allocate recovered games");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < loaded.count; i++) {
+        JournalSession *saved = &loaded.sessions[i];
+        if (saved->closed) {
+            continue;
         }
+
+        Game game;
+        game_init(&game, config.board_kind, &pool);
+        int mismatches = journal_replay(saved, &game, NULL, NULL);
+        bool in_play = game.phase != PHASE_OVER && mismatches == 0;
+        game_release(&game);
+
+        if (mismatches) {
+            fprintf(stderr, "[Server] [Session %u] Journal does not replay cleanly; dropping it\n", saved->id);
+        }
+        if (in_play) {
+            recovered.sessions[recovered.count++] = *saved;
+            saved->entries = NULL;
+        }
+    }
+    arena_pool_clear(&pool);
+    recovered.highest_id = loaded.highest_id;
+    journal_set_free(&loaded);
+
+    char compacted[PATH_MAX];
+    char target[PATH_MAX];
+    snprintf(compacted, sizeof(compacted), "%s/worker-0.journal.tmp", config.journal_dir);
+    snprintf(target, sizeof(target), "%s/worker-0.journal", config.journal_dir);
+    unlink(compacted);
+
+    Journal journal;
+    bool written = journal_open(&journal, compacted) &&
+                   journal_mark(&journal, JOURNAL_WATERMARK, recovered.highest_id, 0);
+    for (size_t i = 0; written && i < recovered.count; i++) {
+        for (size_t j = 0; written && j < recovered.sessions[i].count; j++) {
+            written = journal_append_entry(&journal, &recovered.sessions[i].entries[j]);
+        }
+    }
+    written = written && journal_sync(&journal) && rename(compacted, target) == 0;
+    journal_close(&journal);
+    if (!written) {
+        perror("[Server] Failed to rewrite journal");
+        exit(EXIT_FAILURE);
     }
-    return true; 
+
+    for (size_t i = 0; i < found.gl_pathc; i++) {
+        if (strcmp(found.gl_pathv[i], target) != 0) {
+            unlink(found.gl_pathv[i]);
+        }
+    }
+    globfree(&found);
+
+    printf("[Server] Recovered %zu unfinished game%s from the journal.\n",
+           recovered.count, recovered.count == 1 ? "" : "s");
 }
 
+void stop_workers(void) {
+    for (int i = 0; i < worker_count; i++) {
+        atomic_store(&workers[i].stopping, true);
+        wake_worker(&workers[i]);
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    /* Every ring is quiet now; the summary below is written directly. */
+    log_stop();
 
-void game_session(int player1ConnectionFd, int player2ConnectionFd) {
-    int boardWidth, boardHeight;
+    for (int i = 0; i < worker_count; i++) {
+        Worker *worker = &workers[i];
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - worker->started_at.tv_sec) +
+                         (now.tv_nsec - worker->started_at.tv_nsec) / 1e9;
 
-    printf("[Server] Awaiting 'Begin' packet from Player 1...\n");
-    if (!wait_for_begin_packet(player1ConnectionFd, &boardWidth, &boardHeight, player2ConnectionFd, true)) return;
+        Metrics *metrics = &worker->metrics;
+        uint64_t packets = 0;
+        for (int type = 0; type < METRICS_PACKET_KINDS; type++) {
+            packets += metric_read(&metrics->packets[type]);
+        }
+        uint64_t turns = metric_read(&metrics->turns);
+
+        printf("[Server] Worker %d: %llu sessions (%llu stolen), %llu packets, %llu turns, %.1f turns/sec\n",
+               worker->id, (unsigned long long)metric_read(&metrics->sessions_started),
+               (unsigned long long)metric_read(&metrics->sessions_stolen), (unsigned long long)packets,
+               (unsigned long long)turns, elapsed > 0 ? turns / elapsed : 0.0);
+
+        close(worker->epoll_fd);
+        close(worker->wake_fd);
+        pthread_mutex_destroy(&worker->inbox.lock);
+        journal_close(&worker->journal);
+    }
+
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+}
+
+/*
+ * Hands the pair to the worker with the fewest sessions, counting the pairs
+ * still in its inbox, so a worker running hot is passed over until the others
+ * catch up; ties go round-robin. A session taken over in a hot restart keeps
+ * the id it had.
+ */
+void dispatch_session(PendingPair *pair) {
+    static int next_worker = 0;
+
+    if (!pair->snapshot) {
+        pair->id = next_session_id++;
+    }
+    atomic_fetch_add(&live_sessions, 1);
+
+    Worker *worker = NULL;
+    int lightest = INT_MAX;
+    for (int i = 0; i < worker_count; i++) {
+        Worker *candidate = &workers[(next_worker + i) % worker_count];
+        int load = atomic_load(&candidate->load);
+        if (load < lightest) {
+            lightest = load;
+            worker = candidate;
+        }
+    }
+    next_worker = (worker->id + 1) % worker_count;
+    atomic_fetch_add(&worker->load, 1);
+
+    inbox_push(&worker->inbox, pair);
+    wake_worker(worker);
+}
 
-    printf("[Server] Awaiting 'Begin' packet from Player 2...\n");
-    if (!wait_for_begin_packet(player2ConnectionFd, &boardWidth, &boardHeight, player1ConnectionFd, false)) return;
+static long resident_mb(void) {
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        if (fscanf(statm, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024) / 1024;
+}
 
-    Board *player1Board = create_board(boardWidth, boardHeight);
-    Board *player2Board = create_board(boardWidth, boardHeight);
+/* Whether resident memory or the workers' share of CPU time is over budget. */
+bool over_budget(Admission *admission) {
+    if (!config.max_memory_mb && !config.max_cpu_percent) {
+        return false;
+    }
 
-    char **player1ShotHistory = initialize_shot_history(boardWidth, boardHeight);
-    char **player2ShotHistory = initialize_shot_history(boardWidth, boardHeight);
+    uint64_t now = metrics_now_ns();
+    if (now - admission->sampled_ns < ADMISSION_RETRY_MS * 1000000ull) {
+        return admission->over_budget;
+    }
 
-    bool player1SunkShips[MAX_SHIPS] = {false};
-    bool player2SunkShips[MAX_SHIPS] = {false};
+    uint64_t busy = 0;
+    for (int i = 0; i < worker_count; i++) {
+        busy += metric_read(&workers[i].metrics.busy_ns);
+    }
+    double cpu_percent = (busy - admission->busy_ns) * 100.0 / ((now - admission->sampled_ns) * (double)worker_count);
 
-    printf("[Server] Awaiting 'Initialize' packet from Player 1...\n");
-    wait_for_initialize_packet(player1ConnectionFd, player1Board, player2ConnectionFd);
+    admission->over_budget = (config.max_memory_mb && resident_mb() > config.max_memory_mb) ||
+                             (config.max_cpu_percent && cpu_percent > config.max_cpu_percent);
+    admission->sampled_ns = now;
+    admission->busy_ns = busy;
+    return admission->over_budget;
+}
 
-    printf("[Server] Awaiting 'Initialize' packet from Player 2...\n");
-    wait_for_initialize_packet(player2ConnectionFd, player2Board, player1ConnectionFd);
+bool admission_open(Admission *admission) {
+    return (!config.max_sessions || atomic_load(&live_sessions) < config.max_sessions) &&
+           !over_budget(admission);
+}
 
-    printf("[Server] Both players have initialized their boards. Game starting...\n");
+/* Starts as many waiting pairs as the limits now allow. */
+void admit_waiting(Admission *admission) {
+    while (admission->head && admission_open(admission)) {
+        PendingPair *pair = admission->head;
+        admission->head = pair->next;
+        if (!admission->head) {
+            admission->tail = NULL;
+        }
+        admission->count--;
+        dispatch_session(pair);
+    }
+    metric_set(&admission_metrics.sessions_waiting, admission->count);
+}
 
-    bool isGameActive = true;
-    while (isGameActive) {
-        printf("[Server] Player 1's turn...\n");
-        isGameActive = process_turn(player1ConnectionFd, player2Board, player1ShotHistory, player2SunkShips, player2ConnectionFd);
-        if (!isGameActive) break;
+/*
+ * A new pair starts straight away if nobody is waiting ahead of it and the
+ * server is within its limits, waits if there is room to, and is otherwise
+ * turned away so the games already running keep their pace.
+ */
+void admit_pair(Admission *admission, int player1ConnectionFd, int player2ConnectionFd) {
+    PendingPair *pair = malloc(sizeof(PendingPair));
+    if (!pair) {
+        LOG_ERRNO(LOG_ERROR, "Failed to queue session");
+        close(player1ConnectionFd);
+        if (player2ConnectionFd != -1) {
+            close(player2ConnectionFd);
+        }
+        return;
+    }
+    pair->fds[0] = player1ConnectionFd;
+    pair->fds[1] = player2ConnectionFd;
+    pair->snapshot = NULL;
+    pair->next = NULL;
 
-        printf("[Server] Player 2's turn...\n");
-        isGameActive = process_turn(player2ConnectionFd, player1Board, player2ShotHistory, player1SunkShips, player1ConnectionFd);
+    if (!admission->head && admission_open(admission)) {
+        dispatch_session(pair);
+        return;
     }
 
-    printf("[Server] Game over. Cleaning up resources...\n");
+    if (admission->count < config.max_waiting) {
+        if (admission->tail) {
+            admission->tail->next = pair;
+        } else {
+            admission->head = pair;
+        }
+        admission->tail = pair;
+        admission->count++;
+        metric_add(&admission_metrics.sessions_queued, 1);
+        metric_set(&admission_metrics.sessions_waiting, admission->count);
+        return;
+    }
 
-    free_board(player1Board);
-    free_board(player2Board);
-    free_shot_history(player1ShotHistory, boardHeight);
-    free_shot_history(player2ShotHistory, boardHeight);
+    LOG(LOG_WARN, "[Server] Over capacity with %d pairs waiting; turning away a new pair", admission->count);
+    metric_add(&admission_metrics.sessions_shed, 1);
+    close_pair(pair);
+    free(pair);
 }
 
 int setup_socket(int port) {
@@ -665,7 +3097,7 @@ int setup_socket(int port) {
     struct sockaddr_in address;
     int opt = 1;
 
-    if ((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    if ((listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1) {
         perror("[Server] socket() failed");
         exit(EXIT_FAILURE);
     }
@@ -687,7 +3119,7 @@ int setup_socket(int port) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(listen_fd, 1) == -1) {
+    if (listen(listen_fd, config.listen_backlog) == -1) {
         perror("[Server] listen() failed");
         close(listen_fd);
         exit(EXIT_FAILURE);
@@ -697,37 +3129,739 @@ int setup_socket(int port) {
     return listen_fd;
 }
 
-int accept_connection(int listen_fd, const char *player_name) {
-    int conn_fd;
-    struct sockaddr_in client_address;
-    socklen_t addrlen = sizeof(client_address);
+/*
+ * The metrics endpoint only listens on loopback. Failing to open it is not
+ * fatal: the server just runs without one.
+ */
+int setup_metrics_socket(int port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int opt = 1;
+    struct sockaddr_in address = {0};
 
-    if ((conn_fd = accept(listen_fd, (struct sockaddr *)&client_address, &addrlen)) == -1) {
-        perror("[Server] accept() failed");
-        close(listen_fd);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (listen_fd == -1 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1 ||
+        bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(listen_fd, 16) == -1) {
+        perror("[Server] Metrics endpoint disabled");
+        if (listen_fd != -1) {
+            close(listen_fd);
+        }
+        return -1;
+    }
+
+    printf("[Server] Metrics on 127.0.0.1:%d\n", port);
+    return listen_fd;
+}
+
+/*
+ * Spectators may watch from anywhere, so unlike metrics this port is open on
+ * every interface. Failing to open it is not fatal either.
+ */
+int setup_spectator_socket(int port) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int opt = 1;
+    struct sockaddr_in address = {0};
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (listen_fd == -1 ||
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1 ||
+        bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(listen_fd, config.listen_backlog) == -1) {
+        perror("[Server] Spectator port disabled");
+        if (listen_fd != -1) {
+            close(listen_fd);
+        }
+        return -1;
+    }
+
+    printf("[Server] Spectators on port %d\n", port);
+    return listen_fd;
+}
+
+/* Spectators are spread over the workers; the one that reads a request passes it to the session's. */
+void accept_spectators(Listener *listener) {
+    static int next_worker = 0;
+
+    while (true) {
+        int conn_fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK);
+        if (conn_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO(LOG_ERROR, "[Server] accept() failed on spectator port");
+            }
+            return;
+        }
+
+        int nodelay = 1;
+        setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        PendingSpectator *pending = malloc(sizeof(PendingSpectator));
+        if (!pending) {
+            LOG_ERRNO(LOG_ERROR, "Failed to queue spectator");
+            close(conn_fd);
+            continue;
+        }
+        pending->fd = conn_fd;
+        pending->session_id = 0;
+        spectator_inbox_push(&workers[next_worker], pending);
+        next_worker = (next_worker + 1) % worker_count;
+    }
+}
+
+/* Each connection gets one plaintext snapshot summed over all workers, then EOF. */
+void serve_metrics(Listener *listener) {
+    static char reply[METRICS_REPLY_MAX];
+    Metrics *per_worker[worker_count];
+
+    for (int i = 0; i < worker_count; i++) {
+        per_worker[i] = &workers[i].metrics;
+    }
+
+    while (true) {
+        int conn_fd = accept(listener->fd, NULL, NULL);
+        if (conn_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO(LOG_ERROR, "[Server] accept() failed on metrics endpoint");
+            }
+            return;
+        }
+
+        /* A reader that stalls must not hold up pairing players for long. */
+        struct timeval timeout = {0, 100000};
+        setsockopt(conn_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        size_t length = metrics_format(per_worker, worker_count, &admission_metrics, reply, sizeof(reply));
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t written = send(conn_fd, reply + sent, length - sent, 0);
+            if (written <= 0) {
+                break;
+            }
+            sent += written;
+        }
+        close(conn_fd);
+    }
+}
+
+/* Player connections open now: in a session, waiting for one, unpaired or in the lobby. */
+int open_connections(const Admission *admission, const PendingQueue pending[2]) {
+    return 2 * (atomic_load(&live_sessions) + admission->count) + pending[0].count + pending[1].count +
+           atomic_load(&lobby_connections);
+}
+
+void pair_players(PendingQueue pending[2], Admission *admission) {
+    while (pending[0].head && pending[1].head) {
+        int player1ConnectionFd = pop_pending(&pending[0]);
+        int player2ConnectionFd = pop_pending(&pending[1]);
+        admit_pair(admission, player1ConnectionFd, player2ConnectionFd);
+    }
+}
+
+/* Moves the players the workers have found roles for onto the pending queues. */
+void take_matchmaking(PendingQueue pending[2], Admission *admission) {
+    MpscNode *node;
+    while ((node = mpsc_pop(&matchmaking))) {
+        LobbyPlayer *player = (LobbyPlayer *)((char *)node - offsetof(LobbyPlayer, node));
+        LOG(LOG_INFO, "[Server] Player %d connected through the lobby!", player->player + 1);
+        push_pending(&pending[player->player], player->fd);
+        atomic_fetch_sub(&lobby_connections, 1);
+        free(player);
+    }
+    pair_players(pending, admission);
+}
+
+/* Lobby players are spread over the workers, which find out their roles. */
+void queue_lobby_player(int fd) {
+    static int next_worker = 0;
+
+    PendingConnection *lobby = malloc(sizeof(PendingConnection));
+    if (!lobby) {
+        LOG_ERRNO(LOG_ERROR, "Failed to queue lobby player");
+        close(fd);
+        return;
+    }
+    lobby->fd = fd;
+    atomic_fetch_add(&lobby_connections, 1);
+
+    Worker *worker = &workers[next_worker];
+    next_worker = (next_worker + 1) % worker_count;
+    pthread_mutex_lock(&worker->inbox.lock);
+    lobby->next = worker->inbox.lobby;
+    worker->inbox.lobby = lobby;
+    pthread_mutex_unlock(&worker->inbox.lock);
+    wake_worker(worker);
+}
+
+void accept_lobby_players(Listener *listener, PendingQueue pending[2], Admission *admission) {
+    while (true) {
+        int conn_fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK);
+        if (conn_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO(LOG_ERROR, "[Server] accept() failed on lobby port");
+            }
+            return;
+        }
+
+        int nodelay = 1;
+        setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        if (config.max_connections && open_connections(admission, pending) >= config.max_connections) {
+            LOG(LOG_WARN, "[Server] Connection limit of %d reached; refusing a lobby player", config.max_connections);
+            metric_add(&admission_metrics.connections_refused, 1);
+            close(conn_fd);
+            continue;
+        }
+        queue_lobby_player(conn_fd);
+    }
+}
+
+/* A player on the AI port has its opponent already, so its game starts as soon as admission allows. */
+void accept_ai_players(Listener *listener, PendingQueue pending[2], Admission *admission) {
+    while (true) {
+        int conn_fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK);
+        if (conn_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO(LOG_ERROR, "[Server] accept() failed on AI port");
+            }
+            return;
+        }
+
+        int nodelay = 1;
+        setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        if (config.max_connections && open_connections(admission, pending) >= config.max_connections) {
+            LOG(LOG_WARN, "[Server] Connection limit of %d reached; refusing a player for the AI", config.max_connections);
+            metric_add(&admission_metrics.connections_refused, 1);
+            close(conn_fd);
+            continue;
+        }
+
+        LOG(LOG_INFO, "[Server] Player 1 connected to play the AI!");
+        admit_pair(admission, conn_fd, -1);
+    }
+}
+
+void accept_connections(Listener *listener, PendingQueue pending[2], Admission *admission) {
+    while (true) {
+        struct sockaddr_in client_address;
+        socklen_t addrlen = sizeof(client_address);
+
+        int conn_fd = accept4(listener->fd, (struct sockaddr *)&client_address, &addrlen, SOCK_NONBLOCK);
+        if (conn_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERRNO(LOG_ERROR, "[Server] accept() failed");
+            }
+            return;
+        }
+
+        /*
+         * Replies are already batched into one send per event; Nagle would
+         * only hold back a halt that follows an unacknowledged reply.
+         */
+        int nodelay = 1;
+        setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        if (config.max_connections && open_connections(admission, pending) >= config.max_connections) {
+            LOG(LOG_WARN, "[Server] Connection limit of %d reached; refusing Player %d",
+                config.max_connections, listener->player + 1);
+            metric_add(&admission_metrics.connections_refused, 1);
+            close(conn_fd);
+            continue;
+        }
+
+        LOG(LOG_INFO, "[Server] Player %d connected!", listener->player + 1);
+        push_pending(&pending[listener->player], conn_fd);
+        pair_players(pending, admission);
+    }
+}
+
+/*
+ * A restarted server connected to take over. It is sent the listening
+ * sockets and the players waiting here, and the acceptor stops; each worker
+ * then hands its own sessions off as it stops and main() ends the stream.
+ * If even this first part cannot be sent, this server carries on.
+ */
+bool begin_handoff(Listener *listener, const Listener *listeners, int count, PendingQueue pending[2],
+                   Admission *admission) {
+    int fd = accept4(listener->fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd == -1) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LOG_ERRNO(LOG_ERROR, "[Server] accept() failed on the handoff socket");
+        }
+        return false;
+    }
+    HandoffWriter *writer = malloc(sizeof(HandoffWriter));
+    if (!writer) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to start a handoff");
+        close(fd);
+        return false;
+    }
+    handoff_writer_init(writer, fd);
+    LOG(LOG_INFO, "[Server] A new server is taking over; handing off...");
+
+    for (int i = 0; i < count; i++) {
+        uint8_t which;
+        if (listeners[i].fd == -1) {
+            continue;
+        } else if (listeners[i].kind == HANDLE_LISTENER) {
+            which = listeners[i].player == 0 ? HANDOFF_LISTENER_PLAYER1 : HANDOFF_LISTENER_PLAYER2;
+        } else if (listeners[i].kind == HANDLE_LOBBY_LISTENER) {
+            which = HANDOFF_LISTENER_LOBBY;
+        } else if (listeners[i].kind == HANDLE_METRICS) {
+            which = HANDOFF_LISTENER_METRICS;
+        } else if (listeners[i].kind == HANDLE_SPECTATOR_LISTENER) {
+            which = HANDOFF_LISTENER_SPECTATOR;
+        } else if (listeners[i].kind == HANDLE_AI_LISTENER) {
+            which = HANDOFF_LISTENER_AI;
+        } else {
+            continue;
+        }
+        handoff_write(writer, HANDOFF_LISTENER, &which, sizeof(which), &listeners[i].fd, 1);
+    }
+    for (PendingPair *pair = admission->head; pair; pair = pair->next) {
+        handoff_write(writer, HANDOFF_PAIR, NULL, 0, pair->fds, pair_fd_count(pair));
+    }
+    for (int p = 0; p < 2; p++) {
+        uint8_t role = (uint8_t)p;
+        for (PendingConnection *waiting = pending[p].head; waiting; waiting = waiting->next) {
+            handoff_write(writer, HANDOFF_PLAYER, &role, sizeof(role), &waiting->fd, 1);
+        }
+    }
+    if (!handoff_flush(writer)) {
+        LOG_ERRNO(LOG_ERROR, "[Server] Failed to hand off to the new server; carrying on");
+        close(fd);
+        free(writer);
+        return false;
+    }
+
+    /* Our copies of the waiting players go; the new server holds its own. */
+    while (admission->head) {
+        PendingPair *pair = admission->head;
+        admission->head = pair->next;
+        close_pair(pair);
+        free(pair);
+    }
+    admission->tail = NULL;
+    admission->count = 0;
+    for (int p = 0; p < 2; p++) {
+        while (pending[p].head) {
+            close(pop_pending(&pending[p]));
+        }
+    }
+    handoff = writer;
+    return true;
+}
+
+/* Sends what is left once the workers have stopped, then the end of the stream. */
+void finish_handoff(void) {
+    uint32_t next_id = (uint32_t)next_session_id;
+    PendingQueue matched = {NULL, NULL, 0};
+
+    for (MpscNode *node; (node = mpsc_pop(&matchmaking));) {
+        LobbyPlayer *player = (LobbyPlayer *)((char *)node - offsetof(LobbyPlayer, node));
+        uint8_t role = (uint8_t)player->player;
+        handoff_write(handoff, HANDOFF_PLAYER, &role, sizeof(role), &player->fd, 1);
+        push_pending(&matched, player->fd);
+        free(player);
+    }
+    handoff_write(handoff, HANDOFF_END, &next_id, sizeof(next_id), NULL, 0);
+    if (handoff_flush(handoff)) {
+        printf("[Server] Handed off to the new server.\n");
+    } else {
+        perror("[Server] Handoff to the new server was cut short");
+    }
+
+    while (matched.head) {
+        close(pop_pending(&matched));
+    }
+    close(handoff->fd);
+    free(handoff);
+    handoff = NULL;
+}
+
+/*
+ * `takeover` holds the pairs and players a hot restart took over, which join
+ * the queues here before anything new is accepted.
+ */
+void run_acceptor(int listen_fd1, int listen_fd2, int lobby_fd, int ai_fd, int metrics_fd, int spectator_fd,
+                  int handoff_fd, Takeover *takeover) {
+    int epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        perror("[Server] epoll_create1() failed");
+        exit(EXIT_FAILURE);
+    }
+
+    admission_wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (admission_wake_fd == -1) {
+        perror("[Server] Failed to create acceptor wakeup");
+        exit(EXIT_FAILURE);
+    }
+
+    Listener listeners[8] = {
+        {HANDLE_LISTENER, listen_fd1, 0},
+        {HANDLE_LISTENER, listen_fd2, 1},
+        {HANDLE_LOBBY_LISTENER, lobby_fd, -1},
+        {HANDLE_AI_LISTENER, ai_fd, 0},
+        {HANDLE_WAKEUP, admission_wake_fd, -1},
+        {HANDLE_METRICS, metrics_fd, -1},
+        {HANDLE_SPECTATOR_LISTENER, spectator_fd, -1},
+        {HANDLE_HANDOFF, handoff_fd, -1}
+    };
+    PendingQueue pending[2] = {takeover->players[0], takeover->players[1]};
+    Admission admission = {.sampled_ns = metrics_now_ns()};
+
+    while (takeover->pairs) {
+        PendingPair *pair = takeover->pairs;
+        takeover->pairs = pair->next;
+        admit_pair(&admission, pair->fds[0], pair->fds[1]);
+        free(pair);
+    }
+    pair_players(pending, &admission);
+
+    for (int i = 0; i < 8; i++) {
+        if (listeners[i].fd == -1) {
+            continue;
+        }
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.ptr = &listeners[i];
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listeners[i].fd, &event) == -1) {
+            perror("[Server] epoll_ctl() failed to register listener");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!shutdown_requested) {
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, admission.head ? ADMISSION_RETRY_MS : -1);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            perror("[Server] epoll_wait() failed");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < ready; i++) {
+            Listener *listener = events[i].data.ptr;
+            if (listener->kind == HANDLE_METRICS) {
+                serve_metrics(listener);
+            } else if (listener->kind == HANDLE_SPECTATOR_LISTENER) {
+                accept_spectators(listener);
+            } else if (listener->kind == HANDLE_WAKEUP) {
+                uint64_t wakeups;
+                if (read(admission_wake_fd, &wakeups, sizeof(wakeups)) == -1 && errno != EAGAIN) {
+                    LOG_ERRNO(LOG_ERROR, "[Server] Failed to read acceptor wakeup");
+                }
+                take_matchmaking(pending, &admission);
+            } else if (listener->kind == HANDLE_LOBBY_LISTENER) {
+                accept_lobby_players(listener, pending, &admission);
+            } else if (listener->kind == HANDLE_AI_LISTENER) {
+                accept_ai_players(listener, pending, &admission);
+            } else if (listener->kind == HANDLE_HANDOFF) {
+                if (begin_handoff(listener, listeners, 8, pending, &admission)) {
+                    shutdown_requested = 1;
+                    break;
+                }
+            } else {
+                accept_connections(listener, pending, &admission);
+            }
+        }
+        admit_waiting(&admission);
+    }
+
+    while (admission.head) {
+        PendingPair *pair = admission.head;
+        admission.head = pair->next;
+        close_pair(pair);
+        free(pair);
+    }
+
+    for (int p = 0; p < 2; p++) {
+        while (pending[p].head) {
+            close(pop_pending(&pending[p]));
+        }
+    }
+    close(epoll_fd);
+}
+
+void request_shutdown(int signum) {
+    (void)signum;
+    shutdown_requested = 1;
+}
+
+/*
+ * Options apply left to right, so "--config FILE" sets what the file says and
+ * any flag after it overrides that.
+ */
+void parse_arguments(int argc, char **argv) {
+    config_defaults(&config);
+
+    for (int i = 1; i < argc; i++) {
+        const char *name = strncmp(argv[i], "--", 2) == 0 ? argv[i] + 2 : "";
+        bool flag;
+        char error[256];
+
+        if (strcmp(name, "config") == 0 && i + 1 < argc) {
+            if (!config_load(&config, argv[++i])) {
+                exit(EXIT_FAILURE);
+            }
+        } else if (config_has_option(name, &flag) && (flag || i + 1 < argc)) {
+            if (!config_set(&config, name, flag ? "true" : argv[++i], error, sizeof(error))) {
+                fprintf(stderr, "[Server] --%s\n", error);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            config_usage(stderr, argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (config.packet_rate && !config.packet_burst) {
+        config.packet_burst = config.packet_rate;
+    }
+    log_level = config.log_level;
+}
+
+static void close_record_fds(const HandoffRecord *record) {
+    for (int i = 0; i < record->fd_count; i++) {
+        close(record->fds[i]);
+    }
+}
+
+/*
+ * Takes over from the server listening on the --handoff socket, if one is:
+ * its listeners land in `takeover` to be used instead of opening ours, and
+ * its sessions and waiting players are held there until the workers and the
+ * acceptor are up. Returns false, with nothing taken, if no server answered.
+ */
+bool take_over(Takeover *takeover) {
+    int fd = handoff_connect(config.handoff_path);
+    if (fd == -1) {
+        if (errno != ENOENT && errno != ECONNREFUSED) {
+            perror("[Server] Failed to reach a server to take over from");
+        }
+        return false;
+    }
+
+    HandoffReader *reader = malloc(sizeof(HandoffReader));
+    if (!reader) {
+        perror("[Server] Failed to take over");
         exit(EXIT_FAILURE);
     }
+    handoff_reader_init(reader, fd);
+    uint64_t started = metrics_now_ns();
+    int waiting = 0;
+    bool ended = false;
+
+    HandoffRecord record;
+    while (!ended && handoff_read(reader, &record)) {
+        uint8_t byte = record.length == 1 ? *(const uint8_t *)record.payload : UINT8_MAX;
+        if (record.kind == HANDOFF_LISTENER && record.fd_count == 1 && byte < HANDOFF_LISTENERS) {
+            if (takeover->listeners[byte] != -1) {
+                close(takeover->listeners[byte]);
+            }
+            takeover->listeners[byte] = record.fds[0];
+        } else if ((record.kind == HANDOFF_SESSION || record.kind == HANDOFF_PAIR) &&
+                   (record.fd_count == 1 || record.fd_count == 2)) {
+            PendingPair *pair = calloc(1, sizeof(PendingPair));
+            char *snapshot = record.kind == HANDOFF_SESSION ? malloc(record.length ? record.length : 1) : NULL;
+            if (!pair || (record.kind == HANDOFF_SESSION && !snapshot)) {
+                perror("[Server] Failed to take over a session");
+                close_record_fds(&record);
+                free(pair);
+                free(snapshot);
+                continue;
+            }
+            pair->fds[0] = record.fds[0];
+            pair->fds[1] = record.fd_count == 2 ? record.fds[1] : -1;
+            if (snapshot) {
+                uint32_t id = 0;
+                memcpy(snapshot, record.payload, record.length);
+                memcpy(&id, snapshot, record.length < sizeof(id) ? 0 : sizeof(id));
+                pair->id = (int)id;
+                pair->snapshot = snapshot;
+                pair->snapshot_length = record.length;
+                pair->next = takeover->sessions;
+                takeover->sessions = pair;
+                takeover->session_count++;
+            } else {
+                if (takeover->last_pair) {
+                    takeover->last_pair->next = pair;
+                } else {
+                    takeover->pairs = pair;
+                }
+                takeover->last_pair = pair;
+                waiting += record.fd_count;
+            }
+        } else if (record.kind == HANDOFF_PLAYER && record.fd_count == 1 && byte <= 1) {
+            push_pending(&takeover->players[byte], record.fds[0]);
+            waiting++;
+        } else if (record.kind == HANDOFF_LOBBY && record.fd_count == 1) {
+            PendingConnection *lobby = malloc(sizeof(PendingConnection));
+            if (!lobby) {
+                close_record_fds(&record);
+                continue;
+            }
+            lobby->fd = record.fds[0];
+            lobby->next = takeover->lobby;
+            takeover->lobby = lobby;
+            waiting++;
+        } else if (record.kind == HANDOFF_END && record.length == sizeof(uint32_t)) {
+            uint32_t next_id;
+            memcpy(&next_id, record.payload, sizeof(next_id));
+            if ((int)next_id > next_session_id) {
+                next_session_id = (int)next_id;
+            }
+            ended = true;
+        } else {
+            close_record_fds(&record);
+        }
+    }
+    if (!ended) {
+        perror("[Server] The server being taken over stopped part-way");
+    }
+    handoff_reader_free(reader);
+    free(reader);
+    close(fd);
+
+    printf("[Server] Took over %d session%s and %d waiting player%s in %.1f ms.\n",
+           takeover->session_count, takeover->session_count == 1 ? "" : "s", waiting, waiting == 1 ? "" : "s",
+           (metrics_now_ns() - started) / 1e6);
+    return true;
+}
+
+/*
+ * Sessions taken over keep their ids, so the games the journal recovered
+ * under those ids are already in play and may not be resumed with "C".
+ */
+void claim_taken_over(const Takeover *takeover) {
+    for (const PendingPair *pair = takeover->sessions; pair; pair = pair->next) {
+        long index = find_recovered((uint32_t)pair->id);
+        if (index != -1) {
+            recovered_claimed[index] = true;
+        }
+        if (pair->id >= next_session_id) {
+            next_session_id = pair->id + 1;
+        }
+    }
+}
 
-    printf("[Server] %s connected!\n", player_name);
-    return conn_fd;
+/* Starts what a hot restart took over, once the workers are up. */
+void start_taken_over(Takeover *takeover) {
+    while (takeover->sessions) {
+        PendingPair *pair = takeover->sessions;
+        takeover->sessions = pair->next;
+        dispatch_session(pair);
+    }
+    while (takeover->lobby) {
+        PendingConnection *lobby = takeover->lobby;
+        takeover->lobby = lobby->next;
+        queue_lobby_player(lobby->fd);
+        free(lobby);
+    }
 }
 
-int main() {
+int main(int argc, char **argv) {
+    parse_arguments(argc, argv);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sigaction action = {0};
+    action.sa_handler = request_shutdown;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    /* A server already running on the handoff socket passes its listeners over. */
+    Takeover takeover = {.listeners = {-1, -1, -1, -1, -1, -1}};
+    if (config.handoff_path) {
+        take_over(&takeover);
+    }
+    int *inherited = takeover.listeners;
 
-    int listen_fd1 = setup_socket(PORT_PLAYER1);
-    int listen_fd2 = setup_socket(PORT_PLAYER2);
+    /* Opened first, so a client that sees the player ports up finds it ready too. */
+    int lobby_fd = inherited[HANDOFF_LISTENER_LOBBY];
+    if (lobby_fd == -1 && config.lobby_port) {
+        lobby_fd = setup_socket(config.lobby_port);
+    }
+    int ai_fd = inherited[HANDOFF_LISTENER_AI];
+    if (ai_fd == -1 && config.ai_port) {
+        ai_fd = setup_socket(config.ai_port);
+    }
+    int listen_fd1 = inherited[HANDOFF_LISTENER_PLAYER1];
+    int listen_fd2 = inherited[HANDOFF_LISTENER_PLAYER2];
+    listen_fd1 = listen_fd1 == -1 ? setup_socket(config.player_ports[0]) : listen_fd1;
+    listen_fd2 = listen_fd2 == -1 ? setup_socket(config.player_ports[1]) : listen_fd2;
+    int metrics_fd = inherited[HANDOFF_LISTENER_METRICS];
+    if (metrics_fd == -1 && config.metrics_port) {
+        metrics_fd = setup_metrics_socket(config.metrics_port);
+    }
+    int spectator_fd = inherited[HANDOFF_LISTENER_SPECTATOR];
+    if (spectator_fd == -1 && config.spectator_port) {
+        spectator_fd = setup_spectator_socket(config.spectator_port);
+    }
+    spectators_enabled = spectator_fd != -1;
 
-    int conn_fd1 = accept_connection(listen_fd1, "Player 1");
-    int conn_fd2 = accept_connection(listen_fd2, "Player 2");
+    if (config.journal_dir) {
+        recover_journal();
+    }
+    claim_taken_over(&takeover);
+
+    /* Listening only once the last server is done with the path. */
+    int handoff_fd = -1;
+    if (config.handoff_path) {
+        handoff_fd = handoff_listen(config.handoff_path);
+        if (handoff_fd == -1) {
+            perror("[Server] Hot restart disabled");
+        }
+    }
 
-    game_session(conn_fd1, conn_fd2);
+    log_start();
+    log_register_thread();
+    mpsc_init(&matchmaking);
+    start_workers(config.workers);
+    start_taken_over(&takeover);
+    run_acceptor(listen_fd1, listen_fd2, lobby_fd, ai_fd, metrics_fd, spectator_fd, handoff_fd, &takeover);
+
+    LOG(LOG_INFO, "[Server] Shutting down...");
+    stop_workers();
+    if (handoff) {
+        finish_handoff();
+    } else if (handoff_fd != -1) {
+        unlink(config.handoff_path);
+    }
+    if (handoff_fd != -1) {
+        close(handoff_fd);
+    }
+    close(admission_wake_fd);
+    for (MpscNode *node; (node = mpsc_pop(&matchmaking));) {
+        LobbyPlayer *player = (LobbyPlayer *)((char *)node - offsetof(LobbyPlayer, node));
+        close(player->fd);
+        free(player);
+    }
 
-    close(conn_fd1);
-    close(conn_fd2);
     close(listen_fd1);
     close(listen_fd2);
+    if (lobby_fd != -1) {
+        close(lobby_fd);
+    }
+    if (ai_fd != -1) {
+        close(ai_fd);
+    }
+    if (metrics_fd != -1) {
+        close(metrics_fd);
+    }
+    if (spectator_fd != -1) {
+        close(spectator_fd);
+    }
+    journal_set_free(&recovered);
+    free(recovered_claimed);
+    config_free(&config);
 
     return 0;
 }
-
-
@@ -0,0 +1,413 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define JOURNAL_MAGIC "HW4JRNL1"
+#define JOURNAL_HEADER_SIZE 16
+#define JOURNAL_CHUNK (4u << 20)
+
+static size_t record_size(const JournalRecord *record) {
+    return (sizeof(JournalRecord) + record->count * sizeof(int32_t) + 7) & ~(size_t)7;
+}
+
+static uint32_t checksum(const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the size of the valid record at `offset`, or 0 where the journal ends. */
+static size_t valid_record(const char *base, size_t length, size_t offset) {
+    if (length - offset < sizeof(JournalRecord)) {
+        return 0;
+    }
+
+    JournalRecord record;
+    memcpy(&record, base + offset, sizeof(record));
+    if (record.kind < JOURNAL_PACKET || record.kind > JOURNAL_WATERMARK || record.count > PACKET_MAX_VALUES) {
+        return 0;
+    }
+
+    size_t size = record_size(&record);
+    if (length - offset < size ||
+        checksum(base + offset + sizeof(uint32_t), size - sizeof(uint32_t)) != record.checksum) {
+        return 0;
+    }
+    return size;
+}
+
+bool journal_open(Journal *journal, const char *path) {
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (journal->fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(journal->fd, &st) == -1) {
+        goto fail;
+    }
+
+    bool fresh = (size_t)st.st_size < JOURNAL_HEADER_SIZE;
+    journal->size = fresh ? JOURNAL_CHUNK : (size_t)st.st_size;
+    if (fresh && ftruncate(journal->fd, journal->size) == -1) {
+        goto fail;
+    }
+
+    journal->base = mmap(NULL, journal->size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+    if (journal->base == MAP_FAILED) {
+        journal->base = NULL;
+        goto fail;
+    }
+
+    if (fresh) {
+        memcpy(journal->base, JOURNAL_MAGIC, 8);
+    } else if (memcmp(journal->base, JOURNAL_MAGIC, 8) != 0) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    size_t offset = JOURNAL_HEADER_SIZE;
+    size_t size;
+    while ((size = valid_record(journal->base, journal->size, offset)) > 0) {
+        offset += size;
+    }
+
+    /* Whatever a crash left half-written past the end must not be read later. */
+    if (journal->size - offset >= sizeof(uint32_t) && *(uint32_t *)(journal->base + offset) != 0) {
+        memset(journal->base + offset, 0, journal->size - offset);
+    }
+
+    journal->length = offset;
+    journal->synced = fresh ? 0 : offset;
+    return true;
+
+fail:
+    journal_close(journal);
+    return false;
+}
+
+void journal_close(Journal *journal) {
+    if (journal->base) {
+        journal_sync(journal);
+        munmap(journal->base, journal->size);
+    }
+    if (journal->fd > 0) {
+        close(journal->fd);
+    }
+    memset(journal, 0, sizeof(*journal));
+    journal->fd = -1;
+}
+
+/* Writes back everything appended since the last sync with one msync(). */
+bool journal_sync(Journal *journal) {
+    if (!journal->base || journal->synced == journal->length) {
+        return true;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = journal->synced & ~(page - 1);
+    if (msync(journal->base + start, journal->length - start, MS_SYNC) == -1) {
+        return false;
+    }
+    journal->synced = journal->length;
+    return true;
+}
+
+static bool reserve(Journal *journal, size_t size) {
+    if (journal->size - journal->length >= size) {
+        return true;
+    }
+
+    size_t grown = journal->size * 2;
+    if (ftruncate(journal->fd, grown) == -1) {
+        return false;
+    }
+    char *base = mremap(journal->base, journal->size, grown, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    journal->base = base;
+    journal->size = grown;
+    return true;
+}
+
+static bool append(Journal *journal, JournalRecord *record, const int *values) {
+    size_t size = record_size(record);
+    if (!journal->base || !reserve(journal, size)) {
+        return false;
+    }
+
+    char *out = journal->base + journal->length;
+    memset(out, 0, size);
+    if (values) {
+        memcpy(out + sizeof(JournalRecord), values, record->count * sizeof(int32_t));
+    }
+    memcpy(out, record, sizeof(JournalRecord));
+    record->checksum = checksum(out + sizeof(uint32_t), size - sizeof(uint32_t));
+    memcpy(out, &record->checksum, sizeof(uint32_t));
+
+    journal->length += size;
+    return true;
+}
+
+bool journal_step(Journal *journal, uint32_t session, uint32_t seq, int player, const Packet *packet,
+                  uint8_t event_flag, GamePhase before_phase, int before_active, const Game *game,
+                  const GameStep *step) {
+    if (game->phase == before_phase && game->active == before_active) {
+        return false;
+    }
+
+    JournalRecord record = {
+        .session = session,
+        .seq = seq,
+        .kind = JOURNAL_PACKET,
+        .player = (uint8_t)player,
+        .reply_type = JOURNAL_NO_REPLY
+    };
+
+    if (packet) {
+        record.packet_type = (uint8_t)packet->type;
+        record.flags = (packet->bare ? JOURNAL_FLAG_BARE : 0) | (packet->spaced ? JOURNAL_FLAG_SPACED : 0) |
+                       (packet->trailing_space ? JOURNAL_FLAG_TRAILING_SPACE : 0);
+        record.tokens = packet->tokens > UINT16_MAX ? UINT16_MAX : (uint16_t)packet->tokens;
+        record.integers = packet->integers > UINT16_MAX ? UINT16_MAX : (uint16_t)packet->integers;
+        record.count = packet->integers < PACKET_MAX_VALUES ? (uint8_t)packet->integers : PACKET_MAX_VALUES;
+    } else {
+        record.flags = event_flag;
+    }
+
+    if (step->has_reply[player]) {
+        record.reply_type = (uint8_t)step->replies[player].type;
+        record.reply_value = step->replies[player].value;
+        record.reply_shot = (uint8_t)step->replies[player].shot;
+    }
+
+    return append(journal, &record, packet ? packet->values : NULL);
+}
+
+bool journal_mark(Journal *journal, JournalKind kind, uint32_t session, uint32_t seq) {
+    JournalRecord record = {
+        .session = session,
+        .seq = seq,
+        .kind = (uint8_t)kind,
+        .reply_type = JOURNAL_NO_REPLY
+    };
+    return append(journal, &record, NULL);
+}
+
+/* Copies a record read back by journal_load(), as restart compaction does. */
+bool journal_append_entry(Journal *journal, const JournalEntry *entry) {
+    JournalRecord record = entry->header;
+    return append(journal, &record, entry->values);
+}
+
+void journal_entry_packet(const JournalEntry *entry, Packet *packet) {
+    const JournalRecord *record = &entry->header;
+
+    memset(packet, 0, sizeof(*packet));
+    packet->type = (PacketType)record->packet_type;
+    packet->bare = record->flags & JOURNAL_FLAG_BARE;
+    packet->spaced = record->flags & JOURNAL_FLAG_SPACED;
+    packet->trailing_space = record->flags & JOURNAL_FLAG_TRAILING_SPACE;
+    packet->tokens = record->tokens;
+    packet->integers = record->integers;
+    memcpy(packet->values, entry->values, record->count * sizeof(int32_t));
+}
+
+typedef struct {
+    JournalEntry *entries;
+    size_t count;
+    size_t capacity;
+} EntryList;
+
+static bool push_entry(EntryList *list, const JournalEntry *entry) {
+    if (list->count == list->capacity) {
+        size_t grown = list->capacity ? list->capacity * 2 : 256;
+        JournalEntry *resized = realloc(list->entries, grown * sizeof(JournalEntry));
+        if (!resized) {
+            return false;
+        }
+        list->entries = resized;
+        list->capacity = grown;
+    }
+    list->entries[list->count++] = *entry;
+    return true;
+}
+
+static bool read_file(const char *path, EntryList *list, uint32_t *highest_id) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+    if ((size_t)st.st_size < JOURNAL_HEADER_SIZE) {
+        /* Created but never written to. */
+        close(fd);
+        return true;
+    }
+
+    size_t length = (size_t)st.st_size;
+    char *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    if (memcmp(base, JOURNAL_MAGIC, 8) != 0) {
+        munmap(base, length);
+        errno = EINVAL;
+        return false;
+    }
+
+    bool ok = true;
+    size_t offset = JOURNAL_HEADER_SIZE;
+    size_t size;
+    while (ok && (size = valid_record(base, length, offset)) > 0) {
+        JournalEntry entry;
+        memcpy(&entry.header, base + offset, sizeof(JournalRecord));
+        memcpy(entry.values, base + offset + sizeof(JournalRecord), entry.header.count * sizeof(int32_t));
+        offset += size;
+
+        if (entry.header.session > *highest_id) {
+            *highest_id = entry.header.session;
+        }
+        if (entry.header.kind != JOURNAL_WATERMARK) {
+            ok = push_entry(list, &entry);
+        }
+    }
+
+    munmap(base, length);
+    return ok;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const JournalRecord *left = &((const JournalEntry *)a)->header;
+    const JournalRecord *right = &((const JournalEntry *)b)->header;
+    if (left->session != right->session) {
+        return left->session < right->session ? -1 : 1;
+    }
+    if (left->seq != right->seq) {
+        return left->seq < right->seq ? -1 : 1;
+    }
+    return left->kind - right->kind;
+}
+
+bool journal_load(JournalSet *set, char *const *paths, int path_count) {
+    EntryList list = {0};
+    memset(set, 0, sizeof(*set));
+
+    for (int i = 0; i < path_count; i++) {
+        if (!read_file(paths[i], &list, &set->highest_id)) {
+            free(list.entries);
+            return false;
+        }
+    }
+
+    qsort(list.entries, list.count, sizeof(JournalEntry), compare_entries);
+
+    size_t i = 0;
+    while (i < list.count) {
+        uint32_t id = list.entries[i].header.session;
+        size_t end = i;
+        while (end < list.count && list.entries[end].header.session == id) {
+            end++;
+        }
+
+        JournalSession *sessions = realloc(set->sessions, (set->count + 1) * sizeof(JournalSession));
+        if (!sessions) {
+            free(list.entries);
+            journal_set_free(set);
+            return false;
+        }
+        set->sessions = sessions;
+        JournalSession *session = &set->sessions[set->count++];
+        memset(session, 0, sizeof(*session));
+        session->id = id;
+        session->entries = malloc((end - i) * sizeof(JournalEntry));
+        if (!session->entries) {
+            free(list.entries);
+            journal_set_free(set);
+            return false;
+        }
+
+        uint32_t expected = 0;
+        for (size_t j = i; j < end; j++) {
+            const JournalEntry *entry = &list.entries[j];
+            if (entry->header.kind == JOURNAL_CLOSE) {
+                session->closed = true;
+            } else if (entry->header.seq == expected) {
+                session->entries[session->count++] = *entry;
+                expected++;
+            } else if (entry->header.seq > expected) {
+                /* A gap: what follows cannot be applied in order. */
+                break;
+            }
+        }
+        session->capacity = end - i;
+        i = end;
+    }
+
+    free(list.entries);
+    return true;
+}
+
+void journal_set_free(JournalSet *set) {
+    for (size_t i = 0; i < set->count; i++) {
+        free(set->sessions[i].entries);
+    }
+    free(set->sessions);
+    memset(set, 0, sizeof(*set));
+}
+
+bool journal_entry_matches(const JournalEntry *entry, const GameStep *step) {
+    const JournalRecord *record = &entry->header;
+    if (!step->has_reply[record->player]) {
+        return record->reply_type == JOURNAL_NO_REPLY;
+    }
+
+    const Reply *reply = &step->replies[record->player];
+    return reply->type == record->reply_type && reply->value == record->reply_value &&
+           (reply->type != REPLY_SHOT || (uint8_t)reply->shot == record->reply_shot);
+}
+
+int journal_replay(const JournalSession *session, Game *game, JournalStepFn on_step, void *context) {
+    int mismatches = 0;
+
+    for (size_t i = 0; i < session->count; i++) {
+        const JournalEntry *entry = &session->entries[i];
+        GameStep step;
+
+        if (entry->header.flags & JOURNAL_FLAG_DISCONNECT) {
+            game_disconnect(game, &step);
+        } else if (entry->header.flags & JOURNAL_FLAG_TIMEOUT) {
+            game_timeout(game, &step);
+        } else {
+            Packet packet;
+            journal_entry_packet(entry, &packet);
+            game_apply(game, entry->header.player, &packet, &step);
+        }
+
+        if (!journal_entry_matches(entry, &step)) {
+            mismatches++;
+        }
+        if (on_step) {
+            on_step(session, entry, &step, context);
+        }
+    }
+    return mismatches;
+}
@@ -0,0 +1,125 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "engine.h"
+#include "protocol.h"
+
+/*
+ * An append-only log of the packets that moved a game forward: accepted
+ * Begins, boards that were placed, shots with their results and halt
+ * acknowledgements. Rejected packets and queries change nothing and are not
+ * written. Replaying a session's records through game_apply() in `seq` order
+ * rebuilds its boards and shot logs exactly.
+ *
+ * Each worker appends to its own memory-mapped file, so appends take no lock.
+ * Records become durable at journal_sync(), which the server calls once per
+ * epoll batch for everything the batch wrote.
+ */
+typedef enum {
+    JOURNAL_PACKET = 1,
+    JOURNAL_CLOSE,
+    /* `session` is the highest id handed out so far; nothing else is set. */
+    JOURNAL_WATERMARK
+} JournalKind;
+
+#define JOURNAL_NO_REPLY 0xff
+
+/* JournalRecord.flags: the packet's Packet flags, or that the player left or ran out of time. */
+#define JOURNAL_FLAG_BARE 0x1
+#define JOURNAL_FLAG_SPACED 0x2
+#define JOURNAL_FLAG_TRAILING_SPACE 0x4
+#define JOURNAL_FLAG_DISCONNECT 0x8
+#define JOURNAL_FLAG_TIMEOUT 0x10
+
+/*
+ * One record as it sits in the file, followed by `count` int32 values and
+ * padding to a multiple of 8 bytes. `checksum` covers everything after it,
+ * so a record torn by a crash ends the journal there.
+ */
+typedef struct {
+    uint32_t checksum;
+    uint32_t session;
+    uint32_t seq;
+    uint8_t kind;
+    uint8_t player;
+    uint8_t packet_type;
+    uint8_t flags;
+    uint16_t tokens;
+    uint16_t integers;
+    uint8_t count;
+    uint8_t reply_type;
+    uint8_t reply_shot;
+    uint8_t reserved;
+    int32_t reply_value;
+} JournalRecord;
+
+/* A record with its values, as the reader hands them out. */
+typedef struct {
+    JournalRecord header;
+    int32_t values[PACKET_MAX_VALUES];
+} JournalEntry;
+
+typedef struct {
+    int fd;
+    char *base;
+    size_t size;
+    size_t length;
+    size_t synced;
+} Journal;
+
+bool journal_open(Journal *journal, const char *path);
+void journal_close(Journal *journal);
+bool journal_sync(Journal *journal);
+
+/*
+ * Writes what `step` did to `packet` from `player`, if it moved the game on.
+ * A step with no packet is a disconnect or a timeout, as `event_flag` says.
+ * `before_phase` and `before_active` are the game's state ahead of the step.
+ * Returns true if a record was written.
+ */
+bool journal_step(Journal *journal, uint32_t session, uint32_t seq, int player, const Packet *packet,
+                  uint8_t event_flag, GamePhase before_phase, int before_active, const Game *game,
+                  const GameStep *step);
+bool journal_mark(Journal *journal, JournalKind kind, uint32_t session, uint32_t seq);
+bool journal_append_entry(Journal *journal, const JournalEntry *entry);
+
+/*
+ * Every session found in a set of journals, with its records merged across
+ * files, de-duplicated and in `seq` order. A session whose records stop at a
+ * gap keeps only the part before it.
+ */
+typedef struct {
+    uint32_t id;
+    bool closed;
+    size_t count;
+    size_t capacity;
+    JournalEntry *entries;
+} JournalSession;
+
+typedef struct {
+    JournalSession *sessions;
+    size_t count;
+    uint32_t highest_id;
+} JournalSet;
+
+bool journal_load(JournalSet *set, char *const *paths, int path_count);
+void journal_set_free(JournalSet *set);
+
+void journal_entry_packet(const JournalEntry *entry, Packet *packet);
+/* Whether `step` answered the entry's player the way the journal recorded. */
+bool journal_entry_matches(const JournalEntry *entry, const GameStep *step);
+
+/*
+ * Feeds a session's packets to `game`, which must be freshly initialised,
+ * and returns how many steps answered differently from the recorded reply.
+ * `on_step`, if given, sees every entry with the step it produced.
+ */
+typedef void (*JournalStepFn)(const JournalSession *session, const JournalEntry *entry,
+                              const GameStep *step, void *context);
+int journal_replay(const JournalSession *session, Game *game, JournalStepFn on_step, void *context);
+
+#endif
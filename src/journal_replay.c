@@ -0,0 +1,187 @@
+/*
+ * Re-runs server journals through the engine, one session at a time, and
+ * checks every step still gets the reply the server recorded. By default it
+ * prints each journaled packet and the replies it produced, in the same
+ * "sent:"/"received:" form as loadgen --verbose, so a journal can be diffed
+ * against a known-good run.
+ *
+ *   gcc -O2 -o journal_replay src/journal_replay.c src/journal.c src/engine.c src/board.c src/protocol.c
+ *   ./journal_replay [--summary] [--board dense|bitboard|sparse] JOURNAL...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "board.h"
+#include "engine.h"
+#include "journal.h"
+#include "protocol.h"
+
+typedef struct {
+    bool summary;
+    BoardKind kind;
+    char **paths;
+    int path_count;
+} Options;
+
+static const char packet_letters[] = {
+    [PACKET_UNKNOWN] = '?',
+    [PACKET_BEGIN] = 'B',
+    [PACKET_INITIALIZE] = 'I',
+    [PACKET_SHOOT] = 'S',
+    [PACKET_QUERY] = 'Q',
+    [PACKET_FORFEIT] = 'F',
+    [PACKET_RESUME] = 'C',
+    [PACKET_WATCH] = 'W'
+};
+
+static const char *const phase_names[] = {
+    [PHASE_BEGIN_P1] = "awaiting Begin from Player 1",
+    [PHASE_BEGIN_P2] = "awaiting Begin from Player 2",
+    [PHASE_INIT_P1] = "awaiting Initialize from Player 1",
+    [PHASE_INIT_P2] = "awaiting Initialize from Player 2",
+    [PHASE_TURN] = "in play",
+    [PHASE_HALT_LOSER_ACK] = "awaiting the loser's acknowledgement",
+    [PHASE_HALT_WINNER_ACK] = "awaiting the winner's acknowledgement",
+    [PHASE_OVER] = "over"
+};
+
+/* Writes the packet back out as text; tokens the journal did not keep show as "...". */
+static void format_packet(const JournalEntry *entry, char *out, size_t size) {
+    const JournalRecord *record = &entry->header;
+    size_t length = 0;
+
+    if (record->packet_type >= sizeof(packet_letters)) {
+        snprintf(out, size, "?");
+        return;
+    }
+    length += snprintf(out, size, "%c", packet_letters[record->packet_type]);
+    for (int i = 0; i < record->count && length < size; i++) {
+        length += snprintf(out + length, size - length, " %d", entry->values[i]);
+    }
+    if (record->tokens > record->count && length < size) {
+        snprintf(out + length, size - length, " ...");
+    }
+}
+
+static void print_reply(uint32_t session, int player, const Reply *reply) {
+    OutputBuffer out = {0};
+    if (encode_reply(reply, WIRE_TEXT, &out)) {
+        printf("[Replay] Session %u P%d received: %.*s\n", session, player + 1, (int)out.length - 1, out.data);
+    }
+    output_free(&out);
+}
+
+static void print_step(const JournalSession *session, const JournalEntry *entry, const GameStep *step, void *context) {
+    const Options *options = context;
+    const JournalRecord *record = &entry->header;
+
+    if (!options->summary) {
+        char packet[256];
+        if (record->flags & JOURNAL_FLAG_DISCONNECT) {
+            snprintf(packet, sizeof(packet), "(disconnected)");
+        } else if (record->flags & JOURNAL_FLAG_TIMEOUT) {
+            snprintf(packet, sizeof(packet), "(timed out)");
+        } else {
+            format_packet(entry, packet, sizeof(packet));
+        }
+        printf("[Replay] Session %u P%d sent: %s\n", session->id, record->player + 1, packet);
+        for (int p = 0; p < 2; p++) {
+            if (step->has_reply[p]) {
+                print_reply(session->id, p, &step->replies[p]);
+            }
+        }
+    }
+
+    if (!journal_entry_matches(entry, step)) {
+        bool answered = step->has_reply[record->player];
+        const Reply *reply = &step->replies[record->player];
+        printf("[Replay] Session %u seq %u: journal recorded reply %d/%d, replay gave %d/%d\n",
+               session->id, record->seq, record->reply_type, record->reply_value,
+               answered ? (int)reply->type : -1, answered ? reply->value : 0);
+    }
+}
+
+static void parse_arguments(int argc, char **argv, Options *options) {
+    options->summary = false;
+    options->kind = BOARD_DENSE;
+    options->paths = NULL;
+    options->path_count = 0;
+
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--summary") == 0) {
+            options->summary = true;
+        } else if (strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+            const char *kind = argv[++i];
+            if (strcmp(kind, "dense") == 0) {
+                options->kind = BOARD_DENSE;
+            } else if (strcmp(kind, "bitboard") == 0) {
+                options->kind = BOARD_BITBOARD;
+            } else if (strcmp(kind, "sparse") == 0) {
+                options->kind = BOARD_SPARSE;
+            } else {
+                fprintf(stderr, "--board expects 'dense', 'bitboard' or 'sparse'\n");
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (i >= argc) {
+        fprintf(stderr, "Usage: %s [--summary] [--board dense|bitboard|sparse] JOURNAL...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    options->paths = argv + i;
+    options->path_count = argc - i;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    parse_arguments(argc, argv, &options);
+
+    JournalSet set;
+    if (!journal_load(&set, options.paths, options.path_count)) {
+        perror("Failed to read journal");
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ArenaPool pool = {0};
+    size_t packets = 0;
+    size_t unfinished = 0;
+    int mismatches = 0;
+
+    for (size_t i = 0; i < set.count; i++) {
+        const JournalSession *session = &set.sessions[i];
+        Game game;
+
+        game_init(&game, options.kind, &pool);
+        mismatches += journal_replay(session, &game, print_step, &options);
+        packets += session->count;
+        if (game.phase != PHASE_OVER) {
+            unfinished++;
+        }
+        if (options.summary || game.phase != PHASE_OVER) {
+            printf("[Replay] Session %u: %zu packets, %s%s\n", session->id, session->count,
+                   phase_names[game.phase], session->closed ? "" : " (not closed)");
+        }
+        game_release(&game);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "[Replay] %zu sessions (%zu unfinished), %zu packets in %.3f s, %d mismatched\n",
+            set.count, unfinished, packets, elapsed, mismatches);
+
+    arena_pool_clear(&pool);
+    journal_set_free(&set);
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
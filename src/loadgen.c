@@ -0,0 +1,746 @@
+/*
+ * Load generator: keeps many player pairs connected to the server at once and
+ * plays either the scenario pairs in a scripts directory (p1_<name> with
+ * p2_<name>) or random valid games, then reports turns/sec, latency
+ * percentiles per packet type and the error codes the server sent.
+ *
+ *   gcc -O2 -o loadgen src/loadgen.c src/board.c
+ *   ./loadgen [--host ADDR] [--port1 N] [--port2 N] [--lobby N] [--ai N] [--games N] [--concurrency N]
+ *             [--scripts DIR] [--size WxH] [--legacy] [--timeout MS] [--seed N] [--verbose]
+ *
+ * The server pairs connections in the order it accepts them, so each pair
+ * connects Player 1 then Player 2 with blocking connects and only then goes
+ * non-blocking. With --lobby both players dial the lobby port and send their
+ * Begin at once, since the lobby pairs them only when both have; the next
+ * pair joins only once Player 1 is accepted, so no two pairs get crossed.
+ * With --ai only Player 1 connects, to the AI port, and the server's AI
+ * plays Player 2 between Player 1's packets. A pair keeps a single packet
+ * in flight: the loadgen sends only for the player the server is waiting
+ * on, so the latency of a packet is the server's own, never the opponent's
+ * think time; against the AI it includes the AI's move.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "board.h"
+#include "metrics.h"
+
+#define BUFFER_SIZE 1024
+#define MAX_EVENTS 256
+#define MAX_ERROR_CODE 1000
+#define MAX_SCRIPT_LINES 256
+
+typedef enum {
+    KIND_BEGIN,
+    KIND_INITIALIZE,
+    KIND_SHOOT,
+    KIND_QUERY,
+    KIND_FORFEIT,
+    KIND_OTHER,
+    KIND_COUNT
+} PacketKind;
+
+static const char *const kind_names[KIND_COUNT] = {"B", "I", "S", "Q", "F", "other"};
+
+typedef struct {
+    uint64_t count;
+    uint64_t buckets[LATENCY_BUCKETS];
+} Histogram;
+
+typedef struct {
+    char name[256];
+    char *lines[2][MAX_SCRIPT_LINES];
+    int line_count[2];
+} Script;
+
+typedef struct {
+    const char *host;
+    int ports[2];
+    int lobby_port;
+    int ai_port;
+    long games;
+    int concurrency;
+    const char *script_dir;
+    int width;
+    int height;
+    bool legacy;
+    int timeout_ms;
+    uint64_t seed;
+    bool verbose;
+} Options;
+
+typedef struct {
+    int fd;
+    char in[BUFFER_SIZE];
+    size_t in_length;
+    int next_line;
+    int next_target;
+    int random_step;
+} Player;
+
+/*
+ * PAIR_PLAYING covers setup and turns. After a winning shot or a forfeit the
+ * loser acknowledges its halt, then the winner acknowledges its own.
+ */
+typedef enum {
+    PAIR_IDLE,
+    PAIR_PLAYING,
+    PAIR_LOSER_ACK,
+    PAIR_WINNER_ACK
+} PairStage;
+
+typedef struct {
+    uint32_t generation;
+    PairStage stage;
+    Player players[2];
+    int turn;
+    int awaiting;
+    PacketKind sent_kind;
+    uint64_t sent_at;
+    uint64_t deadline;
+    int accepts;
+    /* Player 2's Begin went out with Player 1's, for the lobby. */
+    bool early_begin;
+    int id;
+    const Script *script;
+    int fleet[2][20];
+    int *targets[2];
+} Pair;
+
+typedef struct {
+    Histogram latency[KIND_COUNT];
+    uint64_t errors[MAX_ERROR_CODE];
+    uint64_t turns;
+    long started;
+    long finished;
+    long decided;
+    long aborted;
+    long timed_out;
+} Stats;
+
+static Options options;
+static Stats stats;
+static Script *scripts;
+static int script_count;
+static uint64_t rng_state;
+static int epoll_fd;
+/* The pair whose players are in the lobby, not yet known to be paired. */
+static Pair *joining;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void histogram_record(Histogram *histogram, uint64_t ns) {
+    histogram->count++;
+    histogram->buckets[latency_bucket(ns)]++;
+}
+
+static uint64_t histogram_percentile(const Histogram *histogram, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * histogram->count);
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen > rank) {
+            return bucket_limit(bucket);
+        }
+    }
+    return 0;
+}
+
+static void read_script_lines(const char *path, char **lines, int *count) {
+    FILE *fp = fopen(path, "r");
+    char buffer[BUFFER_SIZE];
+
+    *count = 0;
+    if (!fp) {
+        return;
+    }
+    while (*count < MAX_SCRIPT_LINES && fgets(buffer, sizeof(buffer), fp) != NULL) {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        lines[(*count)++] = strdup(buffer);
+    }
+    fclose(fp);
+}
+
+static int compare_scripts(const void *a, const void *b) {
+    return strcmp(((const Script *)a)->name, ((const Script *)b)->name);
+}
+
+/* Loads every p1_<name> that has a matching p2_<name>. */
+static void load_scripts(const char *directory) {
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    char path[2][4096];
+
+    if (!dir) {
+        perror("[Loadgen] Failed to open scripts directory");
+        exit(EXIT_FAILURE);
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "p1_", 3) != 0) {
+            continue;
+        }
+        snprintf(path[0], sizeof(path[0]), "%s/%s", directory, entry->d_name);
+        snprintf(path[1], sizeof(path[1]), "%s/p2_%s", directory, entry->d_name + 3);
+        if (access(path[1], R_OK) != 0) {
+            continue;
+        }
+
+        scripts = realloc(scripts, (script_count + 1) * sizeof(Script));
+        Script *script = &scripts[script_count];
+        memset(script, 0, sizeof(*script));
+        snprintf(script->name, sizeof(script->name), "%s", entry->d_name + 3);
+        for (int p = 0; p < 2; p++) {
+            read_script_lines(path[p], script->lines[p], &script->line_count[p]);
+        }
+        script_count++;
+    }
+    closedir(dir);
+
+    if (script_count == 0) {
+        fprintf(stderr, "[Loadgen] No p1_/p2_ script pairs in %s\n", directory);
+        exit(EXIT_FAILURE);
+    }
+    qsort(scripts, script_count, sizeof(Script), compare_scripts);
+}
+
+static void shuffle_targets(int *targets, int cells) {
+    for (int i = 0; i < cells; i++) {
+        targets[i] = i;
+    }
+    for (int i = cells - 1; i > 0; i--) {
+        int j = random_below(&rng_state, i + 1);
+        int swap = targets[i];
+        targets[i] = targets[j];
+        targets[j] = swap;
+    }
+}
+
+static PacketKind packet_kind(const char *packet) {
+    switch (packet[0]) {
+    case 'B': return KIND_BEGIN;
+    case 'I': return KIND_INITIALIZE;
+    case 'S': return KIND_SHOOT;
+    case 'Q': return KIND_QUERY;
+    case 'F': return KIND_FORFEIT;
+    default: return KIND_OTHER;
+    }
+}
+
+/*
+ * Writes the next packet `player` sends into `packet`. Returns false when a
+ * script has run out of lines.
+ */
+static bool next_packet(Pair *pair, int player, char *packet, size_t size) {
+    Player *self = &pair->players[player];
+
+    if (pair->script) {
+        if (self->next_line >= pair->script->line_count[player]) {
+            return false;
+        }
+        snprintf(packet, size, "%s", pair->script->lines[player][self->next_line++]);
+        return true;
+    }
+
+    if (pair->stage != PAIR_PLAYING) {
+        snprintf(packet, size, "F");
+        return true;
+    }
+
+    switch (self->random_step++) {
+    case 0:
+        if (player == 0) {
+            snprintf(packet, size, "B %d %d", options.width, options.height);
+        } else {
+            snprintf(packet, size, "B");
+        }
+        return true;
+    case 1: {
+        int length = snprintf(packet, size, "I");
+        for (int i = 0; i < 20; i++) {
+            length += snprintf(packet + length, size - length, " %d", pair->fleet[player][i]);
+        }
+        return true;
+    }
+    default:
+        if (self->next_target >= options.width * options.height) {
+            snprintf(packet, size, "F");
+        } else {
+            int cell = pair->targets[player][self->next_target++];
+            snprintf(packet, size, "S %d %d", cell / options.width, cell % options.width);
+        }
+        return true;
+    }
+}
+
+static void close_pair(Pair *pair) {
+    for (int p = 0; p < 2; p++) {
+        if (pair->players[p].fd >= 0) {
+            close(pair->players[p].fd);
+            pair->players[p].fd = -1;
+        }
+    }
+    pair->stage = PAIR_IDLE;
+    pair->generation++;
+    stats.finished++;
+    if (joining == pair) {
+        joining = NULL;
+    }
+}
+
+static void abort_pair(Pair *pair, const char *reason) {
+    if (options.verbose) {
+        printf("[Loadgen] Pair %d aborted: %s\n", pair->id, reason);
+    }
+    stats.aborted++;
+    close_pair(pair);
+}
+
+static bool send_packet(Pair *pair, int player) {
+    char packet[BUFFER_SIZE];
+
+    if (!next_packet(pair, player, packet, sizeof(packet) - 1)) {
+        /* A script that ends mid-game simply disconnects. */
+        close_pair(pair);
+        return false;
+    }
+
+    size_t length = strlen(packet);
+    if (!options.legacy) {
+        packet[length++] = '\n';
+    }
+
+    pair->sent_kind = packet_kind(packet);
+    pair->sent_at = now_ns();
+    if (send(pair->players[player].fd, packet, length, MSG_NOSIGNAL) != (ssize_t)length) {
+        abort_pair(pair, "send failed");
+        return false;
+    }
+    if (options.verbose) {
+        printf("[Loadgen] Pair %d P%d sent: %.*s\n", pair->id, player + 1,
+               (int)(options.legacy ? length : length - 1), packet);
+    }
+    return true;
+}
+
+/* Sends for whoever the server is waiting on and notes whose reply comes next. */
+static void advance_pair(Pair *pair) {
+    int sender = pair->turn;
+
+    if (pair->early_begin && sender == 1) {
+        pair->early_begin = false;
+        pair->awaiting = sender;
+        pair->sent_kind = KIND_BEGIN;
+        pair->sent_at = now_ns();
+        return;
+    }
+    if (!send_packet(pair, sender)) {
+        return;
+    }
+
+    switch (pair->stage) {
+    case PAIR_LOSER_ACK:
+        /* The loser's acknowledgement is answered on the winner's socket. */
+        pair->awaiting = 1 - sender;
+        break;
+    case PAIR_WINNER_ACK:
+        close_pair(pair);
+        break;
+    default:
+        pair->awaiting = sender;
+        break;
+    }
+}
+
+static void handle_reply(Pair *pair, int player, const char *reply) {
+    int value = 0;
+
+    if (options.verbose) {
+        printf("[Loadgen] Pair %d P%d received: %s\n", pair->id, player + 1, reply);
+    }
+
+    if (player != pair->awaiting) {
+        /* The loser's "H 0" alongside a winning shot, or the other side of a forfeit. */
+        return;
+    }
+    if (joining == pair) {
+        joining = NULL;
+    }
+    histogram_record(&stats.latency[pair->sent_kind], now_ns() - pair->sent_at);
+    pair->deadline = now_ns() + (uint64_t)options.timeout_ms * 1000000ull;
+
+    if (pair->stage == PAIR_LOSER_ACK) {
+        pair->stage = PAIR_WINNER_ACK;
+        pair->turn = player;
+        advance_pair(pair);
+        return;
+    }
+
+    switch (reply[0]) {
+    case 'A':
+        pair->accepts++;
+        pair->turn = options.ai_port ? player : 1 - player;
+        break;
+    case 'E':
+        value = atoi(reply + 1);
+        if (value >= 0 && value < MAX_ERROR_CODE) {
+            stats.errors[value]++;
+        }
+        break;
+    case 'R':
+        stats.turns++;
+        value = atoi(reply + 1);
+        if (value == 0 && options.ai_port) {
+            /* The AI acknowledges its loss at once; Player 1's own halt follows. */
+            pair->stage = PAIR_WINNER_ACK;
+            stats.decided++;
+            return;
+        }
+        if (value == 0) {
+            pair->stage = PAIR_LOSER_ACK;
+            stats.decided++;
+        }
+        pair->turn = options.ai_port ? player : 1 - player;
+        break;
+    case 'H':
+        if (pair->accepts < (options.ai_port ? 2 : 4)) {
+            /* Forfeit before the game started: both sides are told at once. */
+            close_pair(pair);
+            return;
+        }
+        if (options.ai_port && pair->stage == PAIR_WINNER_ACK) {
+            break;
+        }
+        if (options.ai_port) {
+            /* The AI won on its move, and the shot just sent acknowledged it. */
+            stats.decided++;
+            close_pair(pair);
+            return;
+        }
+        pair->stage = PAIR_LOSER_ACK;
+        pair->turn = player;
+        stats.decided++;
+        break;
+    case 'G':
+        break;
+    default:
+        abort_pair(pair, "unrecognised reply");
+        return;
+    }
+
+    advance_pair(pair);
+}
+
+static int connect_player(int port) {
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+
+    if (fd < 0) {
+        perror("[Loadgen] socket() failed");
+        return -1;
+    }
+    if (inet_pton(AF_INET, options.host, &address.sin_addr) <= 0) {
+        fprintf(stderr, "[Loadgen] Invalid address %s\n", options.host);
+        exit(EXIT_FAILURE);
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("[Loadgen] connect() failed");
+        close(fd);
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static uint64_t event_tag(const Pair *pair, int slot, int player) {
+    return (uint64_t)pair->generation << 32 | (uint64_t)slot << 1 | (uint64_t)player;
+}
+
+static bool start_pair(Pair *pair, int slot, Board *scratch) {
+    memset(pair->players, 0, sizeof(pair->players));
+    pair->players[0].fd = pair->players[1].fd = -1;
+    pair->id = (int)stats.started++;
+    pair->accepts = 0;
+    pair->early_begin = false;
+    pair->turn = 0;
+    pair->stage = PAIR_PLAYING;
+    pair->deadline = now_ns() + (uint64_t)options.timeout_ms * 1000000ull;
+
+    if (script_count > 0) {
+        pair->script = &scripts[pair->id % script_count];
+    } else {
+        pair->script = NULL;
+        for (int p = 0; p < 2; p++) {
+            random_fleet(scratch, &rng_state, pair->fleet[p]);
+            shuffle_targets(pair->targets[p], options.width * options.height);
+        }
+    }
+
+    for (int p = 0; p < (options.ai_port ? 1 : 2); p++) {
+        int port = options.ai_port ? options.ai_port : options.lobby_port ? options.lobby_port : options.ports[p];
+        pair->players[p].fd = connect_player(port);
+        if (pair->players[p].fd < 0) {
+            abort_pair(pair, "connect failed");
+            return false;
+        }
+        struct epoll_event event = {.events = EPOLLIN, .data.u64 = event_tag(pair, slot, p)};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pair->players[p].fd, &event);
+    }
+
+    if (options.lobby_port) {
+        if (!send_packet(pair, 1)) {
+            return false;
+        }
+        pair->early_begin = true;
+        joining = pair;
+    }
+    advance_pair(pair);
+    return true;
+}
+
+/* Splits what arrived into replies: one per read for legacy, one per line otherwise. */
+static void read_replies(Pair *pair, int player) {
+    Player *self = &pair->players[player];
+    uint32_t generation = pair->generation;
+
+    for (;;) {
+        ssize_t received = recv(self->fd, self->in + self->in_length, sizeof(self->in) - 1 - self->in_length, 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received <= 0) {
+            abort_pair(pair, "server closed the connection");
+            return;
+        }
+        self->in_length += received;
+        self->in[self->in_length] = '\0';
+
+        if (options.legacy) {
+            self->in_length = 0;
+            handle_reply(pair, player, self->in);
+        } else {
+            char *line = self->in;
+            char *newline;
+            while (pair->generation == generation && (newline = memchr(line, '\n', self->in + self->in_length - line))) {
+                *newline = '\0';
+                handle_reply(pair, player, line);
+                line = newline + 1;
+            }
+            if (pair->generation != generation) {
+                return;
+            }
+            self->in_length -= line - self->in;
+            memmove(self->in, line, self->in_length);
+            if (self->in_length == sizeof(self->in) - 1) {
+                abort_pair(pair, "reply too long");
+            }
+        }
+        if (pair->generation != generation) {
+            return;
+        }
+    }
+}
+
+static void print_report(double elapsed) {
+    printf("[Loadgen] %ld games (%ld decided, %ld aborted, %ld timed out) in %.2f s\n",
+           stats.finished, stats.decided, stats.aborted, stats.timed_out, elapsed);
+    printf("[Loadgen] %.0f games/sec, %.0f turns/sec\n", stats.finished / elapsed, stats.turns / elapsed);
+    printf("[Loadgen] %-6s %10s %10s %10s %10s\n", "packet", "count", "p50 us", "p99 us", "p999 us");
+    for (int kind = 0; kind < KIND_COUNT; kind++) {
+        const Histogram *histogram = &stats.latency[kind];
+        if (histogram->count == 0) {
+            continue;
+        }
+        printf("[Loadgen] %-6s %10llu %10.1f %10.1f %10.1f\n", kind_names[kind],
+               (unsigned long long)histogram->count,
+               histogram_percentile(histogram, 0.50) / 1e3,
+               histogram_percentile(histogram, 0.99) / 1e3,
+               histogram_percentile(histogram, 0.999) / 1e3);
+    }
+    for (int code = 0; code < MAX_ERROR_CODE; code++) {
+        if (stats.errors[code]) {
+            printf("[Loadgen] E %d: %llu\n", code, (unsigned long long)stats.errors[code]);
+        }
+    }
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--host ADDR] [--port1 N] [--port2 N] [--lobby N] [--ai N] [--games N] [--concurrency N]\n"
+                    "       [--scripts DIR] [--size WxH] [--legacy] [--timeout MS] [--seed N] [--verbose]\n",
+            program);
+    exit(EXIT_FAILURE);
+}
+
+static void parse_arguments(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--legacy") == 0) {
+            options.legacy = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--verbose") == 0) {
+            options.verbose = true;
+            continue;
+        }
+        if (!value) {
+            usage(argv[0]);
+        }
+
+        if (strcmp(argv[i], "--host") == 0) {
+            options.host = value;
+        } else if (strcmp(argv[i], "--port1") == 0) {
+            options.ports[0] = atoi(value);
+        } else if (strcmp(argv[i], "--port2") == 0) {
+            options.ports[1] = atoi(value);
+        } else if (strcmp(argv[i], "--lobby") == 0) {
+            options.lobby_port = atoi(value);
+        } else if (strcmp(argv[i], "--ai") == 0) {
+            options.ai_port = atoi(value);
+        } else if (strcmp(argv[i], "--games") == 0) {
+            options.games = atol(value);
+        } else if (strcmp(argv[i], "--concurrency") == 0) {
+            options.concurrency = atoi(value);
+        } else if (strcmp(argv[i], "--scripts") == 0) {
+            options.script_dir = value;
+        } else if (strcmp(argv[i], "--size") == 0) {
+            if (sscanf(value, "%dx%d", &options.width, &options.height) != 2 ||
+                options.width < 10 || options.height < 10) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--timeout") == 0) {
+            options.timeout_ms = atoi(value);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            options.seed = strtoull(value, NULL, 10);
+        } else {
+            usage(argv[0]);
+        }
+        i++;
+    }
+
+    /*
+     * A script may not open with a Begin, which the lobby needs to pair it,
+     * and scripts play both sides, where the AI plays Player 2 itself.
+     */
+    if (options.games < 1 || options.concurrency < 1 || options.timeout_ms < 1 ||
+        ((options.lobby_port || options.ai_port) && options.script_dir) || (options.lobby_port && options.ai_port)) {
+        usage(argv[0]);
+    }
+}
+
+/* Two descriptors per pair plus a few spare; ask for the hard limit if needed. */
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    rlim_t wanted = (rlim_t)options.concurrency * 2 + 16;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted) {
+        limit.rlim_cur = limit.rlim_max < wanted ? limit.rlim_max : wanted;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < wanted) {
+            options.concurrency = (int)((limit.rlim_cur - 16) / 2);
+            fprintf(stderr, "[Loadgen] Descriptor limit allows only %d pairs\n", options.concurrency);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    options = (Options){
+        .host = "127.0.0.1",
+        .ports = {2201, 2202},
+        .games = 1000,
+        .concurrency = 100,
+        .width = 10,
+        .height = 10,
+        .timeout_ms = 5000,
+        .seed = 1
+    };
+    parse_arguments(argc, argv);
+    raise_fd_limit();
+    rng_state = options.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    if (options.script_dir) {
+        load_scripts(options.script_dir);
+    }
+    if (options.concurrency > options.games) {
+        options.concurrency = (int)options.games;
+    }
+
+    epoll_fd = epoll_create1(0);
+    Board *scratch = create_board(BOARD_DENSE, options.width, options.height);
+    Pair *pairs = calloc(options.concurrency, sizeof(Pair));
+    if (epoll_fd < 0 || !scratch || !pairs) {
+        perror("[Loadgen] Setup failed");
+        return EXIT_FAILURE;
+    }
+    for (int slot = 0; slot < options.concurrency; slot++) {
+        pairs[slot].targets[0] = malloc(options.width * options.height * sizeof(int));
+        pairs[slot].targets[1] = malloc(options.width * options.height * sizeof(int));
+        if (!pairs[slot].targets[0] || !pairs[slot].targets[1]) {
+            perror("[Loadgen] Setup failed");
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t start = now_ns();
+    uint64_t next_sweep = start;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (stats.finished < options.games) {
+        for (int slot = 0; slot < options.concurrency && stats.started < options.games && !joining; slot++) {
+            if (pairs[slot].stage == PAIR_IDLE) {
+                start_pair(&pairs[slot], slot, scratch);
+            }
+        }
+
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        for (int i = 0; i < ready; i++) {
+            uint64_t tag = events[i].data.u64;
+            Pair *pair = &pairs[(tag & 0xffffffffu) >> 1];
+            if (pair->stage != PAIR_IDLE && pair->generation == (uint32_t)(tag >> 32)) {
+                read_replies(pair, (int)(tag & 1));
+            }
+        }
+
+        uint64_t now = now_ns();
+        if (now >= next_sweep) {
+            for (int slot = 0; slot < options.concurrency; slot++) {
+                if (pairs[slot].stage != PAIR_IDLE && now > pairs[slot].deadline) {
+                    stats.timed_out++;
+                    abort_pair(&pairs[slot], "timed out");
+                }
+            }
+            next_sweep = now + 100000000ull;
+        }
+    }
+
+    print_report((now_ns() - start) / 1e9);
+
+    for (int slot = 0; slot < options.concurrency; slot++) {
+        free(pairs[slot].targets[0]);
+        free(pairs[slot].targets[1]);
+    }
+    free(pairs);
+    free_board(scratch);
+    close(epoll_fd);
+    return stats.aborted == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "log.h"
+
+#define LOG_RING_SIZE 8192
+#define LOG_MAX_RINGS 1088
+#define LOG_BATCH_MAX 4096
+#define LOG_IDLE_SLEEP_NS 1000000
+#define LOG_LINE_MAX 512
+
+/*
+ * A single-producer, single-consumer ring: the owning thread advances `tail`,
+ * the flusher advances `head`. When the flusher falls behind the producer
+ * drops the record and counts it rather than wait.
+ */
+typedef struct {
+    alignas(64) _Atomic uint64_t head;
+    alignas(64) _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    uint64_t dropped_reported;
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+typedef struct {
+    LogRecord record;
+    uint32_t order;
+} BatchEntry;
+
+LogLevel log_level = LOG_INFO;
+
+static LogRing *rings[LOG_MAX_RINGS];
+static _Atomic int ring_count;
+static pthread_mutex_t register_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic bool running;
+static _Atomic bool stopping;
+static pthread_t flusher;
+static _Thread_local LogRing *thread_ring;
+static BatchEntry batch[LOG_BATCH_MAX];
+static int next_ring;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void write_record(const LogRecord *record) {
+    FILE *stream = record->level >= LOG_WARN ? stderr : stdout;
+
+    if (record->with_errno) {
+        char reason[128];
+        fprintf(stream, "%s: %s\n", record->format, strerror_r(record->error, reason, sizeof(reason)));
+        return;
+    }
+
+    char line[LOG_LINE_MAX];
+    int length = snprintf(line, sizeof(line), record->format,
+                          record->args[0], record->args[1], record->args[2], record->args[3]);
+    if (length > 0) {
+        fwrite(line, 1, length < (int)sizeof(line) ? (size_t)length : sizeof(line) - 1, stream);
+    }
+}
+
+void log_push(int level, int with_errno, int error, const char *format, int count, ...) {
+    LogRecord record = {
+        .timestamp_ns = now_ns(),
+        .format = format,
+        .level = (int16_t)level,
+        .with_errno = (int16_t)with_errno,
+        .error = error
+    };
+
+    va_list args;
+    va_start(args, count);
+    for (int i = 0; i < count && i < LOG_MAX_ARGS; i++) {
+        record.args[i] = va_arg(args, int);
+    }
+    va_end(args);
+
+    LogRing *ring = thread_ring;
+    if (!ring || !atomic_load_explicit(&running, memory_order_relaxed)) {
+        write_record(&record);
+        return;
+    }
+
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == LOG_RING_SIZE) {
+        uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        atomic_store_explicit(&ring->dropped, dropped + 1, memory_order_relaxed);
+        return;
+    }
+
+    ring->records[tail & (LOG_RING_SIZE - 1)] = record;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const BatchEntry *left = a;
+    const BatchEntry *right = b;
+    if (left->record.timestamp_ns != right->record.timestamp_ns) {
+        return left->record.timestamp_ns < right->record.timestamp_ns ? -1 : 1;
+    }
+    return left->order < right->order ? -1 : left->order > right->order;
+}
+
+/*
+ * Takes what every ring holds, up to a batch, and writes it in timestamp
+ * order so lines from different workers interleave as they happened. Each
+ * drain starts at the ring after the last one the previous drain visited,
+ * so a full batch cannot keep the later rings waiting.
+ * Returns the number of records written.
+ */
+static size_t drain_rings(void) {
+    int count = atomic_load_explicit(&ring_count, memory_order_acquire);
+    size_t taken = 0;
+    int start = count ? next_ring % count : 0;
+
+    for (int i = 0; i < count && taken < LOG_BATCH_MAX; i++) {
+        int r = (start + i) % count;
+        LogRing *ring = rings[r];
+        next_ring = r + 1;
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        while (head != tail && taken < LOG_BATCH_MAX) {
+            batch[taken].record = ring->records[head & (LOG_RING_SIZE - 1)];
+            batch[taken].order = (uint32_t)taken;
+            taken++;
+            head++;
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+
+        uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        if (dropped != ring->dropped_reported) {
+            fprintf(stderr, "[Server] Log ring %d dropped %llu records\n", r,
+                    (unsigned long long)(dropped - ring->dropped_reported));
+            ring->dropped_reported = dropped;
+        }
+    }
+
+    qsort(batch, taken, sizeof(BatchEntry), compare_entries);
+    for (size_t i = 0; i < taken; i++) {
+        write_record(&batch[i].record);
+    }
+    if (taken > 0) {
+        fflush(stdout);
+        fflush(stderr);
+    }
+    return taken;
+}
+
+static void *flusher_main(void *arg) {
+    (void)arg;
+    struct timespec idle = {0, LOG_IDLE_SLEEP_NS};
+
+    while (!atomic_load(&stopping)) {
+        if (drain_rings() == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    while (drain_rings() > 0) {
+    }
+    return NULL;
+}
+
+void log_start(void) {
+    atomic_store(&stopping, false);
+    atomic_store(&running, true);
+    if (pthread_create(&flusher, NULL, flusher_main, NULL) != 0) {
+        atomic_store(&running, false);
+        fprintf(stderr, "[Server] Failed to start log flusher; logging synchronously\n");
+    }
+}
+
+/*
+ * Waits for the flusher to write out every ring. Only call this once the
+ * threads that own rings have stopped logging.
+ */
+void log_stop(void) {
+    if (!atomic_load(&running)) {
+        return;
+    }
+    atomic_store(&stopping, true);
+    pthread_join(flusher, NULL);
+    atomic_store(&running, false);
+    fflush(stdout);
+}
+
+void log_register_thread(void) {
+    if (thread_ring || !atomic_load(&running)) {
+        return;
+    }
+
+    LogRing *ring = aligned_alloc(alignof(LogRing), sizeof(LogRing));
+    if (!ring) {
+        return;
+    }
+    memset(ring, 0, sizeof(LogRing));
+
+    pthread_mutex_lock(&register_lock);
+    int index = atomic_load(&ring_count);
+    if (index < LOG_MAX_RINGS) {
+        rings[index] = ring;
+        atomic_store_explicit(&ring_count, index + 1, memory_order_release);
+        thread_ring = ring;
+    }
+    pthread_mutex_unlock(&register_lock);
+
+    if (!thread_ring) {
+        free(ring);
+    }
+}
+
+int log_parse_level(const char *name, LogLevel *level) {
+    static const char *const names[] = {"debug", "info", "warn", "error"};
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *level = (LogLevel)i;
+            return 0;
+        }
+    }
+    return -1;
+}
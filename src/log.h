@@ -0,0 +1,65 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <errno.h>
+#include <stdint.h>
+
+typedef enum {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+} LogLevel;
+
+#define LOG_MAX_ARGS 4
+
+/*
+ * One log line as the hot path leaves it: a static format string and its
+ * integer arguments, formatted later on the flusher thread. A perror()-style
+ * record has `with_errno` set and carries the errno in `error`.
+ */
+typedef struct {
+    uint64_t timestamp_ns;
+    const char *format;
+    int32_t args[LOG_MAX_ARGS];
+    int16_t level;
+    int16_t with_errno;
+    int32_t error;
+} LogRecord;
+
+extern LogLevel log_level;
+
+/*
+ * log_start() spawns the flusher; each thread that logs on a hot path then
+ * calls log_register_thread() to get its own ring. Threads without a ring,
+ * and every thread before log_start() or after log_stop(), write through
+ * synchronously.
+ */
+void log_start(void);
+void log_stop(void);
+void log_register_thread(void);
+int log_parse_level(const char *name, LogLevel *level);
+
+void log_push(int level, int with_errno, int error, const char *format, int count, ...) __attribute__((format(printf, 4, 6)));
+
+#define LOG_NARGS(...) (int)(sizeof((int[]){0, ##__VA_ARGS__}) / sizeof(int) - 1)
+
+/* Format arguments must be ints; at most LOG_MAX_ARGS of them. */
+#define LOG(level, format, ...) \
+    do { \
+        if ((level) >= log_level) { \
+            _Static_assert(LOG_NARGS(__VA_ARGS__) <= LOG_MAX_ARGS, "too many log arguments"); \
+            log_push((level), 0, 0, format "\n", LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+/* Like perror(): the message, ": " and the text for the current errno. */
+#define LOG_ERRNO(level, message) \
+    do { \
+        int saved_errno_ = errno; \
+        if ((level) >= log_level) { \
+            log_push((level), 1, saved_errno_, message, 0); \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+static const char *const packet_names[METRICS_PACKET_KINDS] = {
+    [PACKET_UNKNOWN] = "other",
+    [PACKET_BEGIN] = "B",
+    [PACKET_INITIALIZE] = "I",
+    [PACKET_SHOOT] = "S",
+    [PACKET_QUERY] = "Q",
+    [PACKET_FORFEIT] = "F",
+    [PACKET_RESUME] = "C",
+    [PACKET_WATCH] = "W"
+};
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_record_packet(Metrics *metrics, PacketType type, uint64_t elapsed_ns) {
+    metric_add(&metrics->packets[type], 1);
+    metric_add(&metrics->latency[type].buckets[latency_bucket(elapsed_ns)], 1);
+}
+
+void metrics_record_error(Metrics *metrics, int code) {
+    if (code >= 0 && code < METRICS_MAX_ERROR_CODE) {
+        metric_add(&metrics->errors[code], 1);
+    }
+}
+
+typedef struct {
+    char *out;
+    size_t size;
+    size_t length;
+} Writer;
+
+static void emit(Writer *writer, const char *format, ...) {
+    if (writer->length >= writer->size) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(writer->out + writer->length, writer->size - writer->length, format, args);
+    va_end(args);
+    if (written > 0) {
+        writer->length += (size_t)written;
+        if (writer->length > writer->size) {
+            writer->length = writer->size;
+        }
+    }
+}
+
+/* Sums one counter over every worker; `offset` locates it within Metrics. */
+static uint64_t sum_counter(Metrics *const *per_worker, int count, size_t offset) {
+    uint64_t total = 0;
+    for (int w = 0; w < count; w++) {
+        total += metric_read((const _Atomic uint64_t *)((const char *)per_worker[w] + offset));
+    }
+    return total;
+}
+
+#define SUM(field) sum_counter(per_worker, count, (size_t)((const char *)&per_worker[0]->field - (const char *)per_worker[0]))
+
+size_t metrics_format(Metrics *const *per_worker, int count, const AdmissionMetrics *admission,
+                      char *out, size_t size) {
+    Writer writer = {out, size, 0};
+    const double quantiles[] = {0.5, 0.99, 0.999};
+
+    uint64_t started = SUM(sessions_started);
+    uint64_t finished = SUM(sessions_finished);
+    emit(&writer, "sessions_active %llu\n", (unsigned long long)(started - finished));
+    emit(&writer, "sessions_started_total %llu\n", (unsigned long long)started);
+    emit(&writer, "sessions_stolen_total %llu\n", (unsigned long long)SUM(sessions_stolen));
+    emit(&writer, "turns_total %llu\n", (unsigned long long)SUM(turns));
+    emit(&writer, "bytes_in_total %llu\n", (unsigned long long)SUM(bytes_in));
+    emit(&writer, "bytes_out_total %llu\n", (unsigned long long)SUM(bytes_out));
+    emit(&writer, "io_syscalls_total %llu\n", (unsigned long long)SUM(io_syscalls));
+    emit(&writer, "sessions_waiting %llu\n", (unsigned long long)metric_read(&admission->sessions_waiting));
+    emit(&writer, "sessions_queued_total %llu\n", (unsigned long long)metric_read(&admission->sessions_queued));
+    emit(&writer, "sessions_shed_total %llu\n", (unsigned long long)metric_read(&admission->sessions_shed));
+    emit(&writer, "connections_refused_total %llu\n", (unsigned long long)metric_read(&admission->connections_refused));
+    emit(&writer, "packets_throttled_total %llu\n", (unsigned long long)SUM(packets_throttled));
+    emit(&writer, "idle_timeouts_total %llu\n", (unsigned long long)SUM(idle_timeouts));
+    emit(&writer, "turn_timeouts_total %llu\n", (unsigned long long)SUM(turn_timeouts));
+    emit(&writer, "spectators_watching %llu\n",
+         (unsigned long long)(SUM(spectators_attached) - SUM(spectators_detached)));
+    emit(&writer, "spectators_dropped_total %llu\n", (unsigned long long)SUM(spectators_dropped));
+    emit(&writer, "spectator_events_total %llu\n", (unsigned long long)SUM(spectator_events));
+    emit(&writer, "spectator_bytes_out_total %llu\n", (unsigned long long)SUM(spectator_bytes_out));
+    emit(&writer, "ai_sessions_started_total %llu\n", (unsigned long long)SUM(ai_sessions_started));
+    emit(&writer, "ai_moves_total %llu\n", (unsigned long long)SUM(ai_moves));
+    emit(&writer, "ai_move_seconds_total %.6f\n", SUM(ai_move_ns) / 1e9);
+
+    for (int type = 0; type < METRICS_PACKET_KINDS; type++) {
+        uint64_t packets = SUM(packets[type]);
+        emit(&writer, "packets_total{type=\"%s\"} %llu\n", packet_names[type], (unsigned long long)packets);
+        if (packets == 0) {
+            continue;
+        }
+
+        uint64_t merged[LATENCY_BUCKETS];
+        uint64_t recorded = 0;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+            merged[bucket] = SUM(latency[type].buckets[bucket]);
+            recorded += merged[bucket];
+        }
+
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            uint64_t rank = (uint64_t)(quantiles[q] * recorded);
+            uint64_t seen = 0;
+            int bucket = 0;
+            while (bucket < LATENCY_BUCKETS - 1 && (seen += merged[bucket]) <= rank) {
+                bucket++;
+            }
+            emit(&writer, "packet_latency_us{type=\"%s\",quantile=\"%g\"} %.1f\n",
+                 packet_names[type], quantiles[q], bucket_limit(bucket) / 1e3);
+        }
+    }
+
+    for (int code = 0; code < METRICS_MAX_ERROR_CODE; code++) {
+        uint64_t errors = SUM(errors[code]);
+        if (errors) {
+            emit(&writer, "errors_total{code=\"%d\"} %llu\n", code, (unsigned long long)errors);
+        }
+    }
+
+    for (int w = 0; w < count; w++) {
+        uint64_t packets = 0;
+        for (int type = 0; type < METRICS_PACKET_KINDS; type++) {
+            packets += metric_read(&per_worker[w]->packets[type]);
+        }
+        emit(&writer, "worker_packets_total{worker=\"%d\"} %llu\n", w, (unsigned long long)packets);
+        emit(&writer, "worker_busy_seconds_total{worker=\"%d\"} %.3f\n", w, metric_read(&per_worker[w]->busy_ns) / 1e9);
+    }
+
+    return writer.length;
+}
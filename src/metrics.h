@@ -0,0 +1,110 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+#define METRICS_PACKET_KINDS (PACKET_WATCH + 1)
+#define METRICS_MAX_ERROR_CODE 512
+
+/* 16 sub-buckets per power of two of nanoseconds: about 6% resolution. */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_BUCKETS (64 << LATENCY_SUB_BITS)
+
+/* Shared with the load generator, so both report percentiles the same way. */
+static inline int latency_bucket(uint64_t ns) {
+    if (ns < (1u << LATENCY_SUB_BITS)) {
+        return (int)ns;
+    }
+    int exponent = 63 - __builtin_clzll(ns);
+    int sub = (int)(ns >> (exponent - LATENCY_SUB_BITS)) & ((1 << LATENCY_SUB_BITS) - 1);
+    return ((exponent - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+/* Upper bound of a bucket, so percentiles never under-report. */
+static inline uint64_t bucket_limit(int bucket) {
+    if (bucket < (1 << LATENCY_SUB_BITS)) {
+        return (uint64_t)bucket;
+    }
+    int exponent = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << LATENCY_SUB_BITS) - 1);
+    return ((1ull << LATENCY_SUB_BITS | sub) + 1) << (exponent - LATENCY_SUB_BITS);
+}
+
+typedef struct {
+    _Atomic uint64_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+/*
+ * Counters for one worker. Only the owning worker writes them, so an update
+ * is a relaxed load and store with no locked instruction; the metrics
+ * endpoint sums every worker's copy with relaxed loads and may see a packet
+ * counted a moment before its latency.
+ */
+typedef struct {
+    alignas(64) _Atomic uint64_t packets[METRICS_PACKET_KINDS];
+    _Atomic uint64_t errors[METRICS_MAX_ERROR_CODE];
+    _Atomic uint64_t sessions_started;
+    _Atomic uint64_t sessions_finished;
+    _Atomic uint64_t sessions_stolen;
+    _Atomic uint64_t turns;
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t packets_throttled;
+    _Atomic uint64_t idle_timeouts;
+    _Atomic uint64_t turn_timeouts;
+    _Atomic uint64_t spectators_attached;
+    _Atomic uint64_t spectators_detached;
+    /* Spectators cut off because their queue of events filled up. */
+    _Atomic uint64_t spectators_dropped;
+    _Atomic uint64_t spectator_events;
+    _Atomic uint64_t spectator_bytes_out;
+    /* Games against the built-in AI, its moves and the time spent choosing them. */
+    _Atomic uint64_t ai_sessions_started;
+    _Atomic uint64_t ai_moves;
+    _Atomic uint64_t ai_move_ns;
+    /* Calls made to wait for, read and write player connections. */
+    _Atomic uint64_t io_syscalls;
+    /* Time spent handling events rather than waiting for them. */
+    _Atomic uint64_t busy_ns;
+    LatencyHistogram latency[METRICS_PACKET_KINDS];
+} Metrics;
+
+/* What the acceptor decided about new players; only it writes these. */
+typedef struct {
+    _Atomic uint64_t sessions_waiting;
+    _Atomic uint64_t sessions_queued;
+    _Atomic uint64_t sessions_shed;
+    _Atomic uint64_t connections_refused;
+} AdmissionMetrics;
+
+static inline void metric_add(_Atomic uint64_t *counter, uint64_t amount) {
+    uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, value + amount, memory_order_relaxed);
+}
+
+static inline uint64_t metric_read(const _Atomic uint64_t *counter) {
+    return atomic_load_explicit((_Atomic uint64_t *)counter, memory_order_relaxed);
+}
+
+uint64_t metrics_now_ns(void);
+void metrics_record_packet(Metrics *metrics, PacketType type, uint64_t elapsed_ns);
+void metrics_record_error(Metrics *metrics, int code);
+
+static inline void metric_set(_Atomic uint64_t *gauge, uint64_t value) {
+    atomic_store_explicit(gauge, value, memory_order_relaxed);
+}
+
+/*
+ * Writes the totals over `count` workers, and the admission counters, in the
+ * Prometheus text format, one sample per line, and returns the length
+ * (truncated to fit `size`).
+ */
+size_t metrics_format(Metrics *const *per_worker, int count, const AdmissionMetrics *admission,
+                      char *out, size_t size);
+
+#endif
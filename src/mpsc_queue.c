@@ -0,0 +1,49 @@
+#include <stddef.h>
+
+#include "mpsc_queue.h"
+
+void mpsc_init(MpscQueue *queue) {
+    atomic_store_explicit(&queue->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, &queue->stub, memory_order_relaxed);
+    queue->tail = &queue->stub;
+}
+
+void mpsc_push(MpscQueue *queue, MpscNode *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    MpscNode *previous = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&previous->next, node, memory_order_release);
+}
+
+MpscNode *mpsc_pop(MpscQueue *queue) {
+    MpscNode *tail = queue->tail;
+    MpscNode *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    /* The stub stands in for an empty queue; step past it. */
+    if (tail == &queue->stub) {
+        if (!next) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+
+    /* `tail` is the last node unless a push is still linking one after it. */
+    if (tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return NULL;
+    }
+
+    /* Re-queue the stub behind it so `tail` can be handed out. */
+    mpsc_push(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stdatomic.h>
+
+/* Embedded in whatever is queued, so pushing never allocates. */
+typedef struct MpscNode {
+    _Atomic(struct MpscNode *) next;
+} MpscNode;
+
+/*
+ * An unbounded queue any number of threads push to without locks, each push
+ * one atomic exchange, and one thread pops from, oldest first. A push that
+ * has swapped itself in but not yet linked the node before it hides that
+ * node and those after it for a moment, so the popping thread must be told
+ * about every push once it completes and retry then, not spin.
+ */
+typedef struct {
+    _Atomic(MpscNode *) head;
+    MpscNode *tail;
+    MpscNode stub;
+} MpscQueue;
+
+void mpsc_init(MpscQueue *queue);
+void mpsc_push(MpscQueue *queue, MpscNode *node);
+/* The oldest node, or NULL if the queue is empty or a push is still linking. */
+MpscNode *mpsc_pop(MpscQueue *queue);
+
+#endif
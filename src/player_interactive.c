@@ -7,6 +7,7 @@
 
 #define PORT1 2201
 #define PORT2 2202
+#define PORT_LOBBY 2200
 #define BUFFER_SIZE 1024
 
 void getInput(char* prompt, char* buffer) {
@@ -15,8 +16,8 @@ void getInput(char* prompt, char* buffer) {
 }
 
 int main() {
-    char player_number[2];
-    getInput("Which player are you? (1 or 2)", player_number);
+    char player_number[BUFFER_SIZE];
+    getInput("Which player are you? (1 or 2, or L to be paired through the lobby)", player_number);
     int client_fd = 0;
     struct sockaddr_in serv_addr;
     char buffer[BUFFER_SIZE] = {0};
@@ -28,7 +29,7 @@ int main() {
     }
 
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(player_number[0]=='1' ? PORT1 : PORT2);
+    serv_addr.sin_port = htons(player_number[0]=='1' ? PORT1 : player_number[0]=='2' ? PORT2 : PORT_LOBBY);
 
     // Convert IPv4 and IPv6 addresses from text to binary form
     if (inet_pton(AF_INET, "127.0.0.1", &serv_addr.sin_addr) <= 0) {
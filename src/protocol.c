@@ -0,0 +1,367 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "protocol.h"
+
+static inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static PacketType packet_type(char letter) {
+    switch (letter) {
+    case 'B': return PACKET_BEGIN;
+    case 'I': return PACKET_INITIALIZE;
+    case 'S': return PACKET_SHOOT;
+    case 'Q': return PACKET_QUERY;
+    case 'F': return PACKET_FORFEIT;
+    case 'C': return PACKET_RESUME;
+    case 'W': return PACKET_WATCH;
+    default: return PACKET_UNKNOWN;
+    }
+}
+
+/*
+ * Scans the token starting at *cursor and advances past it. Returns true and
+ * stores the value if the whole token is an optionally signed decimal that
+ * fits in an int.
+ */
+static bool scan_token(const char **cursor, int *value) {
+    const char *p = *cursor;
+    bool negative = false;
+    bool valid = true;
+    long long magnitude = 0;
+
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+
+    const char *digits = p;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        magnitude = magnitude * 10 + (*p - '0');
+        if (magnitude > (long long)INT_MAX + 1) {
+            valid = false;
+            magnitude = 0;
+        }
+    }
+
+    if (p == digits || (!negative && magnitude > INT_MAX)) {
+        valid = false;
+    }
+
+    while (*p != '\0' && !is_space(*p)) {
+        valid = false;
+        p++;
+    }
+
+    *cursor = p;
+    if (valid) {
+        *value = (int)(negative ? -magnitude : magnitude);
+    }
+    return valid;
+}
+
+void scan_packet(const char *buffer, Packet *packet) {
+    packet->type = packet_type(buffer[0]);
+    packet->bare = buffer[0] != '\0' && (buffer[1] == '\0' || (buffer[1] == '\n' && buffer[2] == '\0'));
+    packet->spaced = buffer[0] != '\0' && buffer[1] == ' ';
+    packet->trailing_space = false;
+    packet->tokens = 0;
+    packet->integers = 0;
+
+    if (buffer[0] == '\0') {
+        return;
+    }
+
+    bool leading_integers = true;
+    const char *p = buffer + 1;
+    for (;;) {
+        while (is_space(*p)) {
+            packet->trailing_space = true;
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        packet->trailing_space = false;
+        int value = 0;
+        bool is_integer = scan_token(&p, &value);
+
+        if (leading_integers && is_integer) {
+            if (packet->integers < PACKET_MAX_VALUES) {
+                packet->values[packet->integers] = value;
+            }
+            packet->integers++;
+        } else {
+            leading_integers = false;
+        }
+        packet->tokens++;
+    }
+}
+
+size_t binary_record_size(uint8_t type) {
+    switch (type) {
+    case BINARY_TYPE('B'): return 9;
+    case BINARY_TYPE('I'): return BINARY_RECORD_MAX;
+    case BINARY_TYPE('S'): return 9;
+    case BINARY_TYPE('D'): return 5;
+    case BINARY_TYPE('C'): return 5;
+    default: return 1;
+    }
+}
+
+static inline uint32_t read_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Fields past INT_MAX are clamped, so they fail validation instead of wrapping. */
+static inline int read_int(const uint8_t *p) {
+    uint32_t value = read_u32(p);
+    return value > INT_MAX ? INT_MAX : (int)value;
+}
+
+static inline char *write_u16(char *out, int value) {
+    out[0] = (char)(value & 0xff);
+    out[1] = (char)((value >> 8) & 0xff);
+    return out + 2;
+}
+
+static inline char *write_u32(char *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (char)((value >> (8 * i)) & 0xff);
+    }
+    return out + 4;
+}
+
+/*
+ * Decodes one record of binary_record_size() bytes into the Packet the text
+ * scanner would produce for the same request, so handlers never need to know
+ * which encoding a client uses.
+ */
+void decode_binary_record(const uint8_t *record, Packet *packet) {
+    packet->type = (record[0] & BINARY_FLAG) ? packet_type((char)(record[0] & ~BINARY_FLAG)) : PACKET_UNKNOWN;
+    packet->bare = true;
+    packet->spaced = false;
+    packet->trailing_space = false;
+    packet->tokens = 0;
+    packet->integers = 0;
+
+    int fields = 0;
+    switch (packet->type) {
+    case PACKET_BEGIN:
+        packet->values[0] = read_int(record + 1);
+        packet->values[1] = read_int(record + 5);
+        /* Player 2 sends no dimensions; zeroes stand for a bare "B". */
+        fields = packet->values[0] || packet->values[1] ? 2 : 0;
+        break;
+    case PACKET_INITIALIZE:
+        for (int piece = 0; piece < 5; piece++) {
+            const uint8_t *entry = record + 1 + piece * 10;
+            packet->values[piece * 4] = entry[0];
+            packet->values[piece * 4 + 1] = entry[1];
+            packet->values[piece * 4 + 2] = read_int(entry + 2);
+            packet->values[piece * 4 + 3] = read_int(entry + 6);
+        }
+        fields = 20;
+        break;
+    case PACKET_SHOOT:
+        packet->values[0] = read_int(record + 1);
+        packet->values[1] = read_int(record + 5);
+        fields = 2;
+        break;
+    case PACKET_RESUME:
+        packet->values[0] = read_int(record + 1);
+        fields = 1;
+        break;
+    default:
+        if (record[0] == BINARY_TYPE('D')) {
+            packet->type = PACKET_QUERY;
+            packet->values[0] = read_int(record + 1);
+            fields = 1;
+        }
+        break;
+    }
+
+    if (fields > 0) {
+        packet->bare = false;
+        packet->spaced = true;
+        packet->tokens = fields;
+        packet->integers = fields;
+    }
+}
+
+bool output_reserve(OutputBuffer *out, size_t extra) {
+    if (out->capacity - out->length >= extra) {
+        return true;
+    }
+
+    size_t grown = out->capacity ? out->capacity : 1024;
+    while (grown - out->length < extra) {
+        grown *= 2;
+    }
+
+    char *resized = realloc(out->data, grown);
+    if (!resized) {
+        return false;
+    }
+    out->data = resized;
+    out->capacity = grown;
+    return true;
+}
+
+void output_consume(OutputBuffer *out, size_t count) {
+    memmove(out->data, out->data + count, out->length - count);
+    out->length -= count;
+}
+
+void output_free(OutputBuffer *out) {
+    free(out->data);
+    out->data = NULL;
+    out->length = 0;
+    out->capacity = 0;
+}
+
+static char *append_int(char *out, int value) {
+    char digits[12];
+    int count = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0) {
+        *out++ = '-';
+    }
+    while (count) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+/* Longest text entry: " H " plus two ints and the space between them. */
+#define TEXT_ENTRY_MAX (3 + 11 + 1 + 11)
+/* Longest fixed part of any text reply, terminator included. */
+#define TEXT_HEADER_MAX 32
+
+static char *encode_text_reply(const Reply *reply, char *p, char *limit) {
+    switch (reply->type) {
+    case REPLY_ACCEPT:
+        *p++ = 'A';
+        break;
+    case REPLY_ERROR:
+        *p++ = 'E';
+        *p++ = ' ';
+        p = append_int(p, reply->value);
+        break;
+    case REPLY_SHOT:
+        *p++ = 'R';
+        *p++ = ' ';
+        p = append_int(p, reply->value);
+        *p++ = ' ';
+        *p++ = reply->shot;
+        break;
+    case REPLY_HALT:
+        *p++ = 'H';
+        *p++ = ' ';
+        *p++ = reply->value ? '1' : '0';
+        break;
+    case REPLY_QUERY:
+        *p++ = 'G';
+        *p++ = ' ';
+        p = append_int(p, reply->value);
+        for (size_t i = 0; i < reply->shot_count; i++) {
+            const ShotEntry *shot = &reply->shots[i];
+            if (limit && limit - p < TEXT_ENTRY_MAX) {
+                /* Only whole entries, checked exactly near the cap. */
+                char entry[TEXT_ENTRY_MAX];
+                char *e = entry;
+                *e++ = ' ';
+                *e++ = shot->result;
+                *e++ = ' ';
+                e = append_int(e, shot->row);
+                *e++ = ' ';
+                e = append_int(e, shot->col);
+                if (e - entry > limit - p) {
+                    break;
+                }
+                memcpy(p, entry, e - entry);
+                p += e - entry;
+                continue;
+            }
+            *p++ = ' ';
+            *p++ = shot->result;
+            *p++ = ' ';
+            p = append_int(p, shot->row);
+            *p++ = ' ';
+            p = append_int(p, shot->col);
+        }
+        break;
+    }
+    return p;
+}
+
+static char *encode_binary_reply(const Reply *reply, char *p) {
+    switch (reply->type) {
+    case REPLY_ACCEPT:
+        *p++ = (char)BINARY_TYPE('A');
+        break;
+    case REPLY_ERROR:
+        *p++ = (char)BINARY_TYPE('E');
+        p = write_u16(p, reply->value);
+        break;
+    case REPLY_SHOT:
+        *p++ = (char)BINARY_TYPE('R');
+        *p++ = (char)reply->value;
+        *p++ = reply->shot;
+        break;
+    case REPLY_HALT:
+        *p++ = (char)BINARY_TYPE('H');
+        *p++ = (char)(reply->value ? 1 : 0);
+        break;
+    case REPLY_QUERY:
+        *p++ = (char)BINARY_TYPE('G');
+        *p++ = (char)reply->value;
+        p = write_u32(p, (uint32_t)reply->shot_count);
+        for (size_t i = 0; i < reply->shot_count; i++) {
+            *p++ = reply->shots[i].result;
+            p = write_u32(p, (uint32_t)reply->shots[i].row);
+            p = write_u32(p, (uint32_t)reply->shots[i].col);
+        }
+        break;
+    }
+    return p;
+}
+
+/*
+ * Appends the reply in the connection's format. Space for the worst case is
+ * reserved up front, so the encoders write through a plain cursor.
+ */
+bool encode_reply(const Reply *reply, WireFormat format, OutputBuffer *out) {
+    size_t entries = reply->type == REPLY_QUERY ? reply->shot_count : 0;
+    size_t worst = format == WIRE_BINARY ? 6 + entries * 9 : TEXT_HEADER_MAX + entries * TEXT_ENTRY_MAX;
+
+    if (format == WIRE_LEGACY && worst > LEGACY_REPLY_MAX) {
+        worst = LEGACY_REPLY_MAX;
+    }
+    if (!output_reserve(out, worst)) {
+        return false;
+    }
+
+    char *start = out->data + out->length;
+    char *end;
+    if (format == WIRE_BINARY) {
+        end = encode_binary_reply(reply, start);
+    } else {
+        end = encode_text_reply(reply, start, format == WIRE_LEGACY ? start + LEGACY_REPLY_MAX : NULL);
+        if (format == WIRE_TEXT) {
+            *end++ = '\n';
+        }
+    }
+
+    out->length += end - start;
+    return true;
+}
@@ -0,0 +1,127 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "board.h"
+
+#define PACKET_MAX_VALUES 20
+
+/*
+ * How a connection talks. A legacy client sends one unterminated text packet
+ * per write; a text client terminates every packet with '\n'; a binary client
+ * sends fixed-size records. The first byte a client sends decides between
+ * binary and text, and a text client is legacy until it sends a newline.
+ */
+typedef enum {
+    WIRE_LEGACY,
+    WIRE_TEXT,
+    WIRE_BINARY
+} WireFormat;
+
+/*
+ * Binary records start with the packet letter with its high bit set, followed
+ * by little-endian fields:
+ *
+ *   B  width u32, height u32 (both 0 from Player 2)
+ *   I  5 x {piece u8, rotation u8, row u32, col u32}
+ *   S  row u32, col u32
+ *   D  since u32
+ *   C  session u32
+ *   Q  F  no fields
+ *
+ * and replies:
+ *
+ *   A  no fields
+ *   E  code u16
+ *   R  ships_remaining u8, result u8 ('H' or 'M')
+ *   H  won u8
+ *   G  ships_remaining u8, count u32, count x {result u8, row u32, col u32}
+ *
+ * D is the binary form of the text query "Q <since>". Board dimensions and
+ * coordinates are u32 like the counts, so they cover any board a text client
+ * could ask for; a value past INT_MAX reads as INT_MAX and is refused as out
+ * of range.
+ */
+#define BINARY_FLAG 0x80
+#define BINARY_TYPE(letter) ((uint8_t)(BINARY_FLAG | (letter)))
+#define BINARY_RECORD_MAX 51
+
+typedef enum {
+    PACKET_UNKNOWN,
+    PACKET_BEGIN,
+    PACKET_INITIALIZE,
+    PACKET_SHOOT,
+    PACKET_QUERY,
+    PACKET_FORFEIT,
+    PACKET_RESUME,
+    PACKET_WATCH
+} PacketType;
+
+/*
+ * One packet as seen by a single left-to-right pass over the buffer. The
+ * leading letter picks `type`; everything after it is split on whitespace.
+ *
+ * `bare` means the letter stood alone (optionally followed by one '\n'),
+ * `spaced` means it was followed by a space. `tokens` counts every token,
+ * `integers` counts the leading run of tokens that are whole decimal ints
+ * and the first PACKET_MAX_VALUES of those land in `values`. `trailing_space`
+ * is set when whitespace follows the last token.
+ */
+typedef struct {
+    PacketType type;
+    bool bare;
+    bool spaced;
+    bool trailing_space;
+    int tokens;
+    int integers;
+    int values[PACKET_MAX_VALUES];
+} Packet;
+
+typedef enum {
+    REPLY_ACCEPT,
+    REPLY_ERROR,
+    REPLY_SHOT,
+    REPLY_QUERY,
+    REPLY_HALT
+} ReplyType;
+
+/*
+ * A reply as the game logic produces it, independent of the wire format.
+ * `value` is the error code, the ships remaining or, for a halt, 1 if the
+ * receiver won. A query reply lists the `shot_count` entries of `shots`.
+ */
+typedef struct {
+    ReplyType type;
+    int value;
+    char shot;
+    const ShotEntry *shots;
+    size_t shot_count;
+} Reply;
+
+/*
+ * A legacy client reads each reply with a single 1 KB read, so its query
+ * replies stop at the last whole entry that fits.
+ */
+#define LEGACY_REPLY_MAX 1023
+
+/* Bytes waiting to be sent; encoders append at `length`. */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} OutputBuffer;
+
+bool output_reserve(OutputBuffer *out, size_t extra);
+void output_consume(OutputBuffer *out, size_t count);
+void output_free(OutputBuffer *out);
+
+void scan_packet(const char *buffer, Packet *packet);
+
+size_t binary_record_size(uint8_t type);
+void decode_binary_record(const uint8_t *record, Packet *packet);
+bool encode_reply(const Reply *reply, WireFormat format, OutputBuffer *out);
+
+#endif
@@ -0,0 +1,362 @@
+/*
+ * Plays whole games against the engine in-process, with no sockets, for
+ * strategy tuning and load modelling. Every thread plays its share of the
+ * games with its own bots and arena pool and only the totals are shared.
+ *
+ *   gcc -O2 -pthread -o selfplay src/selfplay.c src/ai.c src/engine.c src/board.c src/protocol.c
+ *   ./selfplay [--games N] [--threads N] [--size WxH] [--board dense|bitboard|sparse]
+ *              [--p1 random|hunt|density] [--p2 random|hunt|density] [--seed N]
+ *
+ * A density bot is the server's built-in AI opponent.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ai.h"
+#include "board.h"
+#include "engine.h"
+#include "protocol.h"
+
+
+typedef enum {
+    STRATEGY_RANDOM,
+    STRATEGY_HUNT,
+    STRATEGY_DENSITY
+} Strategy;
+
+typedef struct {
+    long games;
+    int threads;
+    int width;
+    int height;
+    BoardKind kind;
+    Strategy strategies[2];
+    uint64_t seed;
+} Options;
+
+/*
+ * One player's view of the game. `order` holds every cell in the order the
+ * bot will try them; a hunting bot puts one parity colour first, since every
+ * piece covers both colours, and chases the neighbours of each hit through
+ * `stack` before going back to the list.
+ */
+typedef struct {
+    Strategy strategy;
+    int width;
+    int height;
+    int *order;
+    int next;
+    int *stack;
+    int stack_count;
+    bool *tried;
+    int last_target;
+    AiPlayer ai;
+} Bot;
+
+typedef struct {
+    const Options *options;
+    int id;
+    long games;
+    unsigned long turns;
+    unsigned long rejected;
+    unsigned long wins[2];
+} Runner;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Packet make_packet(PacketType type, int count, const int *values) {
+    Packet packet = {.type = type, .bare = count == 0, .spaced = count > 0,
+                     .tokens = count, .integers = count};
+    memcpy(packet.values, values, count * sizeof(int));
+    return packet;
+}
+
+static bool bot_init(Bot *bot, Strategy strategy, int width, int height, uint64_t *rng) {
+    size_t cells = (size_t)width * height;
+    bot->strategy = strategy;
+    bot->width = width;
+    bot->height = height;
+    bot->order = malloc(cells * sizeof(int));
+    bot->stack = malloc(4 * cells * sizeof(int));
+    bot->tried = malloc(cells * sizeof(bool));
+    bot->ai.shot = NULL;
+    if (strategy == STRATEGY_DENSITY && !ai_init(&bot->ai, width, height, next_random(rng))) {
+        return false;
+    }
+    return bot->order && bot->stack && bot->tried;
+}
+
+static void bot_free(Bot *bot) {
+    free(bot->order);
+    free(bot->stack);
+    free(bot->tried);
+    ai_free(&bot->ai);
+}
+
+static void bot_new_game(Bot *bot, uint64_t *rng) {
+    int cells = bot->width * bot->height;
+    int count = 0;
+
+    /* Parity cells first for a hunter, then the rest; each part shuffled. */
+    for (int pass = 0; pass < 2; pass++) {
+        int start = count;
+        for (int cell = 0; cell < cells; cell++) {
+            int parity = (cell / bot->width + cell % bot->width) & 1;
+            if (bot->strategy == STRATEGY_RANDOM ? pass == 0 : parity == pass) {
+                bot->order[count++] = cell;
+            }
+        }
+        for (int i = count - 1; i > start; i--) {
+            int j = start + random_below(rng, i - start + 1);
+            int swap = bot->order[i];
+            bot->order[i] = bot->order[j];
+            bot->order[j] = swap;
+        }
+    }
+
+    memset(bot->tried, 0, cells * sizeof(bool));
+    bot->next = 0;
+    bot->stack_count = 0;
+    if (bot->strategy == STRATEGY_DENSITY) {
+        ai_reset(&bot->ai);
+    }
+}
+
+static int bot_choose(Bot *bot) {
+    if (bot->strategy == STRATEGY_DENSITY) {
+        int row, col;
+        ai_choose(&bot->ai, &row, &col);
+        return bot->last_target = row * bot->width + col;
+    }
+    while (bot->stack_count > 0) {
+        int cell = bot->stack[--bot->stack_count];
+        if (!bot->tried[cell]) {
+            return bot->last_target = cell;
+        }
+    }
+    while (bot->tried[bot->order[bot->next]]) {
+        bot->next++;
+    }
+    return bot->last_target = bot->order[bot->next];
+}
+
+static void bot_learn(Bot *bot, const Reply *reply) {
+    int cell = bot->last_target;
+    bot->tried[cell] = true;
+    if (bot->strategy == STRATEGY_DENSITY && reply->type == REPLY_SHOT) {
+        ai_learn(&bot->ai, cell / bot->width, cell % bot->width, reply->shot, reply->value);
+        return;
+    }
+    if (bot->strategy != STRATEGY_HUNT || reply->type != REPLY_SHOT || reply->shot != 'H') {
+        return;
+    }
+
+    int row = cell / bot->width;
+    int col = cell % bot->width;
+    const int deltas[4][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    for (int d = 0; d < 4; d++) {
+        int r = row + deltas[d][0];
+        int c = col + deltas[d][1];
+        if (r >= 0 && r < bot->height && c >= 0 && c < bot->width && !bot->tried[r * bot->width + c]) {
+            bot->stack[bot->stack_count++] = r * bot->width + c;
+        }
+    }
+}
+
+static void apply_expecting(Runner *runner, Game *game, int player, const Packet *packet, GameStep *step) {
+    game_apply(game, player, packet, step);
+    if (step->has_reply[player] && step->replies[player].type == REPLY_ERROR) {
+        runner->rejected++;
+    }
+}
+
+static void play_game(Runner *runner, Game *game, ArenaPool *pool, Bot bots[2], Board *scratch, uint64_t *rng) {
+    const Options *options = runner->options;
+    GameStep step;
+    int values[PACKET_MAX_VALUES];
+
+    game_init(game, options->kind, pool);
+
+    int dimensions[2] = {options->width, options->height};
+    Packet begin = make_packet(PACKET_BEGIN, 2, dimensions);
+    apply_expecting(runner, game, 0, &begin, &step);
+    begin = make_packet(PACKET_BEGIN, 0, NULL);
+    apply_expecting(runner, game, 1, &begin, &step);
+
+    for (int p = 0; p < 2 && game->phase != PHASE_OVER; p++) {
+        random_fleet(scratch, rng, values);
+        Packet init = make_packet(PACKET_INITIALIZE, PACKET_MAX_VALUES, values);
+        apply_expecting(runner, game, p, &init, &step);
+        bot_new_game(&bots[p], rng);
+    }
+
+    while (game->phase == PHASE_TURN) {
+        int player = game->active;
+        int cell = bot_choose(&bots[player]);
+        int target[2] = {cell / options->width, cell % options->width};
+        Packet shot = make_packet(PACKET_SHOOT, 2, target);
+        apply_expecting(runner, game, player, &shot, &step);
+        bot_learn(&bots[player], &step.replies[player]);
+        runner->turns++;
+    }
+
+    if (game->phase == PHASE_HALT_LOSER_ACK) {
+        runner->wins[game->winner]++;
+    }
+
+    Packet ack = make_packet(PACKET_UNKNOWN, 0, NULL);
+    while (game->phase != PHASE_OVER) {
+        game_apply(game, game->active, &ack, &step);
+    }
+
+    game_release(game);
+}
+
+static void *runner_main(void *arg) {
+    Runner *runner = arg;
+    const Options *options = runner->options;
+    ArenaPool pool = {0};
+    Bot bots[2];
+    Game game;
+    uint64_t rng = options->seed * 0x9E3779B97F4A7C15ULL + runner->id + 1;
+
+    Board *scratch = create_board(board_kind_for(options->kind, options->width, options->height), options->width, options->height);
+    if (!scratch || !bot_init(&bots[0], options->strategies[0], options->width, options->height, &rng) ||
+        !bot_init(&bots[1], options->strategies[1], options->width, options->height, &rng)) {
+        fprintf(stderr, "[Selfplay] Runner %d failed to allocate\n", runner->id);
+        return NULL;
+    }
+
+    for (long g = 0; g < runner->games; g++) {
+        play_game(runner, &game, &pool, bots, scratch, &rng);
+    }
+
+    bot_free(&bots[0]);
+    bot_free(&bots[1]);
+    free_board(scratch);
+    arena_pool_clear(&pool);
+    return NULL;
+}
+
+static bool parse_strategy(const char *name, Strategy *strategy) {
+    if (strcmp(name, "random") == 0) {
+        *strategy = STRATEGY_RANDOM;
+    } else if (strcmp(name, "hunt") == 0) {
+        *strategy = STRATEGY_HUNT;
+    } else if (strcmp(name, "density") == 0) {
+        *strategy = STRATEGY_DENSITY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void parse_arguments(int argc, char **argv, Options *options) {
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = value != NULL;
+
+        if (ok && strcmp(argv[i], "--games") == 0) {
+            options->games = atol(value);
+            ok = options->games > 0;
+        } else if (ok && strcmp(argv[i], "--threads") == 0) {
+            options->threads = atoi(value);
+            ok = options->threads > 0;
+        } else if (ok && strcmp(argv[i], "--size") == 0) {
+            ok = sscanf(value, "%dx%d", &options->width, &options->height) == 2 &&
+                 options->width >= 10 && options->height >= 10;
+        } else if (ok && strcmp(argv[i], "--board") == 0) {
+            if (strcmp(value, "dense") == 0) {
+                options->kind = BOARD_DENSE;
+            } else if (strcmp(value, "bitboard") == 0) {
+                options->kind = BOARD_BITBOARD;
+            } else if (strcmp(value, "sparse") == 0) {
+                options->kind = BOARD_SPARSE;
+            } else {
+                ok = false;
+            }
+        } else if (ok && strcmp(argv[i], "--p1") == 0) {
+            ok = parse_strategy(value, &options->strategies[0]);
+        } else if (ok && strcmp(argv[i], "--p2") == 0) {
+            ok = parse_strategy(value, &options->strategies[1]);
+        } else if (ok && strcmp(argv[i], "--seed") == 0) {
+            options->seed = strtoull(value, NULL, 10);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Usage: %s [--games N] [--threads N] [--size WxH] [--board dense|bitboard|sparse] "
+                            "[--p1 random|hunt|density] [--p2 random|hunt|density] [--seed N]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        i++;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options = {
+        .games = 100000,
+        .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .width = 10,
+        .height = 10,
+        .kind = BOARD_DENSE,
+        .strategies = {STRATEGY_HUNT, STRATEGY_RANDOM},
+        .seed = 1
+    };
+    if (options.threads < 1) {
+        options.threads = 1;
+    }
+    parse_arguments(argc, argv, &options);
+
+    Runner *runners = calloc(options.threads, sizeof(Runner));
+    pthread_t *threads = calloc(options.threads, sizeof(pthread_t));
+    if (!runners || !threads) {
+        perror("[Selfplay] Failed to allocate runners");
+        return EXIT_FAILURE;
+    }
+
+    double start = now_seconds();
+    for (int t = 0; t < options.threads; t++) {
+        runners[t].options = &options;
+        runners[t].id = t;
+        runners[t].games = options.games / options.threads + (t < options.games % options.threads);
+        if (pthread_create(&threads[t], NULL, runner_main, &runners[t]) != 0) {
+            perror("[Selfplay] Failed to start runner");
+            return EXIT_FAILURE;
+        }
+    }
+
+    long games = 0;
+    unsigned long turns = 0, rejected = 0, wins[2] = {0, 0};
+    for (int t = 0; t < options.threads; t++) {
+        pthread_join(threads[t], NULL);
+        games += runners[t].games;
+        turns += runners[t].turns;
+        rejected += runners[t].rejected;
+        wins[0] += runners[t].wins[0];
+        wins[1] += runners[t].wins[1];
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("[Selfplay] %ld games on %dx%d boards, %d threads, %.2f s\n",
+           games, options.width, options.height, options.threads, elapsed);
+    printf("[Selfplay] %.0f games/sec, %.0f turns/sec, %.1f turns/game\n",
+           games / elapsed, turns / elapsed, games ? (double)turns / games : 0.0);
+    printf("[Selfplay] Player 1 won %lu (%.1f%%), Player 2 won %lu, %lu rejected packets\n",
+           wins[0], games ? 100.0 * wins[0] / games : 0.0, wins[1], rejected);
+
+    free(runners);
+    free(threads);
+    return rejected == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,85 @@
+#include "timer_wheel.h"
+
+#define TICK_NS (TIMER_TICK_MS * 1000000ull)
+
+static void link_timer(TimerWheel *wheel, Timer *timer) {
+    Timer *head = &wheel->slots[timer->tick & (TIMER_SLOTS - 1)];
+    timer->prev = head;
+    timer->next = head->next;
+    head->next->prev = timer;
+    head->next = timer;
+}
+
+static void unlink_timer(Timer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t now_ns) {
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        wheel->slots[i].prev = &wheel->slots[i];
+        wheel->slots[i].next = &wheel->slots[i];
+    }
+    wheel->tick = now_ns / TICK_NS;
+    wheel->pending = 0;
+}
+
+void timer_schedule(TimerWheel *wheel, Timer *timer, uint64_t deadline_ns) {
+    if (timer_pending(timer)) {
+        unlink_timer(timer);
+        wheel->pending--;
+    }
+
+    /* Rounded up, and never into a slot the wheel has already passed. */
+    uint64_t tick = (deadline_ns + TICK_NS - 1) / TICK_NS;
+    timer->tick = tick > wheel->tick ? tick : wheel->tick + 1;
+    link_timer(wheel, timer);
+    wheel->pending++;
+}
+
+void timer_cancel(TimerWheel *wheel, Timer *timer) {
+    if (timer_pending(timer)) {
+        unlink_timer(timer);
+        wheel->pending--;
+    }
+}
+
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ns, TimerFn fire, void *context) {
+    uint64_t now_tick = now_ns / TICK_NS;
+    if (now_tick <= wheel->tick) {
+        return;
+    }
+
+    /* After a long stall every slot is visited once, with all of them due. */
+    uint64_t first = now_tick - wheel->tick > TIMER_SLOTS ? now_tick - TIMER_SLOTS + 1 : wheel->tick + 1;
+    wheel->tick = now_tick;
+
+    for (uint64_t tick = first; tick <= now_tick && wheel->pending; tick++) {
+        Timer *head = &wheel->slots[tick & (TIMER_SLOTS - 1)];
+
+        /* Detach the slot first so timers fired here can reschedule freely. */
+        Timer due = {0};
+        due.next = head->next;
+        due.prev = head->prev;
+        if (due.next == head) {
+            continue;
+        }
+        due.next->prev = &due;
+        due.prev->next = &due;
+        head->next = head;
+        head->prev = head;
+
+        while (due.next != &due) {
+            Timer *timer = due.next;
+            unlink_timer(timer);
+            if (timer->tick <= now_tick) {
+                wheel->pending--;
+                fire(timer, context);
+            } else {
+                link_timer(wheel, timer);
+            }
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_TICK_MS 10
+#define TIMER_SLOTS 1024
+
+/*
+ * A timer is embedded in whatever it times, so scheduling never allocates.
+ * While pending it sits on the list of the slot its tick hashes to; a timer
+ * more than one turn of the wheel away stays there until the wheel comes
+ * round to its tick.
+ */
+typedef struct Timer {
+    struct Timer *prev;
+    struct Timer *next;
+    uint64_t tick;
+} Timer;
+
+/*
+ * A hashed timing wheel with TIMER_TICK_MS resolution. Scheduling and
+ * cancelling are O(1); advancing visits only the slots for the ticks that
+ * passed. Timers fire at most one tick late, never early.
+ */
+typedef struct {
+    Timer slots[TIMER_SLOTS];
+    uint64_t tick;
+    size_t pending;
+} TimerWheel;
+
+typedef void (*TimerFn)(Timer *timer, void *context);
+
+void timer_wheel_init(TimerWheel *wheel, uint64_t now_ns);
+/* (Re)schedules `timer` for `deadline_ns`; a deadline already past fires on the next advance. */
+void timer_schedule(TimerWheel *wheel, Timer *timer, uint64_t deadline_ns);
+void timer_cancel(TimerWheel *wheel, Timer *timer);
+
+static inline bool timer_pending(const Timer *timer) {
+    return timer->next != NULL;
+}
+
+/*
+ * Fires every timer due by `now_ns`, each unscheduled before `fire` is
+ * called so it may schedule itself again.
+ */
+void timer_wheel_advance(TimerWheel *wheel, uint64_t now_ns, TimerFn fire, void *context);
+
+#endif
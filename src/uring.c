@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "uring.h"
+
+#ifdef HW4_HAVE_IO_URING
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#define BUFFER_GROUP 0
+
+static int sys_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_enter(Uring *ring, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t size) {
+    ring->syscalls++;
+    return (int)syscall(__NR_io_uring_enter, ring->fd, submit, wait, flags, arg, size);
+}
+
+static int sys_register(Uring *ring, unsigned opcode, void *arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, ring->fd, opcode, arg, count);
+}
+
+static unsigned load_acquire(const unsigned *p) {
+    return atomic_load_explicit((_Atomic unsigned *)p, memory_order_acquire);
+}
+
+static void store_release(unsigned *p, unsigned value) {
+    atomic_store_explicit((_Atomic unsigned *)p, value, memory_order_release);
+}
+
+static bool map_rings(Uring *ring, const struct io_uring_params *params) {
+    ring->sq_map_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        return false;
+    }
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            return false;
+        }
+    }
+    ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return false;
+    }
+
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_entries = params->sq_entries;
+    ring->sq_head = (unsigned *)(sq + params->sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params->sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + params->sq_off.ring_mask);
+    ring->cq_head = (unsigned *)(cq + params->cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params->cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + params->cq_off.ring_mask);
+    ring->cqes = cq + params->cq_off.cqes;
+
+    /* Submission slots are always used in order, so the index array is fixed. */
+    unsigned *array = (unsigned *)(sq + params->sq_off.array);
+    for (unsigned i = 0; i < params->sq_entries; i++) {
+        array[i] = i;
+    }
+    ring->sq_queued = *ring->sq_tail;
+    return true;
+}
+
+static bool provide_buffers(Uring *ring, unsigned count, unsigned size) {
+    ring->buffer_ring_size = count * sizeof(struct io_uring_buf);
+    ring->buffer_ring = mmap(NULL, ring->buffer_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buffer_ring == MAP_FAILED) {
+        ring->buffer_ring = NULL;
+        return false;
+    }
+    ring->buffers = mmap(NULL, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buffers == MAP_FAILED) {
+        ring->buffers = NULL;
+        return false;
+    }
+    ring->buffer_count = count;
+    ring->buffer_size = size;
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring,
+        .ring_entries = count,
+        .bgid = BUFFER_GROUP
+    };
+    if (sys_register(ring, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        return false;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        uring_recycle(ring, (int)i);
+    }
+    return true;
+}
+
+bool uring_init(Uring *ring, unsigned entries, unsigned buffer_count, unsigned buffer_size) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4;
+
+    ring->fd = sys_setup(entries, &params);
+    if (ring->fd == -1) {
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        errno = ENOSYS;
+    } else if (map_rings(ring, &params) && provide_buffers(ring, buffer_count, buffer_size)) {
+        return true;
+    }
+
+    int saved = errno;
+    uring_free(ring);
+    errno = saved;
+    return false;
+}
+
+void uring_free(Uring *ring) {
+    if (ring->fd != -1) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    if (ring->buffers) {
+        munmap(ring->buffers, (size_t)ring->buffer_count * ring->buffer_size);
+    }
+    if (ring->buffer_ring) {
+        munmap(ring->buffer_ring, ring->buffer_ring_size);
+    }
+    ring->sqes = ring->sq_map = ring->cq_map = ring->buffers = ring->buffer_ring = NULL;
+}
+
+static unsigned queued(const Uring *ring) {
+    return ring->sq_queued - load_acquire(ring->sq_head);
+}
+
+static int submit(Uring *ring, unsigned wait, unsigned flags, void *arg, size_t size) {
+    store_release(ring->sq_tail, ring->sq_queued);
+    return sys_enter(ring, queued(ring), wait, flags, arg, size);
+}
+
+static struct io_uring_sqe *next_sqe(Uring *ring) {
+    if (queued(ring) == ring->sq_entries) {
+        if (submit(ring, 0, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EBUSY && errno != EAGAIN) {
+            return NULL;
+        }
+        if (queued(ring) == ring->sq_entries) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *)ring->sqes + (ring->sq_queued & ring->sq_mask);
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_queued++;
+    return sqe;
+}
+
+bool uring_recv_multishot(Uring *ring, int fd, uint64_t data) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = data;
+    return true;
+}
+
+bool uring_send(Uring *ring, int fd, const void *bytes, size_t length, uint64_t data, bool link) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)bytes;
+    sqe->len = (uint32_t)length;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->user_data = data;
+    return true;
+}
+
+bool uring_poll_multishot(Uring *ring, int fd, uint64_t data) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = data;
+    return true;
+}
+
+bool uring_cancel(Uring *ring, uint64_t data) {
+    struct io_uring_sqe *sqe = next_sqe(ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = 0;
+    return true;
+}
+
+int uring_wait(Uring *ring, int timeout_ms) {
+    unsigned ready = load_acquire(ring->cq_tail) - *ring->cq_head;
+    struct __kernel_timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+    struct io_uring_getevents_arg arg = {
+        .ts = timeout_ms >= 0 ? (uint64_t)(uintptr_t)&ts : 0
+    };
+
+    /* Completions already waiting only need the new requests submitted. */
+    if (submit(ring, ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) == -1 &&
+        errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+        return -1;
+    }
+    return (int)(load_acquire(ring->cq_tail) - *ring->cq_head);
+}
+
+bool uring_next(Uring *ring, UringCompletion *completion) {
+    unsigned head = *ring->cq_head;
+    if (head == load_acquire(ring->cq_tail)) {
+        return false;
+    }
+
+    const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)ring->cqes + (head & ring->cq_mask);
+    completion->data = cqe->user_data;
+    completion->result = cqe->res;
+    completion->more = cqe->flags & IORING_CQE_F_MORE;
+    completion->buffer = cqe->flags & IORING_CQE_F_BUFFER ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+    store_release(ring->cq_head, head + 1);
+    return true;
+}
+
+void uring_recycle(Uring *ring, int buffer) {
+    struct io_uring_buf_ring *buffers = ring->buffer_ring;
+    struct io_uring_buf *slot = &buffers->bufs[ring->buffer_tail & (ring->buffer_count - 1)];
+
+    slot->addr = (uint64_t)(uintptr_t)uring_buffer(ring, buffer);
+    slot->len = ring->buffer_size;
+    slot->bid = (uint16_t)buffer;
+    ring->buffer_tail++;
+    atomic_store_explicit((_Atomic uint16_t *)&buffers->tail, ring->buffer_tail, memory_order_release);
+}
+
+#else
+
+/* Built without io_uring headers: every ring fails to start and callers keep to epoll. */
+bool uring_init(Uring *ring, unsigned entries, unsigned buffer_count, unsigned buffer_size) {
+    (void)entries;
+    (void)buffer_count;
+    (void)buffer_size;
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    errno = ENOSYS;
+    return false;
+}
+
+void uring_free(Uring *ring) {
+    (void)ring;
+}
+
+bool uring_recv_multishot(Uring *ring, int fd, uint64_t data) {
+    (void)ring, (void)fd, (void)data;
+    return false;
+}
+
+bool uring_send(Uring *ring, int fd, const void *bytes, size_t length, uint64_t data, bool link) {
+    (void)ring, (void)fd, (void)bytes, (void)length, (void)data, (void)link;
+    return false;
+}
+
+bool uring_poll_multishot(Uring *ring, int fd, uint64_t data) {
+    (void)ring, (void)fd, (void)data;
+    return false;
+}
+
+bool uring_cancel(Uring *ring, uint64_t data) {
+    (void)ring, (void)data;
+    return false;
+}
+
+int uring_wait(Uring *ring, int timeout_ms) {
+    (void)ring, (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+bool uring_next(Uring *ring, UringCompletion *completion) {
+    (void)ring, (void)completion;
+    return false;
+}
+
+void uring_recycle(Uring *ring, int buffer) {
+    (void)ring, (void)buffer;
+}
+
+#endif
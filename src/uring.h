@@ -0,0 +1,86 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A thin io_uring wrapper over the raw system calls, enough for one thread
+ * to drive its sockets: multishot receives into a ring of provided buffers,
+ * sends that may be linked into a chain, multishot polls and cancellation.
+ * Requests are queued in the submission ring and only reach the kernel,
+ * together, on the next uring_wait(), which also collects their completions.
+ *
+ * The ring is set up for a single issuer with deferred task work, so it
+ * needs Linux 6.1 or later; uring_init() fails on anything older, or where
+ * io_uring is disabled, and the caller falls back to epoll.
+ */
+typedef struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_queued;
+    void *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    void *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+    /* Provided buffers, lent to the kernel through buffer group 0. */
+    void *buffer_ring;
+    size_t buffer_ring_size;
+    char *buffers;
+    unsigned buffer_count;
+    unsigned buffer_size;
+    uint16_t buffer_tail;
+    /* io_uring_enter() calls made, for the caller to account. */
+    uint64_t syscalls;
+} Uring;
+
+typedef struct {
+    uint64_t data;
+    int32_t result;
+    /* A multishot request stays armed and will complete again. */
+    bool more;
+    /* The provided buffer holding received bytes, or -1. */
+    int buffer;
+} UringCompletion;
+
+/* `buffer_count` must be a power of two. On failure returns false with errno set. */
+bool uring_init(Uring *ring, unsigned entries, unsigned buffer_count, unsigned buffer_size);
+void uring_free(Uring *ring);
+
+/*
+ * Each queues one request completing with `data`, submitting what is already
+ * queued first if the submission ring is full; false if even that fails.
+ */
+bool uring_recv_multishot(Uring *ring, int fd, uint64_t data);
+/* With `link`, the request queued next only starts once this one sent everything. */
+bool uring_send(Uring *ring, int fd, const void *bytes, size_t length, uint64_t data, bool link);
+bool uring_poll_multishot(Uring *ring, int fd, uint64_t data);
+/* Cancels the request queued with `data`; only a failure completes, with data 0. */
+bool uring_cancel(Uring *ring, uint64_t data);
+
+/*
+ * Submits everything queued and waits up to `timeout_ms` (-1 for ever) for
+ * at least one completion. Returns how many are ready, or -1 with errno set.
+ */
+int uring_wait(Uring *ring, int timeout_ms);
+/* Takes the oldest completion; false once there are none. */
+bool uring_next(Uring *ring, UringCompletion *completion);
+
+static inline const char *uring_buffer(const Uring *ring, int buffer) {
+    return ring->buffers + (size_t)buffer * ring->buffer_size;
+}
+
+/* Hands a provided buffer back to the kernel once its bytes are copied out. */
+void uring_recycle(Uring *ring, int buffer);
+
+#endif
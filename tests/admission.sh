@@ -0,0 +1,70 @@
+#!/bin/bash
+# Checks the limits a server can be given: board area and session count from
+# a config file, then packet rate and idle timeout from flags.
+#
+#   admission.sh SERVER [server args]
+set -u
+
+server=$1
+shift
+conf=$(mktemp)
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -f "$conf" "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+cat > "$conf" <<'CONF'
+# One game at a time, one more pair allowed to wait for it.
+max-sessions = 1
+max-waiting = 1
+max-board-cells = 10000
+CONF
+
+start_server "$server" --config "$conf" "$@"
+connect 3 4
+expect 3 "B 200 200" "E 200"
+expect 3 "B 100 100" "A"
+expect 4 "B" "A"
+
+# The second pair waits for the first game; the third is turned away.
+connect 5 6
+connect 7 8
+expect_closed 7
+expect_closed 8
+printf 'B 10 10\n' >&5
+expect_silence 5
+
+expect 3 "F" "H 0"
+expect_unprompted 4 "H 1"
+expect_unprompted 5 "A"
+expect 6 "B" "A"
+disconnect 3 4
+disconnect 5 6
+disconnect 7 8
+
+kill -TERM $pid
+wait $pid || status=1
+
+# Two packets at once, then one every 200 ms; silence for 500 ms forfeits.
+# Player 2 has sent nothing, so its "H 1" comes unterminated as for a legacy
+# client, and only the close is checked.
+start_server "$server" --packet-rate 5 --packet-burst 2 --idle-timeout 500 "$@"
+connect 3 4
+started=${EPOCHREALTIME/./}
+for i in 1 2 3 4; do
+    expect 3 "Q" "E 100"
+done
+elapsed=$(( (${EPOCHREALTIME/./} - started) / 1000 ))
+if [ $elapsed -lt 300 ]; then
+    echo "four packets at 5 per second took only ${elapsed} ms"
+    status=1
+fi
+expect_unprompted 3 "H 0"
+expect_closed 3
+expect_closed 4
+
+kill -TERM $pid
+wait $pid || status=1
+[ $status -eq 0 ] || cat "$log"
+exit $status
@@ -0,0 +1,73 @@
+#!/bin/bash
+# Plays Player 1 against the built-in AI on its own port: the game starts
+# without a second client, the AI's own packets never reach the player, it
+# refuses a board larger than it plays on, and a whole game shot row by row
+# ends in a halt whichever side wins.
+#
+#   ai_opponent.sh SERVER [server args]
+set -u
+
+server=$1
+shift
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -f "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+start_server "$server" "$@"
+
+challenge 3
+expect 3 "B 2000 2000" "E 200"
+expect 3 "B 10 10" "A"
+expect 3 "$board" "A"
+expect_match 3 "S 0 0" "R 5 [HM]"
+expect 3 "S 0 0" "E 401"
+expect 3 "F" "H 0"
+printf 'F\n' >&3
+expect_closed 3
+
+# The AI forfeits nothing and answers every shot until one side has none left.
+challenge 3
+expect 3 "B 10 10" "A"
+expect 3 "$board" "A"
+ended=
+for row in 0 1 2 3 4 5 6 7 8 9; do
+    for col in 0 1 2 3 4 5 6 7 8 9; do
+        printf 'S %d %d\n' $row $col >&3
+        if ! IFS= read -r -t 5 reply <&3; then
+            reply="(no reply)"
+        fi
+        case $reply in
+        "R 0 H")
+            expect_unprompted 3 "H 1"
+            printf 'F\n' >&3
+            ended=won
+            ;;
+        "H 0")
+            # The AI sank the last ship; the shot just sent acknowledged it.
+            ended=lost
+            ;;
+        "R "[1-5]" "[HM]) ;;
+        *)
+            echo "shot $row $col got '$reply'"
+            status=1
+            ended=failed
+            ;;
+        esac
+        [ -n "$ended" ] && break 2
+    done
+done
+if [ -z "$ended" ]; then
+    echo "the game did not end in 100 shots"
+    status=1
+fi
+expect_closed 3
+
+kill -TERM $pid
+wait $pid || status=1
+
+[ $status -eq 0 ] || cat "$log"
+exit $status
@@ -0,0 +1,103 @@
+# Helpers for tests that play a game by hand over bash's /dev/tcp, sourced
+# by the test scripts. The caller sets $log and $status and an EXIT trap that
+# kills $pid.
+
+listening() {
+    awk 'NR > 1 && $4 == "0A" { print $2 }' /proc/net/tcp /proc/net/tcp6 2>/dev/null |
+        grep -q ":$1\$"
+}
+
+# start_server SERVER [args]: starts it in the background and waits for both
+# listeners without connecting, since a probe would be paired as a player.
+start_server() {
+    "$@" --metrics-port 0 >> "$log" 2>&1 &
+    pid=$!
+    tries=0
+    until listening 0899 && listening 089A; do
+        tries=$((tries + 1))
+        if [ $tries -gt 100 ] || ! kill -0 $pid 2>/dev/null; then
+            echo "server did not start"
+            cat "$log"
+            exit 1
+        fi
+        sleep 0.05
+    done
+}
+
+# connect [P1FD P2FD]: Player 1 talks on fd 3 and Player 2 on fd 4 unless
+# other descriptors are given.
+connect() {
+    eval "exec ${1:-3}<>/dev/tcp/127.0.0.1/2201 ${2:-4}<>/dev/tcp/127.0.0.1/2202"
+}
+
+# join FD: connects to the lobby, where the first Begin decides the role.
+join() {
+    eval "exec $1<>/dev/tcp/127.0.0.1/2200"
+}
+
+# challenge FD: connects to the AI port, where the AI is already Player 2.
+challenge() {
+    eval "exec $1<>/dev/tcp/127.0.0.1/2205"
+}
+
+disconnect() {
+    eval "exec ${1:-3}>&- ${2:-4}>&-"
+}
+
+# expect FD PACKET REPLY: sends PACKET as one player and checks the reply.
+expect() {
+    printf '%s\n' "$2" >&"$1"
+    if ! IFS= read -r -t 5 reply <&"$1"; then
+        reply="(no reply)"
+    fi
+    if [ "$reply" != "$3" ]; then
+        echo "sent '$2', expected '$3', got '$reply'"
+        status=1
+    fi
+}
+
+# expect_match FD PACKET PATTERN: like expect, for a reply only known up to
+# a glob pattern, such as one to a shot at the AI's hidden fleet.
+expect_match() {
+    printf '%s\n' "$2" >&"$1"
+    if ! IFS= read -r -t 5 reply <&"$1"; then
+        reply="(no reply)"
+    fi
+    case $reply in
+    $3) ;;
+    *)
+        echo "sent '$2', expected '$3', got '$reply'"
+        status=1
+        ;;
+    esac
+}
+
+# expect_unprompted FD REPLY: checks a reply that needs no packet, like the
+# winner's halt.
+expect_unprompted() {
+    if ! IFS= read -r -t 5 reply <&"$1"; then
+        reply="(no reply)"
+    fi
+    if [ "$reply" != "$2" ]; then
+        echo "expected '$2' unprompted, got '$reply'"
+        status=1
+    fi
+}
+
+# expect_closed FD: the server closes the connection without replying.
+expect_closed() {
+    IFS= read -r -t 5 reply <&"$1"
+    case $? in
+    0) echo "expected fd $1 to close, got '$reply'"; status=1 ;;
+    1) ;;
+    *) echo "expected fd $1 to close, it is still open"; status=1 ;;
+    esac
+}
+
+# expect_silence FD: nothing arrives for a moment.
+expect_silence() {
+    if IFS= read -r -t 0.3 reply <&"$1"; then
+        echo "expected no reply on fd $1, got '$reply'"
+        status=1
+    fi
+}
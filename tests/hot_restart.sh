@@ -0,0 +1,100 @@
+#!/bin/bash
+# Restarts the server under live games with --handoff: a new server takes
+# over the listeners, the sessions and the players still waiting from the
+# running one, which exits. Games must carry on as if nothing happened: one
+# played by hand, restarted mid-turn from io_uring onto epoll with a packet
+# it had read but not answered, one against the AI, whose shots must carry
+# over too, then loadgen's across two more restarts.
+#
+#   hot_restart.sh SERVER LOADGEN [server args]
+set -u
+
+server=$1 loadgen=$2
+shift 2
+dir=$(mktemp -d)
+socket=$dir/handoff.sock
+log=$dir/log
+pid=
+status=0
+trap 'kill $pid 2>/dev/null; rm -rf "$dir"' EXIT
+. "$(dirname "$0")/client.sh"
+
+# restart [args]: starts a server that takes over from $pid and waits for
+# the old one to exit.
+restart() {
+    old=$pid
+    "$server" --handoff "$socket" --metrics-port 0 "$@" >> "$log" 2>&1 &
+    pid=$!
+    tries=0
+    until [ "$(grep -c 'Took over' "$log")" -gt "${restarts:-0}" ]; do
+        tries=$((tries + 1))
+        if [ $tries -gt 100 ] || ! kill -0 $pid 2>/dev/null; then
+            echo "server did not take over"
+            cat "$log"
+            exit 1
+        fi
+        sleep 0.05
+    done
+    restarts=$((${restarts:-0} + 1))
+    wait $old || status=1
+}
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+start_server "$server" --handoff "$socket" --io-backend io_uring "$@"
+connect
+expect 3 "B 10 10" "A"
+expect 4 "B" "A"
+expect 3 "$board" "A"
+expect 4 "$board" "A"
+expect 3 "S 0 0" "R 5 H"
+expect 4 "S 9 9" "R 5 M"
+expect 3 "S 0 1" "R 5 M"
+# Out of turn, so it waits, and is only answered after the restart.
+printf 'Q\n' >&3
+# A player still waiting for an opponent, and one in the lobby yet to speak.
+exec 5<>/dev/tcp/127.0.0.1/2201
+join 7
+challenge 8
+expect 8 "B 10 10" "A"
+expect 8 "$board" "A"
+expect_match 8 "S 9 9" "R 5 [HM]"
+sleep 0.2
+
+restart "$@"
+expect 4 "Q" "G 5 M 9 9"
+expect 4 "S 5 5" "R 5 M"
+expect_unprompted 3 "G 5 H 0 0 M 0 1"
+expect 3 "Q 1" "G 5 M 0 1"
+exec 6<>/dev/tcp/127.0.0.1/2202
+expect 5 "B 12 12" "A"
+expect 6 "B" "A"
+expect 7 "S 1 1" "E 100"
+expect 8 "S 9 9" "E 401"
+expect_match 8 "S 9 8" "R 5 [HM]"
+expect 8 "F" "H 0"
+printf 'F\n' >&8
+expect_closed 8
+expect 3 "F" "H 0"
+printf 'F\n' >&3
+expect_unprompted 4 "H 1"
+disconnect
+disconnect 5 6
+disconnect 7
+disconnect 8
+
+"$loadgen" --games 600 --concurrency 100 --size 20x20 > "$dir/loadgen" &
+games=$!
+"$loadgen" --ai 2205 --games 300 --concurrency 50 --size 20x20 > "$dir/loadgen_ai" &
+ai_games=$!
+sleep 0.3
+restart "$@"
+sleep 0.3
+restart "$@" --io-backend io_uring
+wait $games || { status=1; cat "$dir/loadgen"; }
+wait $ai_games || { status=1; cat "$dir/loadgen_ai"; }
+
+kill -TERM $pid
+wait $pid || status=1
+[ $status -eq 0 ] || cat "$log"
+exit $status
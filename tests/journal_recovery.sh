@@ -0,0 +1,68 @@
+#!/bin/bash
+# Plays part of a game against a journaling server, kills the server with
+# SIGKILL, starts a new one on the same journal and has the players take the
+# game over with "C <session>". The boards and shot history must survive. A
+# game on a board too big for the AI can only be taken over by players.
+#
+#   journal_recovery.sh SERVER [server args]
+set -u
+
+server=$1
+shift
+journal=$(mktemp -d)
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -rf "$journal" "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+start_server "$server" --journal "$journal" "$@"
+connect
+expect 3 "B 10 10" "A"
+expect 4 "B" "A"
+expect 3 "$board" "A"
+expect 4 "$board" "A"
+expect 3 "S 0 0" "R 5 H"
+expect 4 "S 9 9" "R 5 M"
+expect 3 "S 5 5" "R 5 M"
+session=$(sed -n 's/.*\[Session \([0-9]*\)\] Started.*/\1/p' "$log" | head -n 1)
+connect 5 6
+expect 5 "B 2000 2000" "A"
+expect 6 "B" "A"
+expect 5 "$board" "A"
+expect 6 "$board" "A"
+expect 5 "S 0 0" "R 5 H"
+big=$(sed -n 's/.*\[Session \([0-9]*\)\] Started.*/\1/p' "$log" | sed -n 2p)
+
+{ kill -9 $pid; wait $pid; } 2>/dev/null
+disconnect
+disconnect 5 6
+
+start_server "$server" --journal "$journal" "$@"
+connect
+expect 3 "C 999" "E 100"
+disconnect
+challenge 5
+expect 5 "C $big" "E 100"
+expect 5 "B 10 10" "A"
+disconnect 5 5
+connect 5 6
+expect 5 "C $big" "A"
+expect 6 "S 1 1" "R 5 M"
+expect 5 "Q" "G 5 H 0 0"
+disconnect 5 6
+connect
+expect 3 "C $session" "A"
+expect 4 "Q" "G 5 M 9 9"
+expect 4 "S 0 1" "R 5 M"
+expect 3 "Q 1" "G 5 M 5 5"
+expect 3 "F" "H 0"
+printf 'F\n' >&3
+expect_unprompted 4 "H 1"
+
+kill -TERM $pid
+wait $pid || status=1
+[ $status -eq 0 ] || cat "$log"
+exit $status
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Runs replay_scripts.sh against a server that journals its games, then
+# re-runs the journal with journal_replay. Every step must replay to the
+# reply the server sent; with JOURNAL_EXPECTED the replay transcript must
+# also match it.
+#
+#   journal_replay.sh JOURNAL_REPLAY JOURNAL_EXPECTED|"" REPLAY_SCRIPTS SERVER LOADGEN SCRIPTS|"" EXPECTED|"" [server args] [-- loadgen args]
+set -u
+
+journal_replay=$1 journal_expected=$2 replay_scripts=$3
+server=$4 loadgen=$5 scripts=$6 expected=$7
+shift 7
+journal=$(mktemp -d)
+transcript=$(mktemp)
+trap 'rm -rf "$journal" "$transcript"' EXIT
+
+"$replay_scripts" "$server" "$loadgen" "$scripts" "$expected" --journal "$journal" "$@" || exit 1
+
+"$journal_replay" "$journal"/*.journal > "$transcript" || { cat "$transcript"; exit 1; }
+if [ -n "$journal_expected" ]; then
+    diff -u "$journal_expected" "$transcript" || exit 1
+fi
+exit 0
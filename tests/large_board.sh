@@ -0,0 +1,44 @@
+#!/bin/bash
+# Plays on a 100000x100000 board. The boards must go sparse on their own and
+# the server must stay small; a dense board this size would be 10 GB each.
+#
+#   large_board.sh SERVER [server args]
+set -u
+
+server=$1
+shift
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -f "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+start_server "$server" "$@"
+connect
+expect 3 "B 100000 100000" "A"
+expect 4 "B" "A"
+expect 3 "$board" "A"
+expect 4 "I 1 1 99996 99999 1 1 0 99999 1 1 50000 50000 2 1 99998 0 7 1 0 1" "A"
+expect 3 "S 99999 99999" "R 5 H"
+expect 4 "S 0 0" "R 5 H"
+expect 3 "S 99999 99999" "E 401"
+expect 3 "S 12345 67890" "R 5 M"
+expect 4 "S 100000 0" "E 400"
+expect 4 "S 99999 99999" "R 5 M"
+expect 3 "Q" "G 5 M 12345 67890 H 99999 99999"
+expect 3 "F" "H 0"
+printf 'F\n' >&3
+expect_unprompted 4 "H 1"
+
+peak=$(awk '/^VmHWM:/ { print $2 }' /proc/$pid/status)
+if [ "$peak" -gt 65536 ]; then
+    echo "server peaked at ${peak} kB"
+    status=1
+fi
+
+kill -TERM $pid
+wait $pid || status=1
+[ $status -eq 0 ] || cat "$log"
+exit $status
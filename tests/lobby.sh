@@ -0,0 +1,102 @@
+#!/bin/bash
+# Plays through the lobby port: the Begin each player sends decides its role
+# whatever order they join in, anything else first is answered like the
+# Begin phase would answer it, and a lobby player pairs with one who dialed
+# the other player's own port. A binary Begin split across writes waits for
+# the rest without busying its worker, and a silent lobby player is closed
+# once its deadline passes.
+#
+#   lobby.sh SERVER [server args]
+set -u
+
+server=$1
+shift
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -f "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+start_server "$server" "$@"
+
+# Player 2 joins first and is kept waiting until a Player 1 turns up.
+join 4
+expect 4 "S 0 0" "E 100"
+printf 'B\n' >&4
+expect_silence 4
+join 3
+expect 3 "B 10 10" "A"
+expect_unprompted 4 "A"
+expect 3 "$board" "A"
+expect 4 "$board" "A"
+expect 3 "F" "H 0"
+printf 'F\n' >&3
+expect_unprompted 4 "H 1"
+printf 'F\n' >&4
+expect_closed 3
+expect_closed 4
+
+# A player who forfeits in the lobby just leaves it.
+join 5
+printf 'F\n' >&5
+expect_closed 5
+
+# The lobby and the player ports feed the same pairing.
+join 5
+eval "exec 6<>/dev/tcp/127.0.0.1/2202"
+expect 5 "B 10 10" "A"
+expect 6 "B" "A"
+printf 'F\n' >&5
+expect_unprompted 5 "H 0"
+expect_unprompted 6 "H 1"
+expect_closed 5
+expect_closed 6
+
+# CPU time the server has used, in clock ticks.
+cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$pid/stat
+}
+
+# Player 1 sends the first byte of a binary "B 10 10" and the rest later.
+join 5
+printf '\xc2' >&5
+sleep 0.2
+before=$(cpu_ticks)
+sleep 0.5
+spent=$(($(cpu_ticks) - before))
+if [ $spent -gt 10 ]; then
+    echo "server used $spent ticks waiting on a partial record"
+    status=1
+fi
+printf '\x0a\x00\x00\x00\x0a\x00\x00\x00' >&5
+eval "exec 6<>/dev/tcp/127.0.0.1/2202"
+expect 6 "B" "A"
+reply=$(timeout 5 head -c 1 <&5 | od -An -tx1 | tr -d ' ')
+if [ "$reply" != "c1" ]; then
+    echo "expected a binary 'A' (c1), got '$reply'"
+    status=1
+fi
+printf '\xc6' >&5
+expect_unprompted 6 "H 1"
+expect_closed 6
+disconnect 5 6
+
+kill -TERM $pid
+wait $pid || status=1
+
+# A lobby player who never sends a Begin is closed at its deadline.
+start_server "$server" --idle-timeout 300 "$@"
+join 5
+expect_closed 5
+# Closing on part of a record resets the connection, as the rest is unread.
+join 5
+printf '\xc2' >&5
+expect_closed 5 2>/dev/null
+
+kill -TERM $pid
+wait $pid || status=1
+
+[ $status -eq 0 ] || cat "$log"
+exit $status
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Starts a server, plays games against it with loadgen and stops it again.
+# With a scripts directory every p1_/p2_ pair is played once in name order
+# and the transcript must match EXPECTED; without one loadgen plays random
+# games and only has to finish them all.
+#
+#   replay_scripts.sh SERVER LOADGEN SCRIPTS_DIR|"" EXPECTED|"" [server args] [-- loadgen args]
+set -u
+
+server=$1 loadgen=$2 scripts=$3 expected=$4
+shift 4
+server_args=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    server_args="$server_args $1"
+    shift
+done
+[ $# -gt 0 ] && shift
+
+log=$(mktemp)
+transcript=$(mktemp)
+trap 'kill $pid 2>/dev/null; rm -f "$log" "$transcript"' EXIT
+
+$server $server_args > "$log" 2>&1 &
+pid=$!
+
+# Wait for both listeners without connecting: a probe would be paired as a player.
+listening() {
+    awk 'NR > 1 && $4 == "0A" { print $2 }' /proc/net/tcp /proc/net/tcp6 2>/dev/null |
+        grep -q ":$1\$"
+}
+tries=0
+until listening 0899 && listening 089A; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ] || ! kill -0 $pid 2>/dev/null; then
+        echo "server did not start"
+        cat "$log"
+        exit 1
+    fi
+    sleep 0.05
+done
+
+if [ -n "$scripts" ]; then
+    count=$(ls "$scripts" | grep -c '^p1_')
+    "$loadgen" --scripts "$scripts" --games "$count" --concurrency 1 --verbose "$@" > "$transcript"
+    status=$?
+    grep -E ' (sent|received): ' "$transcript" | diff -u "$expected" - || status=1
+else
+    "$loadgen" "$@"
+    status=$?
+fi
+
+kill -TERM $pid
+wait $pid || status=1
+exit $status
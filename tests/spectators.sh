@@ -0,0 +1,73 @@
+#!/bin/bash
+# Attaches spectators to a game already in play, one on the worker running
+# it and one that has to be passed over from another, and checks both are
+# caught up and then see every shot and the winner. Asking for a session
+# that does not exist is refused.
+#
+#   spectators.sh SERVER [server args]
+set -u
+
+server=$1
+shift
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -f "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+# watch FD SESSION: connects a spectator and asks for the session.
+watch() {
+    eval "exec $1<>/dev/tcp/127.0.0.1/2204"
+    printf 'W %s\n' "$2" >&"$1"
+}
+
+start_server "$server" "$@"
+until listening 089C; do
+    sleep 0.05
+done
+
+connect 3 4
+expect 3 "B 10 10" "A"
+expect 4 "B" "A"
+expect 3 "$board" "A"
+expect 4 "$board" "A"
+expect 3 "S 0 0" "R 5 H"
+
+# Spectators are spread over the workers, so one of these is passed on.
+for fd in 7 8; do
+    watch $fd 1
+    expect_unprompted $fd "A"
+    expect_unprompted $fd "B 10 10"
+    expect_unprompted $fd "S 1 0 0 5 H"
+done
+
+expect 4 "S 9 9" "R 5 M"
+expect 3 "S 1 0" "R 5 H"
+for fd in 7 8; do
+    expect_unprompted $fd "S 2 9 9 5 M"
+    expect_unprompted $fd "S 1 1 0 5 H"
+done
+
+# Player 2 forfeits; both acknowledgements end the game.
+expect 4 "F" "H 0"
+printf 'F\n' >&4
+expect_unprompted 3 "H 1"
+printf 'F\n' >&3
+for fd in 7 8; do
+    expect_unprompted $fd "H 1"
+    expect_closed $fd
+done
+expect_closed 3
+expect_closed 4
+
+watch 7 99
+expect_unprompted 7 "E 100"
+expect_closed 7
+
+kill -TERM $pid
+wait $pid || status=1
+
+[ $status -eq 0 ] || cat "$log"
+exit $status
@@ -0,0 +1,60 @@
+#!/bin/bash
+# Runs a server with a short turn timeout and checks that a player who stops
+# moving forfeits with the usual halts while the other keeps being served,
+# and that a loser who never acknowledges its halt does not hold up the
+# winner's. The journal must replay the timeouts exactly.
+#
+#   timeouts.sh SERVER JOURNAL_REPLAY [server args]
+set -u
+
+server=$1
+journal_replay=$2
+shift 2
+journal=$(mktemp -d)
+log=$(mktemp)
+pid=
+status=0
+trap 'kill -9 $pid 2>/dev/null; rm -rf "$journal" "$log"' EXIT
+. "$(dirname "$0")/client.sh"
+
+board="I 1 1 0 0 1 1 0 2 1 1 0 4 1 1 0 6 1 1 0 8"
+
+start_server "$server" --turn-timeout 300 --journal "$journal" "$@"
+
+# Player 2 stops after one shot; Player 1 keeps querying, which is no move.
+connect 3 4
+expect 3 "B 10 10" "A"
+expect 4 "B" "A"
+expect 3 "$board" "A"
+expect 4 "$board" "A"
+expect 3 "S 0 0" "R 5 H"
+expect_unprompted 4 "H 0"
+expect_unprompted 3 "H 1"
+expect_closed 4
+expect_closed 3
+
+# Player 1 forfeits and never acknowledges; Player 2 still hears it won.
+connect 5 6
+expect 5 "B 10 10" "A"
+expect 6 "B" "A"
+expect 5 "$board" "A"
+expect 6 "$board" "A"
+expect 5 "F" "H 0"
+expect_unprompted 6 "H 1"
+printf 'F\n' >&6
+expect_closed 5
+expect_closed 6
+
+kill -TERM $pid
+wait $pid || status=1
+
+transcript=$("$journal_replay" "$journal"/worker-*.journal 2>&1) || status=1
+for line in "P2 sent: (timed out)" "P1 sent: (timed out)"; do
+    if ! grep -qF "$line" <<< "$transcript"; then
+        echo "journal transcript has no '$line'"
+        status=1
+    fi
+done
+
+[ $status -eq 0 ] || { cat "$log"; echo "$transcript"; }
+exit $status
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Builds a profile-guided server: an instrumented build plays the scripts/
+# corpus and generated games against a live server plus in-process self-play,
+# then the same tree is rebuilt with the collected profiles.
+#
+#   tools/pgo_train.sh [build-dir]      (default build/pgo)
+set -eu
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=${1:-$root/build/pgo}
+profiles=$build/pgo-profiles
+
+cmake -S "$root" -B "$build" -DCMAKE_BUILD_TYPE=Release -DHW4_LTO=ON -DHW4_PGO=GENERATE
+rm -rf "$profiles"
+cmake --build "$build" --target server loadgen selfplay -j"$(nproc)"
+
+replay=$root/tests/replay_scripts.sh
+server=$build/server
+loadgen=$build/loadgen
+scripts=$root/scripts
+games=$(ls "$scripts" | grep -c '^p1_')
+
+# The turn loop dominates production traffic, so most of the training is full
+# games; the scripts keep the error paths from being treated as cold.
+"$replay" "$server" "$loadgen" "" "" --workers 2 -- \
+    --scripts "$scripts" --games $((games * 200)) --concurrency 32 > /dev/null
+"$replay" "$server" "$loadgen" "" "" --workers 2 -- \
+    --games 3000 --concurrency 200 --size 10x10 > /dev/null
+"$replay" "$server" "$loadgen" "" "" --workers 2 --board bitboard -- \
+    --games 300 --concurrency 50 --size 40x40 --legacy > /dev/null
+"$build/selfplay" --games 200000 --threads 2 > /dev/null
+
+cmake -S "$root" -B "$build" -DHW4_PGO=USE
+cmake --build "$build" -j"$(nproc)"
+echo "PGO build ready in $build"